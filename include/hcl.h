@@ -13,6 +13,7 @@
 #include <hcl/clock/global_clock.h>
 #include <hcl/communication/rpc_lib.h>
 #include <hcl/unordered_map/unordered_map.h>
+#include <hcl/flat_unordered_map/flat_unordered_map.h>
 #include <hcl/map/map.h>
 #include <hcl/multimap/multimap.h>
 #include <hcl/priority_queue/priority_queue.h>
@@ -70,31 +70,7 @@ class global_clock {
         name = name+"_"+std::to_string(my_server);
         rpc = Singleton<RPCFactory>::GetInstance()->GetRPC(port);
         if (is_server) {
-            switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-                case RPCLIB: {
-                std::function<HTime(void)> getTimeFunction(
-                    std::bind(&global_clock::LocalGetTime, this));
-                rpc->bind(func_prefix+"_GetTime", getTimeFunction);
-                break;
-            }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-                case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-                    case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-                {
-                    std::function<void(const tl::request &)> getTimeFunction(
-                            std::bind(&global_clock::ThalliumLocalGetTime, this,
-                                      std::placeholders::_1));
-                    rpc->bind(func_prefix+"_GetTime", getTimeFunction);
-                    break;
-                }
-#endif
-            }
+            rpc->bind_method(func_prefix+"_GetTime", this, &global_clock::LocalGetTime);
 
             bip::file_mapping::remove(backed_file.c_str());
             segment = bip::managed_mapped_file(bip::create_only, backed_file.c_str(),
@@ -166,9 +142,6 @@ class global_clock {
         return t;
     }
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE1(LocalGetTime)
-#endif
 
 };
 
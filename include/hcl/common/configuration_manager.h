@@ -30,12 +30,38 @@ namespace hcl{
     public:
         uint16_t RPC_PORT;
         uint16_t RPC_THREADS;
+        /* informational: the transport of RPC is selected at compile time, see rpc_lib.h */
         RPCImplementation RPC_IMPLEMENTATION;
+        /* rpclib connections kept to every server and how a call picks one of them */
+        uint16_t RPC_CLIENTS_PER_SERVER;
+        RPCClientSelection RPC_CLIENT_SELECTION;
+        /* resolved endpoints/connections kept for calls addressing a server by host and port */
+        size_t RPC_ENDPOINT_CACHE_SIZE;
         int MPI_RANK, COMM_SIZE;
         CharStruct TCP_CONF;
         CharStruct VERBS_CONF;
         CharStruct VERBS_DOMAIN;
+        /* Mercury plugin used instead of TCP_CONF/VERBS_CONF for servers on this node */
+        CharStruct SHM_CONF;
+        bool USE_SHM_TRANSPORT;
         really_long MEMORY_ALLOCATED;
+        /* the segment of a container grows by its size when full, instead of failing the insert */
+        bool GROW_MEMORY;
+        /* fraction of the segment in use past which the watermark callback of a container runs */
+        double MEMORY_HIGH_WATERMARK;
+        /* madvise segments for transparent huge pages; for hugetlbfs point BACKED_FILE_DIR to its mount */
+        bool MEMORY_HUGEPAGES;
+        /* NUMA placement of the segments of the servers, see SegmentPlacement */
+        SegmentNumaPolicy MEMORY_NUMA_POLICY;
+        std::vector<int> MEMORY_NUMA_NODES;
+        /* servers keep their segment file and recover its data when started again */
+        bool MEMORY_PERSISTENT;
+        /* modifications of persistent segments are flushed to the file before they return; each flush
+         * is an msync of the whole mapping, whose cost grows with the segment, see WriteGuard */
+        bool MEMORY_SYNC_ON_WRITE;
+        /* what a server does with a persistent segment a process crashed writing to, see open_persistent_segment */
+        SegmentRecovery MEMORY_RECOVERY;
+        CharStruct MEMORY_RECOVERY_SNAPSHOT;
 
         bool IS_SERVER;
         uint16_t MY_SERVER;
@@ -44,14 +70,56 @@ namespace hcl{
         CharStruct SERVER_LIST_PATH;
         std::vector<CharStruct> SERVER_LIST;
         CharStruct BACKED_FILE_DIR;
+        /* values at least this many bytes are moved with Thallium bulk transfers */
+        size_t BULK_TRANSFER_THRESHOLD;
+        /* tables, each with its own lock, hcl::unordered_map splits the data of a server in */
+        uint16_t UNORDERED_MAP_SHARDS;
+        /* slots of the table of each hcl::flat_unordered_map server, rounded up to a power of two */
+        size_t FLAT_MAP_CAPACITY;
+        /* points of each server on the ring of hcl::ring_partitioner: more even load, 10 bytes each per container */
+        uint16_t RING_VIRTUAL_NODES;
+        /* hcl::unordered_map servers evict entries past these bounds, for all their shards together, 0 for no bound */
+        size_t CACHE_CAPACITY_ENTRIES;
+        really_long CACHE_CAPACITY_BYTES;
+        EvictionPolicy CACHE_EVICTION_POLICY;
+        /* servers of hcl::unordered_map and hcl::map reclaim up to TTL_SWEEP_BATCH expired entries
+         * (buckets of each shard for hcl::unordered_map) every TTL_SWEEP_INTERVAL_MS, 0 to only expire lazily */
+        really_long TTL_SWEEP_INTERVAL_MS;
+        size_t TTL_SWEEP_BATCH;
+        /* clients reuse values of remote Gets of hcl::unordered_map and hcl::map for this long, 0 to not cache */
+        really_long CLIENT_CACHE_LEASE_MS;
+        size_t CLIENT_CACHE_ENTRIES;
 
-        bool DYN_CONFIG;  // Does not do anything (yet)
+        /* servers may join and leave hcl::unordered_map while it runs, see unordered_map::Join */
+        bool DYN_CONFIG;
+        /* with DYN_CONFIG, how often clients fetch the servers of a container, and the entries per RPC of a move */
+        really_long MEMBERSHIP_REFRESH_MS;
+        size_t REBALANCE_BATCH;
+        /* a change of the servers is aborted once a server involved did not answer for this long; a server
+         * of an ordered hcl::map waits as long for the first server to check its split points */
+        really_long REBALANCE_TIMEOUT_MS;
+        /* copies of each key of hcl::unordered_map, map and set, the primary and its backups, with the mode
+         * and the read policy; the defaults of ReplicationOptions, which a container may be given instead */
+        uint16_t REPLICATION_FACTOR;
+        ReplicationMode REPLICATION_MODE;
+        ReadPolicy REPLICATION_READ_POLICY;
+        /* changes per RPC to a backup */
+        size_t REPLICATION_BATCH;
 
       ConfigurationManager():
               SERVER_LIST(),
-              BACKED_FILE_DIR("/dev/shm"),
-              MEMORY_ALLOCATED(1024ULL * 1024ULL * 128ULL),
+              BACKED_FILE_DIR("/dev/shm"), BULK_TRANSFER_THRESHOLD(4096),
+              UNORDERED_MAP_SHARDS(16), FLAT_MAP_CAPACITY(4096), RING_VIRTUAL_NODES(256),
+              CACHE_CAPACITY_ENTRIES(0), CACHE_CAPACITY_BYTES(0), CACHE_EVICTION_POLICY(EVICT_LRU),
+              TTL_SWEEP_INTERVAL_MS(1000), TTL_SWEEP_BATCH(1024),
+              CLIENT_CACHE_LEASE_MS(0), CLIENT_CACHE_ENTRIES(4096),
+              MEMORY_ALLOCATED(1024ULL * 1024ULL * 128ULL), GROW_MEMORY(true), MEMORY_HIGH_WATERMARK(0.9),
+              MEMORY_HUGEPAGES(false), MEMORY_NUMA_POLICY(NUMA_DEFAULT), MEMORY_NUMA_NODES(),
+              MEMORY_PERSISTENT(false), MEMORY_SYNC_ON_WRITE(false),
+              MEMORY_RECOVERY(RECOVER_REFUSE), MEMORY_RECOVERY_SNAPSHOT(""),
               RPC_PORT(9000), RPC_THREADS(1),
+              RPC_CLIENTS_PER_SERVER(1), RPC_CLIENT_SELECTION(THREAD_AFFINE),
+              RPC_ENDPOINT_CACHE_SIZE(64),
 #if defined(HCL_ENABLE_RPCLIB)
               RPC_IMPLEMENTATION(RPCLIB),
 #elif defined(HCL_ENABLE_THALLIUM_TCP)
@@ -60,8 +128,12 @@ namespace hcl{
         RPC_IMPLEMENTATION(THALLIUM_ROCE),
 #endif
               TCP_CONF("ofi+sockets"), VERBS_CONF("ofi-verbs"), VERBS_DOMAIN("mlx5_0"),
+              SHM_CONF("na+sm"), USE_SHM_TRANSPORT(false),
               IS_SERVER(false), MY_SERVER(0), NUM_SERVERS(1),
-              SERVER_ON_NODE(true), SERVER_LIST_PATH("./server_list"), DYN_CONFIG(false) {
+              SERVER_ON_NODE(true), SERVER_LIST_PATH("./server_list"), DYN_CONFIG(false),
+              MEMBERSHIP_REFRESH_MS(1000), REBALANCE_BATCH(1024), REBALANCE_TIMEOUT_MS(10000),
+              REPLICATION_FACTOR(1), REPLICATION_MODE(REPLICATE_SYNC), REPLICATION_READ_POLICY(READ_PRIMARY),
+              REPLICATION_BATCH(1024) {
           AutoTrace trace = AutoTrace("ConfigurationManager");
           MPI_Comm_size(MPI_COMM_WORLD, &COMM_SIZE);
           MPI_Comm_rank(MPI_COMM_WORLD, &MPI_RANK);
@@ -13,13 +13,69 @@
 #ifndef HCL_CONTAINER_H
 #define HCL_CONTAINER_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <future>
+#include <random>
+#include <any>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include <unordered_map>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <hcl/communication/rpc_lib.h>
 #include <hcl/communication/rpc_factory.h>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_sharable_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/interprocess/sync/sharable_lock.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <hcl/common/memory_placement.h>
 #include "typedefs.h"
 
 namespace hcl{
+/*
+ * Locks of the data of containers in shared memory. With
+ * HCL_ENABLE_SHARED_LOCKS, operations that only read take the mutex shared
+ * so that concurrent readers do not block each other; writers still take it
+ * exclusively. Without it both are the plain exclusive mutex, which is
+ * cheaper when writes dominate.
+ */
+#ifdef HCL_ENABLE_SHARED_LOCKS
+typedef boost::interprocess::interprocess_sharable_mutex Mutex;
+typedef boost::interprocess::sharable_lock<Mutex> ReadLock;
+#else
+typedef boost::interprocess::interprocess_mutex Mutex;
+typedef boost::interprocess::scoped_lock<Mutex> ReadLock;
+#endif
+typedef boost::interprocess::scoped_lock<Mutex> WriteLock;
+/* Held shared by operations of guarded containers and exclusively while the segment grows or is copied. */
+typedef boost::interprocess::interprocess_sharable_mutex SegmentMutex;
+
+/* Header of persistent segments, validated when a server opens one again. */
+struct PersistentHeader {
+    static constexpr uint64_t MAGIC = 0x544d4745534c4348ULL;  /* "HCLSEGMT" */
+    static constexpr uint32_t VERSION = 2;
+    uint64_t magic;
+    uint32_t version;
+    /* modifications in progress, left non zero by a process that crashed in one */
+    std::atomic<uint32_t> pending_writes;
+    PersistentHeader() : magic(MAGIC), version(VERSION), pending_writes(0) {}
+};
+
     class container{
     protected:
         int comm_size, my_rank, num_servers;
@@ -29,8 +85,424 @@ namespace hcl{
         bool is_server;
         boost::interprocess::managed_mapped_file segment;
         CharStruct name, func_prefix;
-        boost::interprocess::interprocess_mutex* mutex;
+        Mutex* mutex;
         CharStruct backed_file;
+        /* named server-side functions of the container, see RegisterCallback */
+        std::unordered_map<std::string, std::any> callbacks;
+        /*
+         * Growth of the segment, see WithSegment. Containers whose operations
+         * all run through WithSegment set guarded; generation counts the
+         * replacements of the file and this process maps it at local_generation.
+         */
+        bool guarded;
+        bool grow_memory;
+        SegmentMutex* segment_mutex;
+        std::atomic<uint32_t>* generation;
+        uint32_t local_generation;
+        /* threads of this process using the mapping, so that it is replaced only when none does */
+        std::shared_mutex segment_users;
+        double memory_high_watermark;
+        std::atomic<bool> above_watermark;
+        std::function<void(really_long, really_long)> watermark_callback;
+        SegmentPlacement* placement;
+        /*
+         * Persistence, see init_shared_memory. header is null unless the
+         * segment is persistent; recovered is set on servers that found the
+         * data of a previous run.
+         */
+        bool persistent;
+        bool sync_on_write;
+        bool recovered;
+        PersistentHeader* header;
+        /* the image of the last Snapshot while it is written out, see LocalSnapshot */
+        std::mutex snapshot_mutex;
+        std::future<bool> snapshot_write;
+        /* periodic work of the server on its segment, see StartMaintenance */
+        std::thread maintenance_thread;
+        std::mutex maintenance_mutex;
+        std::condition_variable maintenance_wakeup;
+        bool maintenance_stop;
+
+        /*
+         * Expiry times of entries are milliseconds of the system clock, which
+         * all processes of a node share and which keeps counting across restarts
+         * of persistent servers. 0 means the entry does not expire.
+         */
+        static really_long now_ms() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        static really_long expiry_time(really_long ttl_ms) {
+            return ttl_ms == 0 ? 0 : now_ms() + ttl_ms;
+        }
+        /* The inverse of expiry_time, for entries sent to other servers; at least 1 if it expires. */
+        static really_long time_left(really_long expires_at) {
+            return expires_at == 0 ? 0 : std::max<really_long>(expires_at - now_ms(), 1);
+        }
+        static bool is_expired(really_long expires_at) {
+            return expires_at != 0 && expires_at <= now_ms();
+        }
+        /*
+         * Where the write count of a segment starts when it is created,
+         * recovered or restored: a random epoch above 40 bits of count, so
+         * the versions of values (see lease_cache.h) do not repeat across
+         * server runs or between servers.
+         */
+        static uint64_t first_version() {
+            std::random_device random;
+            uint64_t epoch = 0;
+            while (epoch == 0) epoch = ((static_cast<uint64_t>(random()) << 32) | random()) & ((1ULL << 24) - 1);
+            return epoch << 40;
+        }
+
+        /* Run task every interval on a thread of the server until it is destroyed. */
+        void StartMaintenance(std::chrono::milliseconds interval, std::function<void()> task) {
+            maintenance_thread = std::thread([this, interval, task]() {
+                std::unique_lock<std::mutex> lock(maintenance_mutex);
+                while (!maintenance_wakeup.wait_for(lock, interval, [this]() { return maintenance_stop; })) {
+                    lock.unlock();
+                    task();
+                    lock.lock();
+                }
+            });
+        }
+
+        void StopMaintenance() {
+            {
+                std::lock_guard<std::mutex> lock(maintenance_mutex);
+                maintenance_stop = true;
+            }
+            maintenance_wakeup.notify_all();
+            if (maintenance_thread.joinable()) maintenance_thread.join();
+        }
+
+        /* Make the header durable, so that a pending write is seen after a node crash too. */
+        void sync_header() {
+            long page_size = sysconf(_SC_PAGESIZE);
+            uintptr_t page = reinterpret_cast<uintptr_t>(header) & ~static_cast<uintptr_t>(page_size - 1);
+            msync(reinterpret_cast<void *>(page), sizeof(PersistentHeader) + (reinterpret_cast<uintptr_t>(header) - page),
+                  MS_SYNC);
+        }
+
+        /*
+         * Flush point of a modification of a persistent segment: it is counted
+         * in the header while it runs and, with MEMORY_SYNC_ON_WRITE, is
+         * durable before the operation returns. The pages a modification
+         * touches are spread by the allocator and not tracked, so the flush
+         * is an msync of the whole mapping: the kernel writes only dirty
+         * pages, but walks all of them, which costs more the larger the
+         * segment. Batches pay it once for all of their entries.
+         */
+        class WriteGuard {
+            container *owner;
+            bool active;
+          public:
+            WriteGuard(container *owner_, bool modifies) : owner(owner_), active(modifies && owner_->header != nullptr) {
+                if (!active) return;
+                owner->header->pending_writes.fetch_add(1, std::memory_order_acq_rel);
+                if (owner->sync_on_write) owner->sync_header();
+            }
+            ~WriteGuard() {
+                if (!active) return;
+                if (owner->sync_on_write) owner->segment.flush();
+                owner->header->pending_writes.fetch_sub(1, std::memory_order_acq_rel);
+                if (owner->sync_on_write) owner->sync_header();
+            }
+        };
+
+        /**
+         * Servers call this instead of construct_shared_memory. A persistent
+         * segment gets its header once the data structure is complete, so a
+         * crash during construction leaves a file that is not recovered.
+         */
+        void init_shared_memory() {
+            if (recovered) {
+                recover_shared_memory();
+                return;
+            }
+            construct_shared_memory();
+            if (persistent) {
+                header = segment.construct<PersistentHeader>("hcl_header")();
+                segment.flush();
+            }
+        }
+
+        /*
+         * Find the data structure of a previous run. Locks held by processes of
+         * that run are reinitialized, nothing else uses the segment yet.
+         */
+        virtual void recover_shared_memory() {
+            open_shared_memory();
+        }
+
+        void find_segment_objects() {
+            mutex = segment.find<Mutex>("mtx").first;
+            segment_mutex = segment.find<SegmentMutex>("segment_mtx").first;
+            generation = segment.find<std::atomic<uint32_t>>("segment_generation").first;
+            placement = segment.find<SegmentPlacement>("segment_placement").first;
+            placement->Apply(segment.get_address(), segment.get_size());
+            header = segment.find<PersistentHeader>("hcl_header").first;
+        }
+
+        /**
+         * Open the segment of a previous run. If a process crashed while it
+         * modified the segment, the operations that returned before are in
+         * the file, after a crash of the node only if they were flushed. The
+         * one in flight may be there in whole, in part or not at all, and a
+         * crash inside the allocator or while a table rehashes may leave the
+         * data structure damaged. MEMORY_RECOVERY decides: RECOVER_REFUSE
+         * throws, RECOVER_ACCEPT takes that risk and lets
+         * recover_shared_memory recount what derives from the entries, and
+         * RECOVER_ROLLBACK replaces the file with the snapshot at
+         * MEMORY_RECOVERY_SNAPSHOT, losing the writes that followed it.
+         * @param rolled_back, true once the file is the snapshot
+         * @return false if there is no segment to recover.
+         */
+        bool open_persistent_segment(bool rolled_back = false) {
+            try {
+                segment = boost::interprocess::managed_mapped_file(
+                        boost::interprocess::open_only, backed_file.c_str());
+            } catch (boost::interprocess::interprocess_exception &) {
+                return false;
+            }
+            auto found = segment.find<PersistentHeader>("hcl_header").first;
+            if (found == nullptr) {
+                /* construction did not complete */
+                segment = boost::interprocess::managed_mapped_file();
+                return false;
+            }
+            if (found->magic != PersistentHeader::MAGIC || found->version != PersistentHeader::VERSION)
+                throw std::runtime_error("hcl: " + backed_file.string() + " is not a segment of this version");
+            if (found->pending_writes.load() != 0) {
+                SegmentRecovery recovery = rolled_back ? RECOVER_REFUSE : HCL_CONF->MEMORY_RECOVERY;
+                if (recovery == RECOVER_ACCEPT) {
+                    found->pending_writes.store(0);
+                } else if (recovery == RECOVER_ROLLBACK) {
+                    segment = boost::interprocess::managed_mapped_file();
+                    if (!rollback_segment(HCL_CONF->MEMORY_RECOVERY_SNAPSHOT.string()))
+                        throw std::runtime_error("hcl: cannot roll " + backed_file.string() + " back to " +
+                                                 HCL_CONF->MEMORY_RECOVERY_SNAPSHOT.string());
+                    return open_persistent_segment(true);
+                } else {
+                    throw std::runtime_error("hcl: a write to " + backed_file.string() +
+                                             " was interrupted, see MEMORY_RECOVERY");
+                }
+            }
+            find_segment_objects();
+            new (mutex) Mutex();
+            new (segment_mutex) SegmentMutex();
+            /* the server of this run decides the placement */
+            *placement = SegmentPlacement::Resolve(HCL_CONF->MEMORY_NUMA_POLICY, HCL_CONF->MEMORY_NUMA_NODES,
+                                                   HCL_CONF->MEMORY_HUGEPAGES);
+            placement->Apply(segment.get_address(), segment.get_size());
+            local_generation = generation->load(std::memory_order_acquire);
+            return true;
+        }
+
+        /* Replace the file of the segment with the image at path, with a header; false if it is not one of this container. */
+        bool rollback_segment(const std::string &path) {
+            std::string staged = backed_file.string() + ".rollback";
+            std::unique_ptr<char[]> data;
+            size_t size = 0;
+            bool copied = !path.empty() && read_file(path, data, size) && write_file(staged, data.get(), size);
+            data.reset();
+            try {
+                if (copied) {
+                    boost::interprocess::managed_mapped_file image(boost::interprocess::open_only, staged.c_str());
+                    copied = is_segment_image(image);
+                    if (copied && image.find<PersistentHeader>("hcl_header").first == nullptr)
+                        image.construct<PersistentHeader>("hcl_header")();
+                    image.flush();
+                }
+            } catch (boost::interprocess::interprocess_exception &) {
+                copied = false;
+            }
+            if (copied && std::rename(staged.c_str(), backed_file.c_str()) == 0) return true;
+            std::remove(staged.c_str());
+            return false;
+        }
+
+        /* Map the file again at its current size, after a process grew it. */
+        void remap_segment() {
+            std::unique_lock<std::shared_mutex> users(segment_users);
+            /* read before mapping: a later growth is seen by the next operation */
+            uint32_t current = generation->load(std::memory_order_acquire);
+            if (current == local_generation) return;
+            segment = boost::interprocess::managed_mapped_file(
+                    boost::interprocess::open_only, backed_file.c_str());
+            find_segment_objects();
+            open_shared_memory();
+            local_generation = current;
+            above_watermark = false;
+        }
+
+        /*
+         * Grow the file by extra_bytes unless another process grew it since
+         * seen_generation. Returns false if the segment could not grow.
+         */
+        bool grow_segment(really_long extra_bytes, uint32_t seen_generation) {
+            bool grown = true;
+            {
+                std::unique_lock<std::shared_mutex> users(segment_users);
+                boost::interprocess::scoped_lock<SegmentMutex> lock(*segment_mutex);
+                if (generation->load(std::memory_order_acquire) == seen_generation) {
+                    AutoTrace trace = AutoTrace("hcl::container::grow_segment", extra_bytes);
+                    grown = boost::interprocess::managed_mapped_file::grow(backed_file.c_str(), extra_bytes);
+                    if (grown) generation->fetch_add(1, std::memory_order_acq_rel);
+                }
+            }
+            remap_segment();
+            return grown;
+        }
+
+        void acquire_segment() {
+            while (true) {
+                segment_users.lock_shared();
+                segment_mutex->lock_sharable();
+                if (generation->load(std::memory_order_acquire) == local_generation) return;
+                segment_mutex->unlock_sharable();
+                segment_users.unlock_shared();
+                remap_segment();
+            }
+        }
+
+        void release_segment() {
+            segment_mutex->unlock_sharable();
+            segment_users.unlock_shared();
+        }
+
+        /* Keeps the segment mapped at its full size for the duration of an operation. */
+        class SegmentGuard {
+            container *owner;
+          public:
+            explicit SegmentGuard(container *owner_) : owner(owner_) { owner->acquire_segment(); }
+            ~SegmentGuard() { owner->release_segment(); }
+        };
+
+        void check_watermark(really_long used, really_long size) {
+            if (used < memory_high_watermark * size) {
+                if (above_watermark.load(std::memory_order_relaxed)) above_watermark = false;
+                return;
+            }
+            if (!above_watermark.exchange(true) && watermark_callback) watermark_callback(used, size);
+        }
+
+        /**
+         * Run operation on the data of the container in the segment. Pointers
+         * into the segment are only valid inside operation, as other processes
+         * may grow the file in between. When operation runs out of memory, the
+         * segment grows by its current size and operation runs again, so it
+         * must be safe to repeat after a failed allocation.
+         */
+        template<typename Operation>
+        auto WithSegment(Operation &&operation, bool modifies = false) -> decltype(operation()) {
+            if (!guarded) {
+                WriteGuard write(this, modifies);
+                return operation();
+            }
+            while (true) {
+                uint32_t seen_generation = 0;
+                really_long used = 0, size = 0;
+                try {
+                    auto result = [&]() {
+                        SegmentGuard guard(this);
+                        seen_generation = local_generation;
+                        size = segment.get_size();
+                        WriteGuard write(this, modifies);
+                        auto value = operation();
+                        used = size - segment.get_free_memory();
+                        return value;
+                    }();
+                    check_watermark(used, size);
+                    return result;
+                } catch (boost::interprocess::bad_alloc &) {
+                    if (!grow_memory || !grow_segment(size, seen_generation)) throw;
+                }
+            }
+        }
+
+        /* Servers of guarded containers call this from bind_functions. */
+        void bind_segment_functions() {
+            rpc->bind_method(func_prefix+"_Grow", this, &container::LocalGrow);
+            rpc->bind_method(func_prefix+"_Snapshot", this, &container::LocalSnapshot);
+            rpc->bind_method(func_prefix+"_WaitSnapshot", this, &container::LocalWaitSnapshot);
+            rpc->bind_method(func_prefix+"_Restore", this, &container::LocalRestore);
+        }
+
+        /* Hold the whole segment exclusively, mapped at its current size. */
+        void lock_segment_exclusive(std::unique_lock<std::shared_mutex> &users) {
+            while (true) {
+                remap_segment();
+                users = std::unique_lock<std::shared_mutex>(segment_users);
+                segment_mutex->lock();
+                if (generation->load(std::memory_order_acquire) == local_generation) return;
+                segment_mutex->unlock();
+                users.unlock();
+            }
+        }
+
+        /* Write size bytes of data to path and make them durable. */
+        static bool write_file(const std::string &path, const char *data, size_t size) {
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) return false;
+            size_t written = 0;
+            while (written < size) {
+                ssize_t count = ::write(fd, data + written, size - written);
+                if (count <= 0) break;
+                written += count;
+            }
+            bool complete = written == size && fsync(fd) == 0;
+            return close(fd) == 0 && complete;
+        }
+
+        /* The size of the file at path, false if it cannot be read. */
+        static bool file_size(const std::string &path, size_t &size) {
+            struct stat status;
+            if (::stat(path.c_str(), &status) != 0) return false;
+            size = static_cast<size_t>(status.st_size);
+            return true;
+        }
+
+        /* Read the first size bytes of path into data. */
+        static bool read_file(const std::string &path, char *data, size_t size) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+            bool complete = true;
+            size_t done = 0;
+            while (complete && done < size) {
+                ssize_t count = ::read(fd, data + done, size - done);
+                if (count <= 0) complete = false;
+                else done += count;
+            }
+            return close(fd) == 0 && complete;
+        }
+
+        static bool read_file(const std::string &path, std::unique_ptr<char[]> &data, size_t &size) {
+            if (!file_size(path, size)) return false;
+            data.reset(new char[size]);
+            return read_file(path, data.get(), size);
+        }
+
+        /* The image is written next to path and renamed, so path always holds a complete image. */
+        static bool write_image(const std::string &path, std::shared_ptr<char> data, size_t size) {
+            std::string staged = path + ".tmp";
+            if (!write_file(staged, data.get(), size)) {
+                std::remove(staged.c_str());
+                return false;
+            }
+            return std::rename(staged.c_str(), path.c_str()) == 0;
+        }
+
+        /* Whether image holds the named objects a segment of this container has. */
+        bool is_segment_image(boost::interprocess::managed_mapped_file &image) {
+            bool found = false;
+            for (auto iter = image.named_begin(); iter != image.named_end(); ++iter)
+                if (std::string(iter->name(), iter->name_length()) == name.string()) found = true;
+            return found && image.find<Mutex>("mtx").first != nullptr &&
+                   image.find<SegmentMutex>("segment_mtx").first != nullptr &&
+                   image.find<std::atomic<uint32_t>>("segment_generation").first != nullptr &&
+                   image.find<SegmentPlacement>("segment_placement").first != nullptr;
+        }
     public:
         bool server_on_node;
         virtual void construct_shared_memory() = 0;
@@ -40,10 +512,41 @@ namespace hcl{
         inline bool is_local(uint16_t &key_int){ return key_int == my_server && server_on_node;}
         inline bool is_local(){ return server_on_node;}
 
+        /* Local operations complete immediately, so their async variants hand back a ready future. */
+        template<typename Ret>
+        std::future<Ret> make_ready_future(Ret value){
+            std::promise<Ret> promise;
+            promise.set_value(std::move(value));
+            return promise.get_future();
+        }
+
+        /**
+         * Register a named function that operations of the container can run
+         * on the server owning the data. Code cannot be shipped between
+         * processes, so every rank registers the same callbacks under the same
+         * names before the first call; clients sharing the node with the server
+         * run them directly on the shared memory.
+         */
+        template<typename Function>
+        void RegisterCallback(CharStruct cb_name, Function callback){
+            callbacks.insert_or_assign(cb_name.string(), std::any(std::move(callback)));
+        }
+
+        /* Look up a callback registered with exactly the signature Function. */
+        template<typename Function>
+        Function &GetCallback(CharStruct cb_name){
+            auto iter = callbacks.find(cb_name.string());
+            Function *callback = iter == callbacks.end() ? nullptr : std::any_cast<Function>(&iter->second);
+            if (callback == nullptr)
+                throw std::invalid_argument("hcl: no callback " + cb_name.string() + " with the requested signature");
+            return *callback;
+        }
+
+        /* Without an allocator the value is copied into the segment once, by the container insert. */
         template<typename Allocator, typename MappedType, typename SharedType>
-        typename std::enable_if_t<std::is_same<Allocator, nullptr_t>::value,MappedType>
+        typename std::enable_if_t<std::is_same<Allocator, nullptr_t>::value,MappedType&>
         GetData(MappedType & data){
-            return std::move(data);
+            return data;
         }
 
         template<typename Allocator, typename MappedType, typename SharedType>
@@ -55,8 +558,202 @@ namespace hcl{
             return std::move(value);
         }
 
+        /**
+         * Run callback(used_bytes, segment_size) in the process whose write
+         * first fills the segment past HCL_CONF->MEMORY_HIGH_WATERMARK, e.g. to
+         * Grow it ahead of a burst. It runs again after usage drops below it.
+         */
+        void SetWatermarkCallback(std::function<void(really_long, really_long)> callback){
+            watermark_callback = std::move(callback);
+        }
+
+        /**
+         * Grow the segment of the local server by extra_bytes.
+         * @return the size of the segment, unchanged if the container cannot grow.
+         */
+        really_long LocalGrow(really_long extra_bytes){
+            AutoTrace trace = AutoTrace("hcl::container::Grow(local)", extra_bytes);
+            if (!guarded || !grow_memory) return segment.get_size();
+            uint32_t seen_generation;
+            {
+                std::shared_lock<std::shared_mutex> users(segment_users);
+                seen_generation = generation->load(std::memory_order_acquire);
+            }
+            grow_segment(extra_bytes, seen_generation);
+            std::shared_lock<std::shared_mutex> users(segment_users);
+            return segment.get_size();
+        }
+
+        really_long Grow(really_long extra_bytes){
+            if (is_local()) {
+                return LocalGrow(extra_bytes);
+            } else {
+                AutoTrace trace = AutoTrace("hcl::container::Grow(remote)", extra_bytes);
+                uint16_t my_server_i = my_server;
+                return RPC_CALL_WRAPPER("_Grow", my_server_i, really_long, extra_bytes);
+            }
+        }
+
+        /**
+         * Write the segment back to its file, e.g. as a checkpoint of a
+         * persistent container that does not sync on every write.
+         */
+        bool Flush(){
+            AutoTrace trace = AutoTrace("hcl::container::Flush");
+            if (!server_on_node && !is_server) return false;
+            std::shared_lock<std::shared_mutex> users(segment_users);
+            return segment.flush();
+        }
+
+        /**
+         * Write an image of the segment of the local server to path. Operations
+         * only wait while the segment is copied in memory; the image is written
+         * to disk in the background, see LocalWaitSnapshot. Locks held during
+         * the copy are reset when the image is restored.
+         * @return false if the container does not support snapshots.
+         */
+        bool LocalSnapshot(std::string path){
+            AutoTrace trace = AutoTrace("hcl::container::Snapshot(local)", path);
+            if (!guarded) return false;
+            std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex);
+            if (snapshot_write.valid()) snapshot_write.get();
+            /* the file, unlike get_address(), also holds the header of the managed segment */
+            std::string file = backed_file.string();
+            std::unique_ptr<char[]> copy;
+            size_t size = 0, locked_size = 0;
+            while (true) {
+                /* allocated before the segment is locked, which then only waits for the copy */
+                if (!file_size(file, size)) return false;
+                copy.reset(new char[size]);
+                std::unique_lock<std::shared_mutex> users;
+                lock_segment_exclusive(users);
+                boost::interprocess::scoped_lock<SegmentMutex> segment_lock(*segment_mutex,
+                                                                           boost::interprocess::accept_ownership);
+                if (!file_size(file, locked_size)) return false;
+                /* a Grow in between */
+                if (locked_size != size) continue;
+                if (!read_file(file, copy.get(), size)) return false;
+                break;
+            }
+            std::shared_ptr<char> data(copy.release(), std::default_delete<char[]>());
+            snapshot_write = std::async(std::launch::async, &container::write_image, path, data, size);
+            return true;
+        }
+
+        /* Wait for the last snapshot to reach the disk, returns whether it did. */
+        bool LocalWaitSnapshot(){
+            AutoTrace trace = AutoTrace("hcl::container::WaitSnapshot(local)");
+            std::lock_guard<std::mutex> snapshot_lock(snapshot_mutex);
+            if (!snapshot_write.valid()) return true;
+            return snapshot_write.get();
+        }
+
+        /**
+         * Replace the segment of this server with the image at path. The image
+         * is mapped as it is, so this costs one copy of the file whatever the
+         * number of entries. The server then goes through
+         * recover_shared_memory, as after a restart, before the processes
+         * sharing the segment map the restored file at their next operation.
+         * @return false if path does not hold an image of this container.
+         */
+        bool LocalRestore(std::string path){
+            AutoTrace trace = AutoTrace("hcl::container::Restore(local)", path);
+            /* only the server holds the state recover_shared_memory rebuilds */
+            if (!guarded || !is_server) return false;
+            std::string staged = backed_file.string() + ".restore";
+            std::unique_ptr<char[]> data;
+            size_t size = 0;
+            if (!read_file(path, data, size) || !write_file(staged, data.get(), size)) {
+                std::remove(staged.c_str());
+                return false;
+            }
+            data.reset();
+            /* the segment mutex held, and the mapping it lives in once the restored file replaced it */
+            SegmentMutex *held = nullptr;
+            boost::interprocess::managed_mapped_file old_segment;
+            try {
+                boost::interprocess::managed_mapped_file image(boost::interprocess::open_only, staged.c_str());
+                if (!is_segment_image(image)) {
+                    std::remove(staged.c_str());
+                    return false;
+                }
+                new (image.find<Mutex>("mtx").first) Mutex();
+                new (image.find<SegmentMutex>("segment_mtx").first) SegmentMutex();
+                if (persistent && image.find<PersistentHeader>("hcl_header").first == nullptr)
+                    image.construct<PersistentHeader>("hcl_header")();
+                auto image_generation = image.find<std::atomic<uint32_t>>("segment_generation").first;
+                std::unique_lock<std::shared_mutex> users;
+                lock_segment_exclusive(users);
+                held = segment_mutex;
+                *image.find<SegmentPlacement>("segment_placement").first = *placement;
+                uint32_t next = generation->load(std::memory_order_acquire) + 1;
+                image_generation->store(next, std::memory_order_release);
+                image.flush();
+                bool swapped = std::rename(staged.c_str(), backed_file.c_str()) == 0;
+                if (!swapped) {
+                    held->unlock();
+                    std::remove(staged.c_str());
+                    return false;
+                }
+                /*
+                 * The old mapping, with the segment mutex and the generation
+                 * the other processes look at, stays until the restored
+                 * segment is recovered; they then open the new file.
+                 */
+                std::atomic<uint32_t> *old_generation = generation;
+                old_segment.swap(segment);
+                segment = boost::interprocess::managed_mapped_file(boost::interprocess::open_only, backed_file.c_str());
+                find_segment_objects();
+                recover_shared_memory();
+                local_generation = next;
+                above_watermark = false;
+                old_generation->store(next, std::memory_order_release);
+                held->unlock();
+            } catch (boost::interprocess::interprocess_exception &) {
+                if (held) held->unlock();
+                std::remove(staged.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        bool Snapshot(std::string path){
+            if (is_local()) {
+                return LocalSnapshot(path);
+            } else {
+                AutoTrace trace = AutoTrace("hcl::container::Snapshot(remote)", path);
+                uint16_t my_server_i = my_server;
+                return RPC_CALL_WRAPPER("_Snapshot", my_server_i, bool, path);
+            }
+        }
+
+        bool WaitSnapshot(){
+            if (is_local()) {
+                return LocalWaitSnapshot();
+            } else {
+                AutoTrace trace = AutoTrace("hcl::container::WaitSnapshot(remote)");
+                uint16_t my_server_i = my_server;
+                return RPC_CALL_WRAPPER1("_WaitSnapshot", my_server_i, bool);
+            }
+        }
+
+        bool Restore(std::string path){
+            if (is_server) {
+                return LocalRestore(path);
+            } else {
+                AutoTrace trace = AutoTrace("hcl::container::Restore(remote)", path);
+                uint16_t my_server_i = my_server;
+                return RPC_CALL_WRAPPER("_Restore", my_server_i, bool, path);
+            }
+        }
+
         ~container(){
-            if (is_server)
+            StopMaintenance();
+            /* let a snapshot still being written out reach the disk; it only reads its own copy */
+            if (snapshot_write.valid()) snapshot_write.get();
+            if (is_server && persistent)
+                segment.flush();
+            else if (is_server)
                 boost::interprocess::file_mapping::remove(backed_file.c_str());
         }
         container(CharStruct name_, uint16_t port): is_server(HCL_CONF->IS_SERVER), my_server(HCL_CONF->MY_SERVER),
@@ -64,7 +761,14 @@ namespace hcl{
                                                      comm_size(1), my_rank(0), memory_allocated(HCL_CONF->MEMORY_ALLOCATED),
                                                      name(name_), segment(), func_prefix(name_),
                                                      backed_file(HCL_CONF->BACKED_FILE_DIR + PATH_SEPARATOR + name_+"_"+std::to_string(my_server)),
-                                                     server_on_node(HCL_CONF->SERVER_ON_NODE){
+                                                     server_on_node(HCL_CONF->SERVER_ON_NODE), guarded(false),
+                                                     grow_memory(HCL_CONF->GROW_MEMORY),
+                                                     segment_mutex(), generation(), local_generation(0),
+                                                     memory_high_watermark(HCL_CONF->MEMORY_HIGH_WATERMARK),
+                                                     above_watermark(false), watermark_callback(), placement(),
+                                                     persistent(HCL_CONF->MEMORY_PERSISTENT),
+                                                     sync_on_write(HCL_CONF->MEMORY_SYNC_ON_WRITE),
+                                                     recovered(false), header(), maintenance_stop(false){
             AutoTrace trace = AutoTrace("hcl::container");
             /* Initialize MPI rank and size of world */
             MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
@@ -74,20 +778,25 @@ namespace hcl{
             this->name += "_" + std::to_string(my_server);
             /* if current rank is a server */
             rpc = hcl::Singleton<RPCFactory>::GetInstance()->GetRPC(port);
-            if (is_server) {
+            if (is_server && persistent) recovered = open_persistent_segment();
+            if (is_server && !recovered) {
                 /* Delete existing instance of shared memory space*/
                 boost::interprocess::file_mapping::remove(backed_file.c_str());
                 /* allocate new shared memory space */
                 segment = boost::interprocess::managed_mapped_file(boost::interprocess::create_only, backed_file.c_str(), memory_allocated);
-                mutex = segment.construct<boost::interprocess::interprocess_mutex>("mtx")();
+                /* place the segment before the data structures touch its pages */
+                placement = segment.construct<SegmentPlacement>("segment_placement")(SegmentPlacement::Resolve(
+                        HCL_CONF->MEMORY_NUMA_POLICY, HCL_CONF->MEMORY_NUMA_NODES, HCL_CONF->MEMORY_HUGEPAGES));
+                placement->Apply(segment.get_address(), segment.get_size());
+                mutex = segment.construct<Mutex>("mtx")();
+                segment_mutex = segment.construct<SegmentMutex>("segment_mtx")();
+                generation = segment.construct<std::atomic<uint32_t>>("segment_generation")(0);
             }else if (!is_server && server_on_node) {
                 /* Map the clients to their respective memory pools */
                 segment = boost::interprocess::managed_mapped_file(
                         boost::interprocess::open_only, backed_file.c_str());
-                std::pair<boost::interprocess::interprocess_mutex *,
-                        boost::interprocess::managed_mapped_file::size_type> res2;
-                res2 = segment.find<boost::interprocess::interprocess_mutex>("mtx");
-                mutex = res2.first;
+                find_segment_objects();
+                local_generation = generation->load(std::memory_order_acquire);
             }
         }
         void lock() {
@@ -32,6 +32,7 @@
 #endif
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include <chrono>
@@ -125,8 +126,7 @@ namespace std {
 template<>
 struct hash<CharStruct> {
     size_t operator()(const CharStruct &k) const {
-        std::string val(k.c_str());
-        return std::hash<std::string>()(val);
+        return std::hash<std::string_view>()(std::string_view(k.c_str()));
     }
 };
 }
@@ -19,4 +19,50 @@ typedef enum RPCImplementation {
   THALLIUM_ROCE = 2
 } RPCImplementation;
 
+typedef enum RPCClientSelection {
+  ROUND_ROBIN = 0,
+  THREAD_AFFINE = 1
+} RPCClientSelection;
+
+typedef enum SegmentNumaPolicy {
+  NUMA_DEFAULT = 0,     /* first touch */
+  NUMA_LOCAL = 1,       /* the node the server runs on */
+  NUMA_BIND = 2,        /* the nodes of MEMORY_NUMA_NODES */
+  NUMA_INTERLEAVE = 3   /* pages round robin over MEMORY_NUMA_NODES */
+} SegmentNumaPolicy;
+
+typedef enum SegmentRecovery {
+  RECOVER_REFUSE = 0,   /* throw, leaving the file for inspection */
+  RECOVER_ACCEPT = 1,   /* keep the data as the crash left it */
+  RECOVER_ROLLBACK = 2  /* start from the snapshot at MEMORY_RECOVERY_SNAPSHOT */
+} SegmentRecovery;
+
+typedef enum EvictionPolicy {
+  EVICT_LRU = 0,        /* oldest access of a sample of entries */
+  EVICT_CLOCK = 1       /* second chance over the buckets */
+} EvictionPolicy;
+
+typedef enum ReplicationMode {
+  REPLICATE_SYNC = 0,   /* writes return once the backups applied them */
+  REPLICATE_ASYNC = 1   /* writes return once the primary applied them */
+} ReplicationMode;
+
+typedef enum ReadPolicy {
+  READ_PRIMARY = 0,     /* the primary of the key */
+  READ_NEAREST = 1,     /* the server of the process if it holds a copy, else the primary */
+  READ_ANY = 2          /* the server of the process if it holds a copy, else the copies in turn */
+} ReadPolicy;
+
+typedef enum MigrationState {
+  MIGRATING = 0,        /* keys of the server are still moving */
+  MIGRATED = 1,         /* all of them moved */
+  MIGRATION_FAILED = 2  /* some could not move, or none are moving */
+} MigrationState;
+
+typedef enum ShardMove {
+  SHARD_SERVING = 0,      /* the shard serves its keys */
+  SHARD_MOVED = 1,        /* its keys that change server moved, operations on them are forwarded */
+  SHARD_HANDING_OVER = 2  /* its last changes are on their way, operations on those keys wait */
+} ShardMove;
+
 #endif //INCLUDE_HCL_COMMON_ENUMERATIONS_H
@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*-------------------------------------------------------------------------
+ *
+ * Created: lease_cache.h
+ *
+ * Purpose: Values of remote Gets kept by a client for the duration of a
+ * lease, and revalidated by version once it ends.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCLUDE_HCL_COMMON_LEASE_CACHE_H_
+#define INCLUDE_HCL_COMMON_LEASE_CACHE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace hcl {
+/**
+ * Cache of one container in one process. A value is served from the cache
+ * for lease milliseconds after the Get that fetched it was sent, so a read
+ * sees writes of other processes at most lease late. After that, the version
+ * the server gave the value lets the server answer "unchanged" without
+ * sending it again.
+ *
+ * @tparam KeyType, the key of the container
+ * @tparam MappedType, the value of the container
+ */
+template<typename KeyType, typename MappedType, typename Hash = std::hash<KeyType>>
+class LeaseCache {
+  public:
+    typedef std::chrono::steady_clock clock;
+    enum State { MISS, EXPIRED, VALID };
+
+  private:
+    struct Lease {
+        MappedType value;
+        /* versions come from the server, 0 is never one */
+        uint64_t version;
+        clock::time_point expires;
+    };
+    std::mutex mutex;
+    std::unordered_map<KeyType, Lease, Hash> leases;
+    std::chrono::milliseconds lease;
+    size_t capacity;
+
+  public:
+    LeaseCache(std::chrono::milliseconds lease_, size_t capacity_) : lease(lease_), capacity(capacity_) {}
+
+    /* Copy the cached value of key out; its version is set unless the state is MISS. */
+    State Lookup(const KeyType &key, MappedType &value, uint64_t &version, clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = leases.find(key);
+        if (iter == leases.end()) return MISS;
+        value = iter->second.value;
+        version = iter->second.version;
+        return now < iter->second.expires ? VALID : EXPIRED;
+    }
+
+    /* requested is when the Get was sent, so that the lease never outlives the one of the server. */
+    void Store(const KeyType &key, const MappedType &value, uint64_t version, clock::time_point requested) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = leases.find(key);
+        if (iter == leases.end()) {
+            if (capacity == 0) return;
+            /* any entry makes room, hot keys come back on their next Get */
+            if (leases.size() >= capacity) leases.erase(leases.begin());
+            leases.emplace(key, Lease{value, version, requested + lease});
+        } else {
+            iter->second = Lease{value, version, requested + lease};
+        }
+    }
+
+    void Renew(const KeyType &key, uint64_t version, clock::time_point requested) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = leases.find(key);
+        if (iter != leases.end() && iter->second.version == version) iter->second.expires = requested + lease;
+    }
+
+    /* Writes of this process are seen by its next read. */
+    void Forget(const KeyType &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        leases.erase(key);
+    }
+};
+}  // namespace hcl
+
+#endif  // INCLUDE_HCL_COMMON_LEASE_CACHE_H_
@@ -0,0 +1,112 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*-------------------------------------------------------------------------
+ *
+ * Created: lru_cache.h
+ *
+ * Purpose: Define a thread safe least recently used cache, used by RPC to
+ * keep resolved endpoints and connections of ad-hoc servers.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCLUDE_HCL_COMMON_LRU_CACHE_H_
+#define INCLUDE_HCL_COMMON_LRU_CACHE_H_
+
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace hcl {
+/**
+ * Keeps at most capacity values, evicting the least recently used one.
+ * Values are handed out as copies so that an entry can be evicted or erased
+ * while a caller still uses it.
+ *
+ * @tparam Key, the key of the cache
+ * @tparam Value, the cached value, must be copy constructible
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class lru_cache {
+  private:
+    typedef std::list<std::pair<Key, Value>> EntryList;
+    size_t capacity;
+    EntryList entries;
+    std::unordered_map<Key, typename EntryList::iterator, Hash> index;
+    std::mutex mutex;
+
+  public:
+    explicit lru_cache(size_t capacity_) : capacity(std::max<size_t>(capacity_, 1)), entries(), index() {}
+
+    /**
+     * Get the value of key, creating it with factory on a miss. factory runs
+     * without the lock held, so slow lookups do not serialize other keys.
+     */
+    template<typename Factory>
+    Value Get(const Key &key, Factory factory) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto iter = index.find(key);
+            if (iter != index.end()) {
+                entries.splice(entries.begin(), entries, iter->second);
+                return iter->second->second;
+            }
+        }
+        Value value = factory();
+        Put(key, value);
+        return value;
+    }
+
+    void Put(const Key &key, Value value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = index.find(key);
+        if (iter != index.end()) {
+            iter->second->second = std::move(value);
+            entries.splice(entries.begin(), entries, iter->second);
+            return;
+        }
+        entries.emplace_front(key, std::move(value));
+        index.emplace(key, entries.begin());
+        if (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    /* Drop key, e.g. after a call through its value failed. */
+    bool Erase(const Key &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = index.find(key);
+        if (iter == index.end()) return false;
+        entries.erase(iter->second);
+        index.erase(iter);
+        return true;
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.clear();
+        entries.clear();
+    }
+
+    size_t Size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+};
+}  // namespace hcl
+
+#endif  // INCLUDE_HCL_COMMON_LRU_CACHE_H_
@@ -18,100 +18,21 @@
 # define EXPAND_ARGS(...) __VA_ARGS__
 #define HCL_CONF hcl::Singleton<hcl::ConfigurationManager>::GetInstance()
 
-#define THALLIUM_DEFINE(name, args,args_t...) void Thallium##name(const tl::request &thallium_req, args_t) { thallium_req.respond(name args ); }
-
-#define THALLIUM_DEFINE1(name) void Thallium##name(const tl::request &thallium_req) { thallium_req.respond(name()); }
-
-#ifdef HCL_ENABLE_RPCLIB
-#define RPC_CALL_WRAPPER_RPCLIB1(funcname, serverVar,ret) \
- case RPCLIB: {								\
-    return rpc->call<RPCLIB_MSGPACK::object_handle>( serverVar , func_prefix + std::string(funcname) ).template as< ret >(); \
-    break;\
-  }
-#define RPC_CALL_WRAPPER_RPCLIB(funcname, serverVar,ret,args...)			\
- case RPCLIB: {								\
-  return rpc->call<RPCLIB_MSGPACK::object_handle>( serverVar , func_prefix + std::string(funcname) ,args).template as< ret >(); \
-    break;\
-  }
-#else
-#define RPC_CALL_WRAPPER_RPCLIB1(funcname, serverVar,ret)
-#define RPC_CALL_WRAPPER_RPCLIB(funcname, serverVar,ret,args...) 
-#endif
-#ifdef HCL_ENABLE_RPCLIB
-#define RPC_CALL_WRAPPER_RPCLIB1_CB(funcname, serverVar,ret) \
- case RPCLIB: {								\
-    return rpc->call<RPCLIB_MSGPACK::object_handle>( serverVar , funcname , std::forward< CB_Args >( cb_args )...).template as< ret >();\
-    break;\
-  }
-#define RPC_CALL_WRAPPER_RPCLIB_CB(funcname, serverVar,ret, ...)			\
- case RPCLIB: {								\
-  return rpc->call<RPCLIB_MSGPACK::object_handle>( serverVar , funcname , __VA_ARGS__ , std::forward< CB_Args >( cb_args )...).template as< ret >();\
-    break;\
-  }
-#else
-#define RPC_CALL_WRAPPER_RPCLIB1_CB(funcname, serverVar,ret)
-#define RPC_CALL_WRAPPER_RPCLIB_CB(funcname, serverVar,ret,args...)
-#endif
-
-#ifdef  HCL_ENABLE_THALLIUM_TCP
-#define RPC_CALL_WRAPPER_THALLIUM_TCP() case THALLIUM_TCP:
-#else
-#define RPC_CALL_WRAPPER_THALLIUM_TCP() 
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-#define RPC_CALL_WRAPPER_THALLIUM_ROCE() case THALLIUM_ROCE:
-#else
-#define RPC_CALL_WRAPPER_THALLIUM_ROCE() 
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-#define RPC_CALL_WRAPPER_THALLIUM1(funcname, serverVar,ret)\
-{\
- return rpc->call<tl::packed_response>( serverVar , func_prefix + funcname ).template as< ret >(); \
- break;\
- }
-#define RPC_CALL_WRAPPER_THALLIUM(funcname, serverVar,ret,args...)	\
-{\
- return rpc->call<tl::packed_response>( serverVar , func_prefix + funcname ,args ).template as< ret >(); \
- break;\
- }
-#else
-#define RPC_CALL_WRAPPER_THALLIUM1(funcname, serverVar,ret)
-#define RPC_CALL_WRAPPER_THALLIUM(funcname, serverVar,ret,args...) 
-#endif
-
-
-#define RPC_CALL_WRAPPER1(funcname, serverVar,ret) [& ]()-> ret { \
-switch (HCL_CONF->RPC_IMPLEMENTATION) {\
-RPC_CALL_WRAPPER_RPCLIB1(funcname, serverVar,ret) \
-RPC_CALL_WRAPPER_THALLIUM_TCP()\
-RPC_CALL_WRAPPER_THALLIUM_ROCE()\
-RPC_CALL_WRAPPER_THALLIUM1(funcname, serverVar,ret)\
- }\
-}();
-#define RPC_CALL_WRAPPER(funcname, serverVar,ret, args...) [& ]()-> ret { \
-switch (HCL_CONF->RPC_IMPLEMENTATION) {\
-  RPC_CALL_WRAPPER_RPCLIB(funcname, serverVar,ret,args)	\
-RPC_CALL_WRAPPER_THALLIUM_TCP()\
-RPC_CALL_WRAPPER_THALLIUM_ROCE()\
-    RPC_CALL_WRAPPER_THALLIUM(funcname, serverVar,ret,args)	\
-}\
-  }();
-#define RPC_CALL_WRAPPER1_CB(funcname, serverVar,ret) [&]()-> ret { \
-switch (HCL_CONF->RPC_IMPLEMENTATION) {\
-RPC_CALL_WRAPPER_RPCLIB1(funcname, serverVar,ret) \
-RPC_CALL_WRAPPER_THALLIUM_TCP()\
-RPC_CALL_WRAPPER_THALLIUM_ROCE()\
-RPC_CALL_WRAPPER_THALLIUM1(funcname, serverVar,ret)\
- }\
-}();
-
-#define RPC_CALL_WRAPPER_CB(funcname, serverVar,ret, ...) [&]()-> ret { \
-switch (HCL_CONF->RPC_IMPLEMENTATION) {\
-  RPC_CALL_WRAPPER_RPCLIB_CB(funcname, serverVar,ret, __VA_ARGS__)	\
-RPC_CALL_WRAPPER_THALLIUM_TCP()\
-RPC_CALL_WRAPPER_THALLIUM_ROCE()\
-    RPC_CALL_WRAPPER_THALLIUM(funcname, serverVar,ret,__VA_ARGS__)	\
-}\
-  }();
+/*
+ * The transport of RPC is fixed at compile time, so these expand to a direct
+ * call on it. ret must be a single token (typedef it if it contains commas).
+ */
+#define RPC_CALL_WRAPPER1(funcname, serverVar,ret) \
+  RPC::decode< ret >(rpc->call<RPC::response_type>( serverVar , func_prefix + std::string(funcname) ));
+#define RPC_CALL_WRAPPER(funcname, serverVar,ret, args...) \
+  RPC::decode< ret >(rpc->call<RPC::response_type>( serverVar , func_prefix + std::string(funcname) ,args ));
+#define RPC_CALL_WRAPPER_ASYNC1(funcname, serverVar,ret) \
+  RPC::as_future< ret >(rpc->async_call<RPC::response_type>( serverVar , func_prefix + std::string(funcname) ));
+#define RPC_CALL_WRAPPER_ASYNC(funcname, serverVar,ret, args...) \
+  RPC::as_future< ret >(rpc->async_call<RPC::response_type>( serverVar , func_prefix + std::string(funcname) ,args ));
+#define RPC_CALL_WRAPPER1_CB(funcname, serverVar,ret) \
+  RPC::decode< ret >(rpc->call<RPC::response_type>( serverVar , funcname , std::forward< CB_Args >( cb_args )...));
+#define RPC_CALL_WRAPPER_CB(funcname, serverVar,ret, ...) \
+  RPC::decode< ret >(rpc->call<RPC::response_type>( serverVar , funcname , __VA_ARGS__ , std::forward< CB_Args >( cb_args )...));
 
 #endif  // INCLUDE_HCL_COMMON_MACROS_H_
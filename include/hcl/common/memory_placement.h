@@ -0,0 +1,99 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*-------------------------------------------------------------------------
+ *
+ * Created: memory_placement.h
+ *
+ * Purpose: Place the pages of container segments on NUMA nodes and back
+ * them with transparent huge pages, as configured in HCL_CONF.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCLUDE_HCL_COMMON_MEMORY_PLACEMENT_H_
+#define INCLUDE_HCL_COMMON_MEMORY_PLACEMENT_H_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#endif
+
+#include <hcl/common/enumerations.h>
+
+namespace hcl {
+/**
+ * Placement of a segment, resolved once by its server and stored in the
+ * segment, so that every process mapping it applies the same policy (the
+ * node of NUMA_LOCAL is the one of the server, not of the caller).
+ */
+struct SegmentPlacement {
+    SegmentNumaPolicy policy;
+    /* bit i set for NUMA node i */
+    unsigned long nodemask;
+    bool huge_pages;
+
+    SegmentPlacement() : policy(NUMA_DEFAULT), nodemask(0), huge_pages(false) {}
+
+    static SegmentPlacement Resolve(SegmentNumaPolicy policy, const std::vector<int> &nodes, bool huge_pages) {
+        SegmentPlacement placement;
+        placement.policy = policy;
+        placement.huge_pages = huge_pages;
+#ifdef __linux__
+        if (policy == NUMA_LOCAL) {
+            unsigned cpu = 0, node = 0;
+            if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) node = 0;
+            placement.nodemask = 1UL << node;
+        }
+#endif
+        for (int node : nodes) {
+            if (node < 0 || node >= static_cast<int>(sizeof(unsigned long) * 8))
+                throw std::invalid_argument("hcl: NUMA node " + std::to_string(node) + " out of range");
+            placement.nodemask |= 1UL << node;
+        }
+        if (policy != NUMA_DEFAULT && placement.nodemask == 0)
+            throw std::invalid_argument("hcl: MEMORY_NUMA_NODES is empty");
+        return placement;
+    }
+
+    /**
+     * Apply the placement to a mapping of the segment. Pages already touched
+     * keep their node, so this runs before the data is written. Huge pages are
+     * only a hint: tmpfs honors it when shmem_enabled is set to advise. So is
+     * the NUMA policy: where the kernel refuses it (no NUMA support, nodes
+     * outside the cpuset) the segment is used with the default placement.
+     */
+    void Apply(void *address, size_t size) const {
+#ifdef __linux__
+        if (huge_pages) madvise(address, size, MADV_HUGEPAGE);
+        if (policy == NUMA_DEFAULT) return;
+        int mode = policy == NUMA_INTERLEAVE ? MPOL_INTERLEAVE : MPOL_BIND;
+        /* the kernel reads maxnode - 1 bits */
+        if (syscall(SYS_mbind, address, size, mode, &nodemask, sizeof(nodemask) * 8 + 1, 0) != 0)
+            fprintf(stderr, "hcl: cannot place segment on NUMA nodes %#lx, using the default placement: %s\n",
+                    nodemask, strerror(errno));
+#endif
+    }
+};
+}  // namespace hcl
+
+#endif  // INCLUDE_HCL_COMMON_MEMORY_PLACEMENT_H_
@@ -0,0 +1,209 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*-------------------------------------------------------------------------
+ *
+ * Created: partitioner.h
+ *
+ * Purpose: Pick the server owning a key of a container from the hash of the
+ * key, or from the key itself for range partitioning.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCLUDE_HCL_COMMON_PARTITIONER_H_
+#define INCLUDE_HCL_COMMON_PARTITIONER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <hcl/common/macros.h>
+
+namespace hcl {
+/* Mix all bits of x into all bits of the result (the finalizer of SplitMix64). */
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * Partitioners are constructed with the number of servers, or the indices of
+ * the servers, and map the hash of a key to its server. local_hash is what is
+ * left of the hash for placing the key within the server (shards, slots): it
+ * must not be correlated with the choice of the server. replicas lists the
+ * servers holding copies of a key, its server first (see replicator.h).
+ * Ordered partitioners take the keys themselves instead of their hashes.
+ */
+
+/* The indices 0..num_servers-1. */
+inline std::vector<uint16_t> all_servers(uint16_t num_servers) {
+    std::vector<uint16_t> servers(num_servers);
+    for (uint16_t server = 0; server < num_servers; ++server) servers[server] = server;
+    return servers;
+}
+
+/* hash % num_servers: even for good hashes, but most keys move when num_servers changes. */
+class modulo_partitioner {
+    std::vector<uint16_t> servers;
+  public:
+    /* whether adding or removing a server only moves keys from or to it, see unordered_map::Join */
+    static constexpr bool consistent = false;
+    static constexpr bool ordered = false;
+    explicit modulo_partitioner(uint16_t num_servers) : servers(all_servers(num_servers)) {}
+    explicit modulo_partitioner(const std::vector<uint16_t> &servers_) : servers(servers_) {}
+    inline uint16_t operator()(size_t key_hash) const {
+        return servers[key_hash % servers.size()];
+    }
+    inline size_t local_hash(size_t key_hash) const { return key_hash / servers.size(); }
+    /* The server of the key and the count-1 servers following it. */
+    std::vector<uint16_t> replicas(size_t key_hash, uint16_t count) const {
+        size_t first = key_hash % servers.size();
+        count = std::min<size_t>(count, servers.size());
+        std::vector<uint16_t> result(count);
+        for (uint16_t i = 0; i < count; ++i) result[i] = servers[(first + i) % servers.size()];
+        return result;
+    }
+};
+
+/**
+ * Consistent hashing: every server owns virtual_nodes points of a ring of
+ * 64 bit positions and a key belongs to the first point at or after the
+ * mixed hash of the key. Adding or removing a server only moves the keys of
+ * its own points, about 1/num_servers of them. The hash is mixed first, so
+ * identity hashes such as std::hash<int> spread as well.
+ */
+class ring_partitioner {
+    /* positions of the points, sorted, and the server owning each of them */
+    std::vector<uint64_t> points;
+    std::vector<uint16_t> owners;
+    /*
+     * The position of a point, mixed twice so that it is not splitmix64 of
+     * any small number: keys are placed at splitmix64 of their hash, and a
+     * key hashing to the input of a point would always land on it.
+     */
+    static inline uint64_t point(uint16_t server, uint16_t node) {
+        return splitmix64(splitmix64(server) ^ node);
+    }
+  public:
+    static constexpr bool consistent = true;
+    static constexpr bool ordered = false;
+    explicit ring_partitioner(uint16_t num_servers, uint16_t virtual_nodes = HCL_CONF->RING_VIRTUAL_NODES)
+            : ring_partitioner(all_servers(num_servers), virtual_nodes) {}
+    /* The points of a server only depend on its index, so every subset of servers agrees on them. */
+    explicit ring_partitioner(const std::vector<uint16_t> &servers, uint16_t virtual_nodes = HCL_CONF->RING_VIRTUAL_NODES) {
+        std::vector<std::pair<uint64_t, uint16_t>> ring;
+        ring.reserve(servers.size() * virtual_nodes);
+        for (uint16_t server : servers)
+            for (uint16_t node = 0; node < virtual_nodes; ++node)
+                ring.emplace_back(point(server, node), server);
+        std::sort(ring.begin(), ring.end());
+        points.reserve(ring.size());
+        owners.reserve(ring.size());
+        for (auto &point : ring) {
+            points.push_back(point.first);
+            owners.push_back(point.second);
+        }
+    }
+    inline uint16_t operator()(size_t key_hash) const {
+        auto point = std::lower_bound(points.begin(), points.end(), splitmix64(key_hash));
+        return point == points.end() ? owners.front() : owners[point - points.begin()];
+    }
+    /* The server of the key and the next count-1 distinct servers clockwise. */
+    std::vector<uint16_t> replicas(size_t key_hash, uint16_t count) const {
+        std::vector<uint16_t> result;
+        size_t first = std::lower_bound(points.begin(), points.end(), splitmix64(key_hash)) - points.begin();
+        for (size_t i = 0; i < owners.size() && result.size() < count; ++i) {
+            uint16_t owner = owners[(first + i) % owners.size()];
+            if (std::find(result.begin(), result.end(), owner) == result.end()) result.push_back(owner);
+        }
+        return result;
+    }
+    /* static: it does not depend on the servers, which change under it with DYN_CONFIG */
+    static inline size_t local_hash(size_t key_hash) { return key_hash; }
+};
+
+/**
+ * Range partitioning for hcl::map: count-1 sorted split points divide the
+ * keys into ranges, the i-th server owning [split i-1, split i). Neighbouring
+ * ranges are on neighbouring servers, so a range query only asks the servers
+ * overlapping it, in key order. Until split points are given, all keys
+ * belong to the first server.
+ */
+template<typename KeyType, typename Compare = std::less<KeyType>>
+class range_partitioner {
+    std::vector<uint16_t> servers;
+    std::vector<KeyType> points;
+    Compare compare;
+    /* the index of the range of key, into servers */
+    inline size_t range(const KeyType &key) const {
+        return std::upper_bound(points.begin(), points.end(), key, compare) - points.begin();
+    }
+  public:
+    static constexpr bool consistent = false;
+    static constexpr bool ordered = true;
+    explicit range_partitioner(uint16_t num_servers) : servers(all_servers(num_servers)), points(), compare() {}
+    explicit range_partitioner(const std::vector<uint16_t> &servers_) : servers(servers_), points(), compare() {}
+    /* Take split points in any order; duplicates and the ones beyond the servers are dropped. */
+    void split(std::vector<KeyType> split_points) {
+        std::sort(split_points.begin(), split_points.end(), compare);
+        auto same = [this](const KeyType &a, const KeyType &b) { return !compare(a, b) && !compare(b, a); };
+        split_points.erase(std::unique(split_points.begin(), split_points.end(), same), split_points.end());
+        if (split_points.size() >= servers.size())
+            split_points.erase(split_points.begin() + (servers.size() - 1), split_points.end());
+        points = std::move(split_points);
+    }
+    const std::vector<KeyType> &split_points() const { return points; }
+    /* Whether split_points, as split takes them, give every server the range it has here. */
+    bool same_split(const std::vector<KeyType> &split_points) const {
+        range_partitioner other(servers);
+        other.split(split_points);
+        auto same = [this](const KeyType &a, const KeyType &b) { return !compare(a, b) && !compare(b, a); };
+        return std::equal(points.begin(), points.end(), other.points.begin(), other.points.end(), same);
+    }
+    inline uint16_t operator()(const KeyType &key) const { return servers[range(key)]; }
+    /* The servers whose ranges overlap [key_start, key_end], in key order. */
+    std::vector<uint16_t> overlapping(const KeyType &key_start, const KeyType &key_end) const {
+        std::vector<uint16_t> result;
+        if (compare(key_end, key_start)) return result;
+        for (size_t i = range(key_start), last = range(key_end); i <= last; ++i) result.push_back(servers[i]);
+        return result;
+    }
+    /* All servers, in key order. */
+    const std::vector<uint16_t> &ordered_servers() const { return servers; }
+    /* The server of the key and the servers of the count-1 ranges following it. */
+    std::vector<uint16_t> replicas(const KeyType &key, uint16_t count) const {
+        size_t first = range(key);
+        count = std::min<size_t>(count, servers.size());
+        std::vector<uint16_t> result(count);
+        for (uint16_t i = 0; i < count; ++i) result[i] = servers[(first + i) % servers.size()];
+        return result;
+    }
+    /* Split points dividing a sample of the keys into count ranges of about the same number of keys. */
+    static std::vector<KeyType> sample_split_points(std::vector<KeyType> sample, uint16_t count,
+                                                    Compare compare = Compare()) {
+        std::sort(sample.begin(), sample.end(), compare);
+        std::vector<KeyType> result;
+        for (size_t i = 1; i < count && !sample.empty(); ++i) {
+            const KeyType &point = sample[i * sample.size() / count];
+            if (result.empty() || compare(result.back(), point)) result.push_back(point);
+        }
+        return result;
+    }
+};
+}  // namespace hcl
+
+#endif  // INCLUDE_HCL_COMMON_PARTITIONER_H_
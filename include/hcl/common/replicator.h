@@ -0,0 +1,183 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*-------------------------------------------------------------------------
+ *
+ * Created: replicator.h
+ *
+ * Purpose: Changes a primary server made to its keys, on their way to the
+ * backups of the keys.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCLUDE_HCL_COMMON_REPLICATOR_H_
+#define INCLUDE_HCL_COMMON_REPLICATOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <hcl/common/configuration_manager.h>
+#include <hcl/common/enumerations.h>
+#include <hcl/common/macros.h>
+
+namespace hcl {
+/**
+ * Replication of one container, see REPLICATION_FACTOR. Containers take it
+ * as a constructor argument, from the REPLICATION_ settings unless given;
+ * every process of a container has to pass the same.
+ */
+struct ReplicationOptions {
+    uint16_t factor;
+    ReplicationMode mode;
+    ReadPolicy read_policy;
+    size_t batch;
+    ReplicationOptions()
+            : factor(HCL_CONF->REPLICATION_FACTOR), mode(HCL_CONF->REPLICATION_MODE),
+              read_policy(HCL_CONF->REPLICATION_READ_POLICY), batch(HCL_CONF->REPLICATION_BATCH) {}
+    ReplicationOptions(uint16_t factor_, ReplicationMode mode_ = REPLICATE_SYNC, ReadPolicy read_policy_ = READ_PRIMARY)
+            : factor(factor_), mode(mode_), read_policy(read_policy_), batch(HCL_CONF->REPLICATION_BATCH) {}
+    bool enabled() const { return factor > 1; }
+};
+
+/* Wait for the backups of a write with REPLICATE_SYNC; false if one of them did not apply it. */
+inline bool wait_applied(std::vector<std::future<bool>> &applied) {
+    bool result = true;
+    for (auto &backup : applied) result = backup.get() && result;
+    return result;
+}
+
+/**
+ * Replication of one container on one server. Every backup has a queue and
+ * a thread sending it in order, at most batch changes at a time and all of
+ * them stores or all of them erases. Changes are queued under the lock of
+ * the data they changed, so a backup applies the changes of a key in the
+ * order the primary did.
+ *
+ * @tparam Change, the change of one key, with a bool erased
+ */
+template<typename Change>
+class Replicator {
+  public:
+    /* Apply changes on server; false or an exception if it did not. */
+    typedef std::function<bool(uint16_t server, std::vector<Change> &changes)> Send;
+
+  private:
+    /* a change, and the promise of the writer waiting for it with REPLICATE_SYNC */
+    struct Pending {
+        Change change;
+        std::shared_ptr<std::promise<bool>> applied;
+    };
+    struct Backup {
+        std::deque<Pending> queue;
+        std::condition_variable queued;
+        std::thread sender;
+    };
+    Send send;
+    uint16_t copies;
+    ReplicationMode mode;
+    ReadPolicy policy;
+    uint16_t my_server;
+    size_t batch;
+    std::atomic<uint32_t> turn;
+    std::mutex mutex;
+    bool stopping;
+    std::map<uint16_t, std::unique_ptr<Backup>> backups;
+
+    void Run(uint16_t server, Backup *backup) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            backup->queued.wait(lock, [&]() { return stopping || !backup->queue.empty(); });
+            /* what was queued before stopping is still sent */
+            if (backup->queue.empty()) return;
+            std::vector<Change> changes;
+            std::vector<std::shared_ptr<std::promise<bool>>> waiting;
+            bool erased = backup->queue.front().change.erased;
+            while (!backup->queue.empty() && changes.size() < batch && backup->queue.front().change.erased == erased) {
+                changes.push_back(std::move(backup->queue.front().change));
+                if (backup->queue.front().applied) waiting.push_back(std::move(backup->queue.front().applied));
+                backup->queue.pop_front();
+            }
+            lock.unlock();
+            bool applied;
+            try {
+                applied = send(server, changes);
+            } catch (const std::exception &) {
+                applied = false;
+            }
+            for (auto &writer : waiting) writer->set_value(applied);
+            lock.lock();
+        }
+    }
+
+  public:
+    Replicator(Send send_, const ReplicationOptions &options, uint16_t my_server_)
+            : send(send_), copies(options.factor), mode(options.mode), policy(options.read_policy),
+              my_server(my_server_), batch(std::max<size_t>(options.batch, 1)), turn(0), stopping(false), backups() {}
+
+    ~Replicator() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            for (auto &backup : backups) backup.second->queued.notify_one();
+        }
+        for (auto &backup : backups) backup.second->sender.join();
+    }
+
+    uint16_t Copies() const { return copies; }
+
+    /**
+     * Queue a change for the backups of its key.
+     * @param servers, the servers of the key, its primary first
+     * @param change, the change
+     * @param applied, gets a future per backup with REPLICATE_SYNC
+     */
+    void Push(const std::vector<uint16_t> &servers, const Change &change, std::vector<std::future<bool>> &applied) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 1; i < servers.size(); ++i) {
+            auto &backup = backups[servers[i]];
+            if (!backup) {
+                backup.reset(new Backup());
+                backup->sender = std::thread(&Replicator::Run, this, servers[i], backup.get());
+            }
+            std::shared_ptr<std::promise<bool>> promise;
+            if (mode == REPLICATE_SYNC) {
+                promise = std::make_shared<std::promise<bool>>();
+                applied.push_back(promise->get_future());
+            }
+            backup->queue.push_back(Pending{change, std::move(promise)});
+            backup->queued.notify_one();
+        }
+    }
+
+    /* The server a read goes to under the read policy, of the servers of its key, primary first. */
+    uint16_t Reader(const std::vector<uint16_t> &servers) {
+        if (policy == READ_PRIMARY) return servers.front();
+        if (std::find(servers.begin(), servers.end(), my_server) != servers.end()) return my_server;
+        if (policy == READ_NEAREST) return servers.front();
+        return servers[turn.fetch_add(1, std::memory_order_relaxed) % servers.size()];
+    }
+};
+}  // namespace hcl
+
+#endif  // INCLUDE_HCL_COMMON_REPLICATOR_H_
@@ -13,228 +13,218 @@
 #ifndef INCLUDE_HCL_COMMUNICATION_RPC_LIB_CPP_
 #define INCLUDE_HCL_COMMUNICATION_RPC_LIB_CPP_
 
+template <typename Transport>
 template <typename F>
-void RPC::bind(CharStruct str, F func) {
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
+void BasicRPC<Transport>::bind(CharStruct str, F func) {
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            rpclib_server->bind(str.c_str(), func);
-            break;
-        }
+    if constexpr (Transport::implementation == RPCLIB) {
+        rpclib_server->bind(str.c_str(), func);
+    }
 #endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP:
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    if constexpr (Transport::implementation != RPCLIB) {
+        /* the client engine is the server engine on servers, so the handle can be reused by calls */
+        tl::remote_procedure remote_procedure = thallium_server->define(str.string(), func);
+        std::unique_lock<std::shared_mutex> lock(thallium_procedures_mutex);
+        thallium_procedures.insert_or_assign(str, remote_procedure);
+        if (thallium_shm_engine != nullptr) {
+            remote_procedure = thallium_shm_engine->define(str.string(), func);
+            thallium_shm_procedures.insert_or_assign(str, remote_procedure);
+        }
+    }
 #endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-        case THALLIUM_ROCE:
+}
+
+template <typename Transport>
+template <typename Ret, typename... Args>
+void BasicRPC<Transport>::bind_function(CharStruct func_name, std::function<Ret(Args...)> func) {
+    /* wire copyable arguments and results travel as raw bytes, see wire.h */
+#ifdef HCL_ENABLE_RPCLIB
+    if constexpr (Transport::implementation == RPCLIB) {
+        std::function<hcl::wire_t<Ret>(hcl::wire_t<std::decay_t<Args>>...)> rpclib_func(
+                [func](hcl::wire_t<std::decay_t<Args>>... args) -> hcl::wire_t<Ret> {
+                    return hcl::to_wire(func(std::forward<Args>(hcl::from_wire(args))...));
+                });
+        bind(func_name, rpclib_func);
+    }
 #endif
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-            {
-	      thallium_server->define(str.string(), func);
-                break;
-            }
-#endif
+    if constexpr (Transport::implementation != RPCLIB) {
+        std::function<void(const tl::request &, hcl::wire_t<std::decay_t<Args>>...)> thallium_func(
+                [func](const tl::request &thallium_req, hcl::wire_t<std::decay_t<Args>>... args) {
+                    thallium_req.respond(hcl::to_wire(func(std::forward<Args>(hcl::from_wire(args))...)));
+                });
+        bind(func_name, thallium_func);
     }
+#endif
 }
+
+template <typename Transport>
 template <typename Response, typename... Args>
-Response RPC::callWithTimeout(uint16_t server_index, int timeout_ms, CharStruct const &func_name, Args... args) {
+Response BasicRPC<Transport>::callWithTimeout(uint16_t server_index, int timeout_ms, CharStruct const &func_name, Args... args) {
     AutoTrace trace = AutoTrace("RPC::call", server_index, func_name);
-    int16_t port = server_port + server_index;
-
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
+    if (server_index >= server_list.size()) {
+        CharStruct server = get_joined_server(server_index);
+        uint16_t port = server_port + server_index;
+        return call<Response>(server, port, func_name, std::forward<Args>(args)...);
+    }
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            auto *client = rpclib_clients[server_index].get();
-            if(client->get_connection_state() != rpc::client::connection_state::connected){
-                rpclib_clients[server_index]=std::make_unique<rpc::client>(server_list[server_index].c_str(), server_port + server_index);
-                client = rpclib_clients[server_index].get();
-            }
-            client->set_timeout(timeout_ms);
-            Response response = client->call(func_name.c_str(), std::forward<Args>(args)...);
-            client->clear_timeout();
-            return response;
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP: {
-            tl::remote_procedure remote_procedure = thallium_client->define(func_name.c_str());
-            // Setup args for RDMA bulk transfer
-            // std::vector<std::pair<void*,std::size_t>> segments(num_args);
-
-            return remote_procedure.on(thallium_endpoints[server_index])(std::forward<Args>(args)...);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-        case THALLIUM_ROCE: {
-            tl::remote_procedure remote_procedure = thallium_client->define(func_name.c_str());
-            return remote_procedure.on(thallium_endpoints[server_index])(std::forward<Args>(args)...);
-            break;
-        }
+    if constexpr (Transport::implementation == RPCLIB) {
+        std::shared_ptr<rpc::client> client = get_rpclib_client(server_index);
+        client->set_timeout(timeout_ms);
+        Response response = client->call(func_name.c_str(), hcl::to_wire(std::forward<Args>(args))...);
+        client->clear_timeout();
+        return response;
+    }
 #endif
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    if constexpr (Transport::implementation != RPCLIB) {
+        tl::remote_procedure remote_procedure = get_remote_procedure(server_index, func_name);
+        return remote_procedure.on(thallium_endpoints[server_index])(hcl::to_wire(std::forward<Args>(args))...);
     }
+#endif
 }
+
+template <typename Transport>
 template <typename Response, typename... Args>
-Response RPC::call(uint16_t server_index,
-                   CharStruct const &func_name,
-                   Args... args) {
+Response BasicRPC<Transport>::call(uint16_t server_index,
+                                   CharStruct const &func_name,
+                                   Args... args) {
     AutoTrace trace = AutoTrace("RPC::call", server_index, func_name);
-    int16_t port = server_port + server_index;
-
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
+    if (server_index >= server_list.size()) {
+        CharStruct server = get_joined_server(server_index);
+        uint16_t port = server_port + server_index;
+        return call<Response>(server, port, func_name, std::forward<Args>(args)...);
+    }
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            auto *client = rpclib_clients[server_index].get();
-            if(client->get_connection_state() != rpc::client::connection_state::connected){
-                rpclib_clients[server_index]=std::make_unique<rpc::client>(server_list[server_index].c_str(), server_port + server_index);
-                client = rpclib_clients[server_index].get();
-            }
-            /*client.set_timeout(5000);*/
-            return client->call(func_name.c_str(), std::forward<Args>(args)...);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP: {
-            tl::remote_procedure remote_procedure = thallium_client->define(func_name.c_str());
-            return remote_procedure.on(thallium_endpoints[server_index])(std::forward<Args>(args)...);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-        case THALLIUM_ROCE: {
-            tl::remote_procedure remote_procedure = thallium_client->define(func_name.c_str());
-            return remote_procedure.on(thallium_endpoints[server_index])(std::forward<Args>(args)...);
-            break;
-        }
+    if constexpr (Transport::implementation == RPCLIB) {
+        std::shared_ptr<rpc::client> client = get_rpclib_client(server_index);
+        /*client.set_timeout(5000);*/
+        return client->call(func_name.c_str(), hcl::to_wire(std::forward<Args>(args))...);
+    }
 #endif
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    if constexpr (Transport::implementation != RPCLIB) {
+        tl::remote_procedure remote_procedure = get_remote_procedure(server_index, func_name);
+        return remote_procedure.on(thallium_endpoints[server_index])(hcl::to_wire(std::forward<Args>(args))...);
     }
+#endif
 }
 
+template <typename Transport>
 template <typename Response, typename... Args>
-Response RPC::call(CharStruct &server,
-                   uint16_t &port,
-                   CharStruct const &func_name,
-                   Args... args) {
+Response BasicRPC<Transport>::call(CharStruct &server,
+                                   uint16_t &port,
+                                   CharStruct const &func_name,
+                                   Args... args) {
     AutoTrace trace = AutoTrace("RPC::call", server,port, func_name);
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            auto client = rpc::client(server.c_str(),port);
-            /*client.set_timeout(5000);*/
-            return client.call(func_name.c_str(), std::forward<Args>(args)...);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP: {
-
-            tl::remote_procedure remote_procedure = thallium_client->define(func_name.c_str());
-            auto end_point = get_endpoint(HCL_CONF->TCP_CONF,server,port);
-            return remote_procedure.on(end_point)(std::forward<Args>(args)...);
-            break;
+    if constexpr (Transport::implementation == RPCLIB) {
+        std::shared_ptr<rpc::client> client = get_rpclib_client(server, port);
+        /*client.set_timeout(5000);*/
+        try {
+            return client->call(func_name.c_str(), hcl::to_wire(std::forward<Args>(args))...);
+        } catch (...) {
+            rpclib_adhoc_clients.Erase(get_adhoc_key(server, port));
+            throw;
         }
+    }
 #endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-        case THALLIUM_ROCE: {
-            tl::remote_procedure remote_procedure = thallium_client->define(func_name.c_str());
-            auto end_point = get_endpoint(HCL_CONF->TCP_CONF,server,port);
-            return remote_procedure.on(end_point)(std::forward<Args>(args)...);
-            break;
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    if constexpr (Transport::implementation != RPCLIB) {
+        tl::remote_procedure remote_procedure = get_remote_procedure(func_name);
+        tl::endpoint end_point = get_adhoc_endpoint(server, port);
+        try {
+            return remote_procedure.on(end_point)(hcl::to_wire(std::forward<Args>(args))...);
+        } catch (...) {
+            thallium_adhoc_endpoints.Erase(get_adhoc_key(server, port));
+            throw;
         }
-#endif
     }
+#endif
 }
 
+template <typename Transport>
 template <typename Response, typename... Args>
-std::future<Response> RPC::async_call(uint16_t server_index,
-                                      CharStruct const &func_name,
-                                        Args... args) {
-    AutoTrace trace = AutoTrace("RPC::call", server_index, func_name);
-    int16_t port = server_port + server_index;
-
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
+std::future<Response> BasicRPC<Transport>::async_call(uint16_t server_index,
+                                                      CharStruct const &func_name,
+                                                      Args... args) {
+    AutoTrace trace = AutoTrace("RPC::async_call", server_index, func_name);
+    if (server_index >= server_list.size()) {
+        CharStruct server = get_joined_server(server_index);
+        uint16_t port = server_port + server_index;
+        return async_call<Response>(server, port, func_name, std::forward<Args>(args)...);
+    }
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            auto *client = rpclib_clients[server_index].get();
-            if(client->get_connection_state() != rpc::client::connection_state::connected){
-                rpclib_clients[server_index]=std::make_unique<rpc::client>(server_list[server_index].c_str(), server_port + server_index);
-                client = rpclib_clients[server_index].get();
-            }
-            // client.set_timeout(5000);
-            return client->async_call(func_name.c_str(), std::forward<Args>(args)...);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP: {
-            //TODO:NotImplemented error
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-        case THALLIUM_ROCE: {
-             //TODO:NotImplemented error
-            break;
-        }
+    if constexpr (Transport::implementation == RPCLIB) {
+        std::shared_ptr<rpc::client> client = get_rpclib_client(server_index);
+        // client.set_timeout(5000);
+        return client->async_call(func_name.c_str(), hcl::to_wire(std::forward<Args>(args))...);
+    }
 #endif
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    if constexpr (Transport::implementation != RPCLIB) {
+        tl::remote_procedure remote_procedure = get_remote_procedure(server_index, func_name);
+        tl::async_response async_response = remote_procedure.on(thallium_endpoints[server_index]).async(hcl::to_wire(std::forward<Args>(args))...);
+        return wait_async_response<Response>(std::move(async_response));
     }
+#endif
 }
 
+template <typename Transport>
 template <typename Response, typename... Args>
-std::future<Response> RPC::async_call(CharStruct &server,
-                                      uint16_t &port,
-                                      CharStruct const &func_name,
-                                      Args... args) {
+std::future<Response> BasicRPC<Transport>::async_call(CharStruct &server,
+                                                      uint16_t &port,
+                                                      CharStruct const &func_name,
+                                                      Args... args) {
     AutoTrace trace = AutoTrace("RPC::async_call", server,port, func_name);
-
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            auto client = rpc::client(server.c_str(),port);
-            // client.set_timeout(5000);
-            return client.async_call(func_name.c_str(), std::forward<Args>(args)...);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP: {
-            //TODO:NotImplemented error
-            break;
-        }
+    if constexpr (Transport::implementation == RPCLIB) {
+        /* a failed connection is replaced by get_rpclib_client on the next call */
+        std::shared_ptr<rpc::client> client = get_rpclib_client(server, port);
+        // client.set_timeout(5000);
+        return client->async_call(func_name.c_str(), hcl::to_wire(std::forward<Args>(args))...);
+    }
 #endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-        case THALLIUM_ROCE: {
-             //TODO:NotImplemented error
-            break;
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    if constexpr (Transport::implementation != RPCLIB) {
+        tl::remote_procedure remote_procedure = get_remote_procedure(func_name);
+        tl::endpoint end_point = get_adhoc_endpoint(server, port);
+        try {
+            tl::async_response async_response = remote_procedure.on(end_point).async(hcl::to_wire(std::forward<Args>(args))...);
+            return wait_async_response<Response>(std::move(async_response));
+        } catch (...) {
+            thallium_adhoc_endpoints.Erase(get_adhoc_key(server, port));
+            throw;
         }
-#endif
     }
+#endif
+}
+
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+template <typename Transport>
+tl::bulk BasicRPC<Transport>::expose_bulk(uint16_t server_index, void *buffer, size_t size, tl::bulk_mode mode) {
+    AutoTrace trace = AutoTrace("RPC::expose_bulk", server_index, size);
+    std::vector<std::pair<void *, std::size_t>> segments(1, std::make_pair(buffer, size));
+    if (server_index < thallium_shm_targets.size() && thallium_shm_targets[server_index])
+        return thallium_shm_engine->expose(segments, mode);
+    return thallium_client->expose(segments, mode);
 }
 
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-// These are still experimental for using RDMA bulk transfers
-template<typename MappedType>
-MappedType RPC::prep_rdma_server(tl::endpoint endpoint, tl::bulk &bulk_handle) {
-    // MappedType buffer;
-    std::string buffer;
-    buffer.resize(1000000, 'a');
-    std::vector<std::pair<void *, size_t>> segments(1);
-    segments[0].first = (void *)(&buffer[0]);
-    segments[0].second = 1000000 + 1;
-    tl::bulk local = thallium_server->expose(segments, tl::bulk_mode::write_only);
-    bulk_handle.on(endpoint) >> local;
-    return buffer;
+template <typename Transport>
+size_t BasicRPC<Transport>::pull_bulk(const tl::request &thallium_req, tl::bulk &bulk_handle, void *buffer, size_t size) {
+    AutoTrace trace = AutoTrace("RPC::pull_bulk", size);
+    std::vector<std::pair<void *, std::size_t>> segments(1, std::make_pair(buffer, size));
+    tl::bulk local = get_request_engine(thallium_req)->expose(segments, tl::bulk_mode::write_only);
+    return bulk_handle.on(thallium_req.get_endpoint()) >> local;
 }
 
-template<typename MappedType>
-tl::bulk RPC::prep_rdma_client(MappedType &data) {
-    MappedType my_buffer = data;
-    std::vector<std::pair<void *, std::size_t>> segments(1);
-    segments[0].first = (void *)&my_buffer[0];
-    segments[0].second = 1000000 + 1;
-    return thallium_client->expose(segments, tl::bulk_mode::read_only);
+template <typename Transport>
+size_t BasicRPC<Transport>::push_bulk(const tl::request &thallium_req, tl::bulk &bulk_handle, void *buffer, size_t size) {
+    AutoTrace trace = AutoTrace("RPC::push_bulk", size);
+    std::vector<std::pair<void *, std::size_t>> segments(1, std::make_pair(buffer, size));
+    tl::bulk local = get_request_engine(thallium_req)->expose(segments, tl::bulk_mode::read_only);
+    return bulk_handle.on(thallium_req.get_endpoint()) << local;
 }
 #endif
 
@@ -16,9 +16,11 @@
 #include <hcl/common/constants.h>
 #include <hcl/common/data_structures.h>
 #include <hcl/common/debug.h>
+#include <hcl/common/lru_cache.h>
 #include <hcl/common/macros.h>
 #include <hcl/common/singleton.h>
 #include <hcl/common/typedefs.h>
+#include <hcl/communication/wire.h>
 #include <mpi.h>
 
 /** RPC Lib Headers**/
@@ -56,13 +58,18 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <unistd.h>
+#include <climits>
+#include <stdexcept>
 
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/interprocess/managed_mapped_file.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/containers/vector.hpp>
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <utility>
 #include <memory>
 #include <string>
@@ -70,13 +77,42 @@
 #include <fstream>
 #include <iostream>
 #include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
 
 namespace bip = boost::interprocess;
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
 namespace tl = thallium;
 #endif
 
-class RPC {
+/**
+ * Transport policies for BasicRPC. The transport is fixed at compile time,
+ * so calls dispatch without consulting HCL_CONF->RPC_IMPLEMENTATION.
+ */
+#ifdef HCL_ENABLE_RPCLIB
+struct RpcLib {
+    static constexpr RPCImplementation implementation = RPCLIB;
+    typedef RPCLIB_MSGPACK::object_handle response_type;
+};
+#endif
+#ifdef HCL_ENABLE_THALLIUM_TCP
+struct ThalliumTcp {
+    static constexpr RPCImplementation implementation = THALLIUM_TCP;
+    typedef tl::packed_response response_type;
+};
+#endif
+#ifdef HCL_ENABLE_THALLIUM_ROCE
+struct ThalliumRoce {
+    static constexpr RPCImplementation implementation = THALLIUM_ROCE;
+    typedef tl::packed_response response_type;
+};
+#endif
+
+template <typename Transport>
+class BasicRPC {
 private:
     uint16_t server_port;
     std::string name;
@@ -84,17 +120,163 @@ private:
     std::shared_ptr<rpc::server> rpclib_server;
     // We can't use a std::vector<rpc::client> for these since rpc::client is neither copy
     // nor move constructible. See https://github.com/rpclib/rpclib/issues/128
+    // Pool of rpclib_pool_size connections per server, the pool of server i starts at i * rpclib_pool_size.
     std::vector<std::shared_ptr<rpc::client>> rpclib_clients;
+    uint16_t rpclib_pool_size;
+    RPCClientSelection rpclib_client_selection;
+    std::atomic<uint32_t> rpclib_next_client;
+    /*
+     * Picks a connection of the pool of server_index. Slots are swapped atomically so that a
+     * broken connection is replaced once while callers still holding it finish safely.
+     */
+    std::shared_ptr<rpc::client> get_rpclib_client(uint16_t server_index) {
+        uint32_t slot;
+        if (rpclib_client_selection == THREAD_AFFINE) {
+            slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % rpclib_pool_size;
+        } else {
+            slot = rpclib_next_client.fetch_add(1, std::memory_order_relaxed) % rpclib_pool_size;
+        }
+        std::shared_ptr<rpc::client> &entry = rpclib_clients[server_index * rpclib_pool_size + slot];
+        std::shared_ptr<rpc::client> client = std::atomic_load(&entry);
+        auto state = client->get_connection_state();
+        // initial means the connection is still being established and must be left alone
+        if (state == rpc::client::connection_state::disconnected ||
+            state == rpc::client::connection_state::reset) {
+            auto new_client = std::make_shared<rpc::client>(server_list[server_index].c_str(),
+                                                            server_port + server_index);
+            if (std::atomic_compare_exchange_strong(&entry, &client, new_client)) client = new_client;
+        }
+        return client;
+    }
+    // Connections of calls addressing a server by host and port, dropped when a call through them fails.
+    hcl::lru_cache<std::string, std::shared_ptr<rpc::client>> rpclib_adhoc_clients{HCL_CONF->RPC_ENDPOINT_CACHE_SIZE};
+    std::shared_ptr<rpc::client> get_rpclib_client(CharStruct &server, uint16_t port) {
+        auto connect = [&server, port]() { return std::make_shared<rpc::client>(server.c_str(), port); };
+        std::shared_ptr<rpc::client> client = rpclib_adhoc_clients.Get(get_adhoc_key(server, port), connect);
+        auto state = client->get_connection_state();
+        if (state == rpc::client::connection_state::disconnected ||
+            state == rpc::client::connection_state::reset) {
+            client = connect();
+            rpclib_adhoc_clients.Put(get_adhoc_key(server, port), client);
+        }
+        return client;
+    }
 #endif
+    static std::string get_adhoc_key(CharStruct &server, uint16_t port) {
+        return server.string() + ":" + std::to_string(port);
+    }
+    /*
+     * Servers appended to the server list after this object was built (see
+     * DYN_CONFIG) are reached by host and port, like calls addressing a server
+     * by host. The list is read again the first time an unknown index is called.
+     */
+    std::vector<CharStruct> joined_servers;
+    std::mutex joined_servers_mutex;
+    CharStruct get_joined_server(uint16_t server_index) {
+        std::lock_guard<std::mutex> lock(joined_servers_mutex);
+        if (server_index >= server_list.size() + joined_servers.size()) {
+            std::vector<CharStruct> servers = HCL_CONF->LoadServers();
+            if (servers.size() > server_list.size())
+                joined_servers.assign(servers.begin() + server_list.size(), servers.end());
+        }
+        if (server_index >= server_list.size() + joined_servers.size())
+            throw std::out_of_range("hcl: server " + std::to_string(server_index) + " is not in the server list");
+        return joined_servers[server_index - server_list.size()];
+    }
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
     std::shared_ptr<tl::engine> thallium_server;
     std::shared_ptr<tl::engine> thallium_client;
+    // Serves and reaches the servers on this node when HCL_CONF->USE_SHM_TRANSPORT is set.
+    std::shared_ptr<tl::engine> thallium_shm_engine;
     CharStruct engine_init_str;
     std::vector<tl::endpoint> thallium_endpoints;
+    // thallium_shm_targets[i] is true when thallium_endpoints[i] is a shared memory endpoint.
+    std::vector<bool> thallium_shm_targets;
+    // Remote procedures are registered with Mercury once and reused on every call, which only looks them up shared.
+    std::unordered_map<CharStruct, tl::remote_procedure> thallium_procedures;
+    std::unordered_map<CharStruct, tl::remote_procedure> thallium_shm_procedures;
+    std::shared_mutex thallium_procedures_mutex;
+    // Endpoints of calls addressing a server by host and port, dropped when a call through them fails.
+    hcl::lru_cache<std::string, tl::endpoint> thallium_adhoc_endpoints{HCL_CONF->RPC_ENDPOINT_CACHE_SIZE};
+    tl::endpoint get_adhoc_endpoint(CharStruct &server, uint16_t port) {
+        return thallium_adhoc_endpoints.Get(get_adhoc_key(server, port), [this, &server, port]() {
+            return get_endpoint(HCL_CONF->TCP_CONF, server, port);
+        });
+    }
+    tl::remote_procedure get_remote_procedure(std::unordered_map<CharStruct, tl::remote_procedure> &procedures,
+                                              tl::engine &engine, CharStruct const &func_name) {
+        {
+            std::shared_lock<std::shared_mutex> lock(thallium_procedures_mutex);
+            auto iter = procedures.find(func_name);
+            if (iter != procedures.end()) return iter->second;
+        }
+        std::unique_lock<std::shared_mutex> lock(thallium_procedures_mutex);
+        auto iter = procedures.find(func_name);
+        if (iter != procedures.end()) return iter->second;
+        tl::remote_procedure remote_procedure = engine.define(func_name.c_str());
+        procedures.emplace(func_name, remote_procedure);
+        return remote_procedure;
+    }
+    tl::remote_procedure get_remote_procedure(CharStruct const &func_name) {
+        return get_remote_procedure(thallium_procedures, *thallium_client, func_name);
+    }
+    /* Procedures must be defined on the engine owning the endpoint of server_index. */
+    tl::remote_procedure get_remote_procedure(uint16_t server_index, CharStruct const &func_name) {
+        if (!thallium_shm_targets[server_index]) return get_remote_procedure(func_name);
+        return get_remote_procedure(thallium_shm_procedures, *thallium_shm_engine, func_name);
+    }
+    /* One shared memory engine per process, like the Singleton engine used for TCP and verbs. */
+    static std::shared_ptr<tl::engine> get_shm_engine(int mode) {
+        static std::shared_ptr<tl::engine> shm_engine;
+        static std::mutex shm_engine_mutex;
+        std::lock_guard<std::mutex> lock(shm_engine_mutex);
+        if (shm_engine == nullptr) {
+            if (mode == THALLIUM_SERVER_MODE) {
+                shm_engine = std::make_shared<tl::engine>(HCL_CONF->SHM_CONF.c_str(), THALLIUM_SERVER_MODE,
+                                                          true, HCL_CONF->RPC_THREADS);
+            } else {
+                shm_engine = std::make_shared<tl::engine>(HCL_CONF->SHM_CONF.c_str(), MARGO_CLIENT_MODE);
+            }
+        }
+        return shm_engine;
+    }
+    /* The shared memory address of a server is published in a node local file keyed by its port. */
+    CharStruct get_shm_address_file(uint16_t port) {
+        return HCL_CONF->BACKED_FILE_DIR + "/hcl_sm_" + std::to_string(port);
+    }
+    bool is_local_host(CharStruct server_name) {
+        char hostname[HOST_NAME_MAX + 1];
+        if (gethostname(hostname, sizeof(hostname)) != 0) return false;
+        if (server_name.string() == "localhost" || server_name.string() == hostname) return true;
+        struct hostent *he = gethostbyname(server_name.c_str());
+        if (he == nullptr) return false;
+        std::string server_ip = inet_ntoa(*((struct in_addr **)he->h_addr_list)[0]);
+        if (server_ip.compare(0, 4, "127.") == 0) return true;
+        he = gethostbyname(hostname);
+        if (he == nullptr) return false;
+        return server_ip == inet_ntoa(*((struct in_addr **)he->h_addr_list)[0]);
+    }
+    /* Bulk buffers must be exposed on the engine the request came in on. */
+    std::shared_ptr<tl::engine> get_request_engine(const tl::request &thallium_req) {
+        if (thallium_shm_engine != nullptr) {
+            std::string address = thallium_req.get_endpoint();
+            if (address.compare(0, HCL_CONF->SHM_CONF.size(), HCL_CONF->SHM_CONF.string()) == 0)
+                return thallium_shm_engine;
+        }
+        return thallium_server;
+    }
+    /* The operation is already in flight; the deferred future only blocks on it when get() is called. */
+    template <typename Response>
+    std::future<Response> wait_async_response(tl::async_response async_response) {
+        return std::async(std::launch::deferred, [async_response = std::move(async_response)]() mutable -> Response {
+            return async_response.wait();
+        });
+    }
     tl::endpoint get_endpoint(CharStruct protocol, CharStruct server_name, uint16_t server_port){
         // We use addr lookup because mercury addresses must be exactly 15 char
         char ip[16];
         struct hostent *he = gethostbyname(server_name.c_str());
+        if (he == nullptr) throw std::runtime_error("hcl: cannot resolve server " + server_name.string());
         in_addr **addr_list = (struct in_addr **)he->h_addr_list;
         strcpy(ip, inet_ntoa(*addr_list[0]));
         CharStruct lookup_str = protocol + "://" + std::string(ip) + ":" + std::to_string(server_port);
@@ -103,8 +285,22 @@ private:
     void init_engine_and_endpoints(CharStruct protocol) {
         thallium_client = hcl::Singleton<tl::engine>::GetInstance(protocol.c_str(), MARGO_CLIENT_MODE);
         thallium_endpoints.reserve(server_list.size());
+        thallium_shm_targets.reserve(server_list.size());
         for (std::vector<CharStruct>::size_type i = 0; i < server_list.size(); ++i) {
-            thallium_endpoints.push_back(get_endpoint(protocol,server_list[i],server_port + i));
+            std::string shm_address;
+            if (HCL_CONF->USE_SHM_TRANSPORT && is_local_host(server_list[i])) {
+                // Servers that did not publish a shared memory address are reached over the network
+                std::ifstream address_file(get_shm_address_file(server_port + i).c_str());
+                if (address_file.is_open()) std::getline(address_file, shm_address);
+            }
+            if (!shm_address.empty()) {
+                if (thallium_shm_engine == nullptr) thallium_shm_engine = get_shm_engine(MARGO_CLIENT_MODE);
+                thallium_endpoints.push_back(thallium_shm_engine->lookup(shm_address));
+                thallium_shm_targets.push_back(true);
+            } else {
+                thallium_endpoints.push_back(get_endpoint(protocol,server_list[i],server_port + i));
+                thallium_shm_targets.push_back(false);
+            }
         }
     }
 
@@ -119,34 +315,29 @@ private:
 #endif
     std::vector<CharStruct> server_list;
   public:
-    ~RPC() {
-        if (HCL_CONF->IS_SERVER) {
-            switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-                case RPCLIB: {
-          // Twiddle thumbs
-          break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-                case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-                    case THALLIUM_ROCE:
-#endif
+    typedef Transport transport;
+    typedef typename Transport::response_type response_type;
+
+    ~BasicRPC() {
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-                {
-                    // Mercury addresses in endpoints must be freed before finalizing Thallium
-                    thallium_endpoints.clear();
-                    thallium_server->finalize();
-                    break;
+        if constexpr (Transport::implementation != RPCLIB) {
+            if (HCL_CONF->IS_SERVER) {
+                // Mercury addresses in endpoints must be freed before finalizing Thallium
+                thallium_endpoints.clear();
+                thallium_adhoc_endpoints.Clear();
+                thallium_procedures.clear();
+                thallium_shm_procedures.clear();
+                thallium_server->finalize();
+                if (thallium_shm_engine != nullptr) {
+                    std::remove(get_shm_address_file(server_port + HCL_CONF->MY_SERVER).c_str());
+                    thallium_shm_engine->finalize();
                 }
-#endif
             }
         }
+#endif
     }
 
-    RPC() : server_list(),
+    BasicRPC() : server_list(),
              server_port(HCL_CONF->RPC_PORT) {
     AutoTrace trace = AutoTrace("RPC");
 
@@ -154,38 +345,40 @@ private:
 
     /* if current rank is a server */
     if (HCL_CONF->IS_SERVER) {
-        switch (HCL_CONF->RPC_IMPLEMENTATION) {
 #ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
+        if constexpr (Transport::implementation == RPCLIB) {
             rpclib_server = std::make_shared<rpc::server>(server_port+HCL_CONF->MY_SERVER);
             rpclib_server->suppress_exceptions(false);
-	break;
-      }
+        }
 #endif
 #ifdef HCL_ENABLE_THALLIUM_TCP
-        case THALLIUM_TCP: {
-	engine_init_str = HCL_CONF->TCP_CONF + "://" +
-	  HCL_CONF->SERVER_LIST[HCL_CONF->MY_SERVER] +
-	  ":" +
-	  std::to_string(server_port + HCL_CONF->MY_SERVER);
-	break;
-      }
+        if constexpr (Transport::implementation == THALLIUM_TCP) {
+            engine_init_str = HCL_CONF->TCP_CONF + "://" +
+              HCL_CONF->SERVER_LIST[HCL_CONF->MY_SERVER] +
+              ":" +
+              std::to_string(server_port + HCL_CONF->MY_SERVER);
+        }
 #endif
 #ifdef HCL_ENABLE_THALLIUM_ROCE
-      case THALLIUM_ROCE: {
-	  engine_init_str = HCL_CONF->VERBS_CONF + ";" +
-	    HCL_CONF->VERBS_DOMAIN + "://" +
-	    HCL_CONF->SERVER_LIST[HCL_CONF->MY_SERVER] +
-	    ":" +
-	    std::to_string(server_port+HCL_CONF->MY_SERVER);
-	  break;
-	}
-#endif
+        if constexpr (Transport::implementation == THALLIUM_ROCE) {
+            engine_init_str = HCL_CONF->VERBS_CONF + ";" +
+              HCL_CONF->VERBS_DOMAIN + "://" +
+              HCL_CONF->SERVER_LIST[HCL_CONF->MY_SERVER] +
+              ":" +
+              std::to_string(server_port+HCL_CONF->MY_SERVER);
         }
+#endif
     }
 #ifdef HCL_ENABLE_RPCLIB
-    for (std::vector<rpc::client>::size_type i = 0; i < server_list.size(); ++i) {
-        rpclib_clients.push_back(std::make_unique<rpc::client>(server_list[i].c_str(), server_port + i));
+    if constexpr (Transport::implementation == RPCLIB) {
+        rpclib_pool_size = std::max<uint16_t>(HCL_CONF->RPC_CLIENTS_PER_SERVER, 1);
+        rpclib_client_selection = HCL_CONF->RPC_CLIENT_SELECTION;
+        rpclib_next_client = 0;
+        for (std::vector<rpc::client>::size_type i = 0; i < server_list.size(); ++i) {
+            for (uint16_t slot = 0; slot < rpclib_pool_size; ++slot) {
+                rpclib_clients.push_back(std::make_shared<rpc::client>(server_list[i].c_str(), server_port + i));
+            }
+        }
     }
 #endif
     run(HCL_CONF->RPC_THREADS);
@@ -195,90 +388,130 @@ private:
     template <typename F>
     void bind(CharStruct str, F func);
 
+    /**
+     * Binds std::function func as func_name on the server. On Thallium the
+     * handler responds with the return value of func, so the same function
+     * serves every transport.
+     */
+    template <typename Ret, typename... Args>
+    void bind_function(CharStruct func_name, std::function<Ret(Args...)> func);
+
+    /**
+     * Binds method of obj as func_name on the server. Containers bind their
+     * Local* methods with it.
+     */
+    template <typename Class, typename Ret, typename... Args>
+    void bind_method(CharStruct func_name, Class *obj, Ret (Class::*method)(Args...)) {
+        bind_function(func_name, std::function<Ret(Args...)>([obj, method](Args... args) -> Ret {
+            return (obj->*method)(std::forward<Args>(args)...);
+        }));
+    }
+
     void run(size_t workers = RPC_THREADS) {
         AutoTrace trace = AutoTrace("RPC::run", workers);
-        if (HCL_CONF->IS_SERVER){
-            switch (HCL_CONF->RPC_IMPLEMENTATION) {
 #ifdef HCL_ENABLE_RPCLIB
-                case RPCLIB: {
-                    rpclib_server->async_run(workers);
-                break;
-            }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-                case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-                    case THALLIUM_ROCE:
+        if constexpr (Transport::implementation == RPCLIB) {
+            if (HCL_CONF->IS_SERVER) rpclib_server->async_run(workers);
+        }
 #endif
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-                {
-                    thallium_server = hcl::Singleton<tl::engine>::GetInstance(engine_init_str.c_str(), THALLIUM_SERVER_MODE,true,HCL_CONF->RPC_THREADS);
-                    break;
+        if constexpr (Transport::implementation != RPCLIB) {
+            if (HCL_CONF->IS_SERVER) {
+                thallium_server = hcl::Singleton<tl::engine>::GetInstance(engine_init_str.c_str(), THALLIUM_SERVER_MODE,true,HCL_CONF->RPC_THREADS);
+                if (HCL_CONF->USE_SHM_TRANSPORT) {
+                    /* clients on this node find the shared memory engine through the address file */
+                    thallium_shm_engine = get_shm_engine(THALLIUM_SERVER_MODE);
+                    std::ofstream address_file(get_shm_address_file(server_port + HCL_CONF->MY_SERVER).c_str(),
+                                               std::ios::trunc);
+                    address_file << std::string(thallium_shm_engine->self()) << std::endl;
                 }
-#endif
-            }
-        }
-        switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-            case RPCLIB: {
-
-                break;
             }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-            case THALLIUM_TCP: {
+            if constexpr (Transport::implementation == THALLIUM_TCP) {
                 init_engine_and_endpoints(HCL_CONF->TCP_CONF);
-                break;
-            }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-                case THALLIUM_ROCE: {
+            } else {
                 init_engine_and_endpoints(HCL_CONF->VERBS_CONF);
-                break;
             }
-#endif
         }
+#endif
     }
 
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-    template<typename MappedType>
-    MappedType prep_rdma_server(tl::endpoint endpoint, tl::bulk &bulk_handle);
-
-    template<typename MappedType>
-    tl::bulk prep_rdma_client(MappedType &data);
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+    /**
+     * Registers a local buffer with Mercury so that server_index can
+     * access it directly. The buffer must outlive the call using the handle.
+     */
+    tl::bulk expose_bulk(uint16_t server_index, void *buffer, size_t size, tl::bulk_mode mode);
+    /**
+     * Server side of a bulk transfer: pulls the buffer exposed by the caller
+     * of thallium_req straight into buffer.
+     */
+    size_t pull_bulk(const tl::request &thallium_req, tl::bulk &bulk_handle, void *buffer, size_t size);
+    /**
+     * Server side of a bulk transfer: pushes buffer straight into the buffer
+     * exposed by the caller of thallium_req.
+     */
+    size_t push_bulk(const tl::request &thallium_req, tl::bulk &bulk_handle, void *buffer, size_t size);
 #endif
     /**
-     * Response should be RPCLIB_MSGPACK::object_handle for rpclib and
-     * tl::packed_response for thallium/mercury
+     * Response defaults to response_type of the transport:
+     * RPCLIB_MSGPACK::object_handle for rpclib and tl::packed_response for
+     * thallium/mercury
      */
-    template <typename Response, typename... Args>
+    template <typename Response = response_type, typename... Args>
     Response call(uint16_t server_index,
                   CharStruct const &func_name,
                   Args... args);
-    /**
-     * Response should be RPCLIB_MSGPACK::object_handle for rpclib and
-     * tl::packed_response for thallium/mercury
-     */
-    template <typename Response, typename... Args>
+    template <typename Response = response_type, typename... Args>
     Response call(CharStruct &server,
                   uint16_t &port,
                   CharStruct const &func_name,
                   Args... args);
-    template <typename Response, typename... Args>
+    template <typename Response = response_type, typename... Args>
     Response callWithTimeout(uint16_t server_index,
                   int timeout_ms,
                   CharStruct const &func_name,
                   Args... args);
-    template <typename Response, typename... Args>
+    /**
+     * Issues the call without waiting for the server. The returned future
+     * holds RPCLIB_MSGPACK::object_handle for rpclib and tl::packed_response
+     * for thallium/mercury.
+     */
+    template <typename Response = response_type, typename... Args>
     std::future<Response> async_call(
             uint16_t server_index, CharStruct const &func_name, Args... args);
-    template <typename Response, typename... Args>
+    template <typename Response = response_type, typename... Args>
     std::future<Response> async_call(CharStruct &server,
             uint16_t &port, CharStruct const &func_name, Args... args);
+    /**
+     * Converts the raw response future of async_call into a future of the
+     * return type of the remote function.
+     */
+    template <typename Ret, typename Response>
+    static std::future<Ret> as_future(std::future<Response> response) {
+        return std::async(std::launch::deferred, [response = std::move(response)]() mutable -> Ret {
+            return decode<Ret>(response.get());
+        });
+    }
+    /**
+     * Extracts the return value of a function bound with bind_function,
+     * which sends wire copyable results as raw bytes.
+     */
+    template <typename Ret, typename Response>
+    static Ret decode(const Response &response) {
+        hcl::wire_t<Ret> result = response.template as<hcl::wire_t<Ret>>();
+        return std::move(hcl::from_wire(result));
+    }
 
 };
 
+#if defined(HCL_ENABLE_RPCLIB)
+typedef BasicRPC<RpcLib> RPC;
+#elif defined(HCL_ENABLE_THALLIUM_TCP)
+typedef BasicRPC<ThalliumTcp> RPC;
+#elif defined(HCL_ENABLE_THALLIUM_ROCE)
+typedef BasicRPC<ThalliumRoce> RPC;
+#endif
+
 #include "rpc_lib.cpp"
 
 #endif  // INCLUDE_HCL_COMMUNICATION_RPC_LIB_H_
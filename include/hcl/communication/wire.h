@@ -0,0 +1,194 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*-------------------------------------------------------------------------
+ *
+ * Created: wire.h
+ *
+ * Purpose: Send trivially copyable RPC arguments and results as raw bytes
+ * instead of encoding them member by member.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef INCLUDE_HCL_COMMUNICATION_WIRE_H_
+#define INCLUDE_HCL_COMMUNICATION_WIRE_H_
+
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#ifdef HCL_ENABLE_RPCLIB
+#include <rpc/msgpack.hpp>
+#endif
+
+namespace hcl {
+/**
+ * Classes (structs, std::array) that can be sent as their bytes. Arithmetic
+ * types are left alone since both serializers already copy them directly.
+ */
+template<typename T>
+struct is_wire_copyable : std::integral_constant<bool,
+        std::is_trivially_copyable<T>::value && std::is_class<T>::value> {};
+
+/* std::pair is never trivially copyable itself, but its members can be. */
+template<typename A, typename B>
+struct is_wire_copyable<std::pair<A, B>> : std::integral_constant<bool,
+        std::is_trivially_copyable<A>::value && std::is_trivially_copyable<B>::value &&
+        (std::is_class<A>::value || std::is_class<B>::value)> {};
+
+/**
+ * Carries a wire copyable value over RPC as one opaque block of bytes.
+ * BasicRPC wraps arguments and results with it, so bound functions and
+ * callers keep using the plain type.
+ *
+ * @tparam T, the carried type
+ */
+template<typename T>
+struct wire {
+    static constexpr size_t size = sizeof(T);
+    T value;
+
+    wire() : value() {}
+    explicit wire(const T &value_) : value(value_) {}
+
+    template<typename Writer>
+    void write_blocks(Writer &&write) const {
+        write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+    template<typename Reader>
+    void read_blocks(Reader &&read) {
+        read(reinterpret_cast<char *>(&value), sizeof(T));
+    }
+
+    /* Thallium serialization */
+    template<typename A>
+    void save(A &ar) const {
+        write_blocks([&ar](const char *bytes, size_t length) { ar.write(bytes, length); });
+    }
+    template<typename A>
+    void load(A &ar) {
+        read_blocks([&ar](char *bytes, size_t length) { ar.read(bytes, length); });
+    }
+};
+
+template<typename A, typename B>
+struct wire<std::pair<A, B>> {
+    static constexpr size_t size = sizeof(A) + sizeof(B);
+    std::pair<A, B> value;
+
+    wire() : value() {}
+    explicit wire(const std::pair<A, B> &value_) : value(value_) {}
+
+    template<typename Writer>
+    void write_blocks(Writer &&write) const {
+        write(reinterpret_cast<const char *>(&value.first), sizeof(A));
+        write(reinterpret_cast<const char *>(&value.second), sizeof(B));
+    }
+    template<typename Reader>
+    void read_blocks(Reader &&read) {
+        read(reinterpret_cast<char *>(&value.first), sizeof(A));
+        read(reinterpret_cast<char *>(&value.second), sizeof(B));
+    }
+
+    template<typename Ar>
+    void save(Ar &ar) const {
+        write_blocks([&ar](const char *bytes, size_t length) { ar.write(bytes, length); });
+    }
+    template<typename Ar>
+    void load(Ar &ar) {
+        read_blocks([&ar](char *bytes, size_t length) { ar.read(bytes, length); });
+    }
+};
+
+/* The type T travels as over RPC. */
+template<typename T>
+using wire_t = typename std::conditional<is_wire_copyable<T>::value, wire<T>, T>::type;
+
+template<typename T>
+typename std::enable_if_t<is_wire_copyable<std::decay_t<T>>::value, wire<std::decay_t<T>>>
+to_wire(T &&value) {
+    return wire<std::decay_t<T>>(value);
+}
+
+template<typename T>
+typename std::enable_if_t<!is_wire_copyable<std::decay_t<T>>::value, T &&>
+to_wire(T &&value) {
+    return std::forward<T>(value);
+}
+
+template<typename T>
+T &from_wire(wire<T> &value) {
+    return value.value;
+}
+
+template<typename T>
+T &from_wire(T &value) {
+    return value;
+}
+}  // namespace hcl
+
+#ifdef HCL_ENABLE_RPCLIB
+namespace clmdep_msgpack {
+MSGPACK_API_VERSION_NAMESPACE(MSGPACK_DEFAULT_API_NS) {
+    namespace adaptor {
+    namespace mv1 = clmdep_msgpack::v1;
+    template<typename T>
+    struct convert<hcl::wire<T>> {
+        mv1::object const &operator()(mv1::object const &o,
+                                      hcl::wire<T> &input) const {
+            if (o.type != clmdep_msgpack::type::BIN || o.via.bin.size != hcl::wire<T>::size)
+                throw clmdep_msgpack::type_error();
+            const char *bytes = o.via.bin.ptr;
+            input.read_blocks([&bytes](char *block, size_t length) {
+                std::memcpy(block, bytes, length);
+                bytes += length;
+            });
+            return o;
+        }
+    };
+
+    template<typename T>
+    struct pack<hcl::wire<T>> {
+        template<typename Stream>
+        packer <Stream> &operator()(mv1::packer <Stream> &o,
+                                    hcl::wire<T> const &input) const {
+            o.pack_bin(checked_get_container_size(hcl::wire<T>::size));
+            input.write_blocks([&o](const char *block, size_t length) {
+                o.pack_bin_body(block, checked_get_container_size(length));
+            });
+            return o;
+        }
+    };
+
+    template<typename T>
+    struct object_with_zone<hcl::wire<T>> {
+        void operator()(mv1::object::with_zone &o,
+                        hcl::wire<T> const &input) const {
+            uint32_t size = checked_get_container_size(hcl::wire<T>::size);
+            o.type = clmdep_msgpack::type::BIN;
+            char *ptr = static_cast<char *>(
+                o.zone.allocate_align(size, MSGPACK_ZONE_ALIGNOF(char)));
+            o.via.bin.ptr = ptr;
+            o.via.bin.size = size;
+            input.write_blocks([&ptr](const char *block, size_t length) {
+                std::memcpy(ptr, block, length);
+                ptr += length;
+            });
+        }
+    };
+    }  // namespace adaptor
+}
+}  // namespace clmdep_msgpack
+#endif
+
+#endif  // INCLUDE_HCL_COMMUNICATION_WIRE_H_
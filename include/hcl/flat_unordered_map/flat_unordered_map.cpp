@@ -0,0 +1,348 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef INCLUDE_HCL_FLAT_UNORDERED_MAP_FLAT_UNORDERED_MAP_CPP_
+#define INCLUDE_HCL_FLAT_UNORDERED_MAP_FLAT_UNORDERED_MAP_CPP_
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::flat_unordered_map(CharStruct name_, uint16_t port, size_t capacity_)
+        : container(name_, port), partitioner(num_servers), capacity(1), slots(), insert_locks() {
+    AutoTrace trace = AutoTrace("hcl::flat_unordered_map");
+    /* probing wraps around with a mask */
+    while (capacity < capacity_) capacity <<= 1;
+    if (is_server) {
+        init_shared_memory();
+        bind_functions();
+    } else if (!is_server && server_on_node) {
+        open_shared_memory();
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+void flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::open_shared_memory() {
+    std::pair<Slot *, boost::interprocess::managed_mapped_file::size_type> res;
+    res = segment.find<Slot>(name.c_str());
+    slots = res.first;
+    /* the server decides the capacity */
+    capacity = res.second;
+    insert_locks = segment.find<std::atomic<uint32_t>>("flat_insert_locks").first;
+}
+
+/*
+ * A writer that died holding a slot leaves its lock taken: it is released.
+ * The slot stays free if the writer had not stored the key yet, a value being
+ * written during the crash may be torn.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+void flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::recover_shared_memory() {
+    open_shared_memory();
+    /* segments written before the insert locks were kept have none */
+    insert_locks = segment.find_or_construct<std::atomic<uint32_t>>("flat_insert_locks")[insert_stripes](0);
+    for (size_t stripe = 0; stripe < insert_stripes; ++stripe) insert_locks[stripe].store(0);
+    for (size_t index = 0; index < capacity; ++index) {
+        Slot &slot = slots[index];
+        uint32_t version = slot.version.load();
+        if (version & 1) slot.version.store(version + 1);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+void flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::bind_functions() {
+    rpc->bind_method(func_prefix+"_Put", this, &flat_unordered_map::LocalPut);
+    rpc->bind_method(func_prefix+"_Get", this, &flat_unordered_map::LocalGet);
+    rpc->bind_method(func_prefix+"_Erase", this, &flat_unordered_map::LocalErase);
+    rpc->bind_method(func_prefix+"_GetAllData", this, &flat_unordered_map::LocalGetAllDataInServer);
+}
+
+/* Take the sequence lock of a slot as its writer; returns the version that releases it. */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+uint32_t flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::LockSlot(Slot &slot) {
+    uint32_t version = slot.version.load(std::memory_order_relaxed);
+    do {
+        while (version & 1) version = slot.version.load(std::memory_order_relaxed);
+    } while (!slot.version.compare_exchange_weak(version, version + 1, std::memory_order_acquire,
+                                                 std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    return version + 2;
+}
+
+/**
+ * Copy a slot as its last writer left it.
+ * @param key, set to the key of the slot, undefined while it is EMPTY
+ * @param value, set to the value of the slot unless nullptr
+ * @return the state of the slot.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+uint32_t flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::ReadSlot(Slot &slot, KeyType &key, MappedType *value) {
+    uint32_t before, after, state;
+    do {
+        before = slot.version.load(std::memory_order_acquire);
+        state = slot.state.load(std::memory_order_relaxed);
+        std::memcpy(static_cast<void *>(&key), &slot.key, sizeof(KeyType));
+        if (value != nullptr) std::memcpy(static_cast<void *>(value), &slot.value, sizeof(MappedType));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = slot.version.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return state;
+}
+
+/**
+ * Find the slot holding key, stored or erased. Another key may reuse an
+ * erased slot once this returns, so callers check the key again.
+ * @param key, key to find
+ * @return the slot of key, nullptr if the table does not hold key.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+typename flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::Slot *
+flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::FindSlot(KeyType &key) {
+    size_t index = get_slot(key);
+    KeyType slot_key;
+    for (size_t probe = 0; probe < capacity; ++probe) {
+        uint32_t state = ReadSlot(slots[index], slot_key, nullptr);
+        if (state == EMPTY) return nullptr;
+        if (slot_key == key) return &slots[index];
+        index = (index + 1) & (capacity - 1);
+    }
+    return nullptr;
+}
+
+/* The first empty or erased slot on the probe sequence of key, nullptr if the table is full. */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+typename flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::Slot *
+flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::FindFree(KeyType &key) {
+    size_t index = get_slot(key);
+    for (size_t probe = 0; probe < capacity; ++probe) {
+        if (slots[index].state.load(std::memory_order_acquire) != READY) return &slots[index];
+        index = (index + 1) & (capacity - 1);
+    }
+    return nullptr;
+}
+
+/* Store data in the slot of key; false if the slot was reused by another key meanwhile. */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+bool flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::StoreValue(Slot &slot, KeyType &key, MappedType &data) {
+    uint32_t version = LockSlot(slot);
+    bool same_key = slot.state.load(std::memory_order_relaxed) != EMPTY && slot.key == key;
+    if (same_key) {
+        std::memcpy(static_cast<void *>(&slot.value), &data, sizeof(MappedType));
+        slot.state.store(READY, std::memory_order_relaxed);
+    }
+    slot.version.store(version, std::memory_order_release);
+    return same_key;
+}
+
+/* Store key and data in a free slot; false if it was taken meanwhile. */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+bool flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::ClaimSlot(Slot &slot, KeyType &key, MappedType &data) {
+    uint32_t version = LockSlot(slot);
+    bool free = slot.state.load(std::memory_order_relaxed) != READY;
+    if (free) {
+        std::memcpy(static_cast<void *>(&slot.key), &key, sizeof(KeyType));
+        std::memcpy(static_cast<void *>(&slot.value), &data, sizeof(MappedType));
+        slot.state.store(READY, std::memory_order_relaxed);
+    }
+    slot.version.store(version, std::memory_order_release);
+    return free;
+}
+
+/**
+ * Put the data into the local table. A stored or erased key is written in
+ * its slot; a new key takes the first free slot of its probe sequence once
+ * the insert lock of its stripe shows that no other Put is storing it.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @return bool, true if Put was successful, false if the table is full.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+bool flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::LocalPut(KeyType &key, MappedType &data) {
+    AutoTrace trace = AutoTrace("hcl::flat_unordered_map::Put(local)", key);
+    while (true) {
+        Slot *slot = FindSlot(key);
+        if (slot != nullptr) {
+            if (StoreValue(*slot, key, data)) return true;
+            continue;
+        }
+        InsertLock insert(insert_locks[get_slot(key) % insert_stripes]);
+        slot = FindSlot(key);
+        if (slot != nullptr) {
+            if (StoreValue(*slot, key, data)) return true;
+            continue;
+        }
+        slot = FindFree(key);
+        if (slot == nullptr) return false;
+        if (ClaimSlot(*slot, key, data)) return true;
+    }
+}
+
+/**
+ * Put the data into the flat unordered map. Uses key to decide the server to hash it to,
+ * @param key, the key for put
+ * @param data, the value for put
+ * @return bool, true if Put was successful, false if the table of the server is full.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+bool flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::Put(KeyType key, MappedType data) {
+    uint16_t key_int = partitioner(keyHash(key));
+    if (is_local(key_int)) {
+        return LocalPut(key, data);
+    } else {
+        AutoTrace trace = AutoTrace("hcl::flat_unordered_map::Put(remote)", key);
+        return RPC_CALL_WRAPPER("_Put", key_int, bool, key, data);
+    }
+}
+
+/**
+ * Get the data in the local table.
+ * @param key, key to get
+ * @return return a pair of bool and Value. If bool is true then data was
+ * found and is present in value part else bool is set to false
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::pair<bool, MappedType> flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::LocalGet(KeyType &key) {
+    AutoTrace trace = AutoTrace("hcl::flat_unordered_map::Get(local)", key);
+    KeyType slot_key;
+    MappedType value;
+    while (true) {
+        Slot *slot = FindSlot(key);
+        if (slot == nullptr) return std::pair<bool, MappedType>(false, MappedType());
+        uint32_t state = ReadSlot(*slot, slot_key, &value);
+        /* reused by another key since it was found */
+        if (!(slot_key == key)) continue;
+        if (state != READY) return std::pair<bool, MappedType>(false, MappedType());
+        return std::pair<bool, MappedType>(true, value);
+    }
+}
+
+/**
+ * Get the data in the flat unordered map. Uses key to decide the server to hash it to,
+ * @param key, key to get
+ * @return return a pair of bool and Value. If bool is true then data was
+ * found and is present in value part else bool is set to false
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::pair<bool, MappedType> flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::Get(KeyType &key) {
+    uint16_t key_int = partitioner(keyHash(key));
+    if (is_local(key_int)) {
+        return LocalGet(key);
+    } else {
+        AutoTrace trace = AutoTrace("hcl::flat_unordered_map::Get(remote)", key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER("_Get", key_int, ret_type, key);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::pair<bool, MappedType> flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::LocalErase(KeyType &key) {
+    AutoTrace trace = AutoTrace("hcl::flat_unordered_map::Erase(local)", key);
+    while (true) {
+        Slot *slot = FindSlot(key);
+        if (slot == nullptr) return std::pair<bool, MappedType>(false, MappedType());
+        uint32_t version = LockSlot(*slot);
+        if (!(slot->key == key)) {
+            slot->version.store(version, std::memory_order_release);
+            continue;
+        }
+        std::pair<bool, MappedType> erased(slot->state.load(std::memory_order_relaxed) == READY, MappedType());
+        if (erased.first) {
+            std::memcpy(static_cast<void *>(&erased.second), &slot->value, sizeof(MappedType));
+            slot->state.store(ERASED, std::memory_order_relaxed);
+        }
+        slot->version.store(version, std::memory_order_release);
+        return erased;
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::pair<bool, MappedType> flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::Erase(KeyType &key) {
+    uint16_t key_int = partitioner(keyHash(key));
+    if (is_local(key_int)) {
+        return LocalErase(key);
+    } else {
+        AutoTrace trace = AutoTrace("hcl::flat_unordered_map::Erase(remote)", key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER("_Erase", key_int, ret_type, key);
+    }
+}
+
+/**
+ * Put the data into the flat unordered map without waiting for the remote server.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @return future of bool, as returned by Put.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::future<bool> flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::AsyncPut(KeyType key, MappedType data) {
+    uint16_t key_int = partitioner(keyHash(key));
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPut(key, data));
+    } else {
+        return RPC_CALL_WRAPPER_ASYNC("_Put", key_int, bool, key, data);
+    }
+}
+
+/**
+ * Get the data in the flat unordered map without waiting for the remote server.
+ * @param key, key to get
+ * @return future of a pair of bool and Value, as returned by Get.
+ */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::future<std::pair<bool, MappedType>> flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::AsyncGet(KeyType &key) {
+    uint16_t key_int = partitioner(keyHash(key));
+    if (is_local(key_int)) {
+        return make_ready_future(LocalGet(key));
+    } else {
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC("_Get", key_int, ret_type, key);
+    }
+}
+
+/* Slots are read one at a time, so this is not a snapshot of the table. */
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::vector<std::pair<KeyType, MappedType>>
+flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::LocalGetAllDataInServer() {
+    AutoTrace trace = AutoTrace("hcl::flat_unordered_map::GetAllDataInServer(local)");
+    std::vector<std::pair<KeyType, MappedType>> final_values;
+    KeyType key;
+    MappedType value;
+    for (size_t index = 0; index < capacity; ++index) {
+        if (ReadSlot(slots[index], key, &value) != READY) continue;
+        final_values.emplace_back(key, value);
+    }
+    return final_values;
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::vector<std::pair<KeyType, MappedType>>
+flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::GetAllDataInServer() {
+    if (is_local()) {
+        return LocalGetAllDataInServer();
+    } else {
+        typedef std::vector<std::pair<KeyType, MappedType>> ret_type;
+        auto my_server_i = my_server;
+        return RPC_CALL_WRAPPER1("_GetAllData", my_server_i, ret_type);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Partitioner>
+std::vector<std::pair<KeyType, MappedType>>
+flat_unordered_map<KeyType, MappedType, Hash, Partitioner>::GetAllData() {
+    std::vector<std::pair<KeyType, MappedType>> final_values = GetAllDataInServer();
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (server == my_server) continue;
+        typedef std::vector<std::pair<KeyType, MappedType>> ret_type;
+        auto server_values = RPC_CALL_WRAPPER1("_GetAllData", server, ret_type);
+        final_values.insert(final_values.end(), server_values.begin(), server_values.end());
+    }
+    return final_values;
+}
+
+#endif  // INCLUDE_HCL_FLAT_UNORDERED_MAP_FLAT_UNORDERED_MAP_CPP_
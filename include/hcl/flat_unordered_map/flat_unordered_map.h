@@ -0,0 +1,163 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef INCLUDE_HCL_FLAT_UNORDERED_MAP_FLAT_UNORDERED_MAP_H_
+#define INCLUDE_HCL_FLAT_UNORDERED_MAP_FLAT_UNORDERED_MAP_H_
+
+/**
+ * Include Headers
+ */
+
+/** Standard C++ Headers**/
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hcl/communication/rpc_lib.h>
+#include <hcl/communication/rpc_factory.h>
+#include <hcl/common/singleton.h>
+#include <hcl/common/typedefs.h>
+
+/** MPI Headers**/
+#include <mpi.h>
+/** RPC Lib Headers**/
+#ifdef HCL_ENABLE_RPCLIB
+#include <rpc/server.h>
+#include <rpc/client.h>
+#include <rpc/rpc_error.h>
+#endif
+/** Thallium Headers **/
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+#include <thallium.hpp>
+#endif
+/** Boost Headers **/
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <hcl/common/container.h>
+#include <hcl/common/partitioner.h>
+
+namespace hcl {
+/**
+ * This is a Distributed HashMap Class for trivially copyable keys and
+ * values. Each server keeps a fixed size open addressing table (linear
+ * probing) laid out contiguously in shared memory. Each slot has a sequence
+ * lock: readers retry instead of waiting, so same node clients Get without
+ * taking a mutex, and a Put of a stored key only locks its slot. A Put of a
+ * new key also takes the spin lock of its stripe of home slots, so that two
+ * Puts of the same key cannot store it twice.
+ *
+ * Erased slots keep the probe sequences through them and are reused by the
+ * next new key probing them. Put returns false while the table of the server
+ * holds capacity keys.
+ *
+ * @tparam KeyType, the key of the HashMap, compared with operator==
+ * @tparam MappedType, the value of the HashMap
+ * @tparam Partitioner, maps the hash of a key to its server (see partitioner.h)
+ */
+template<typename KeyType, typename MappedType, typename Hash = std::hash<KeyType>,
+         typename Partitioner = ring_partitioner>
+class flat_unordered_map : public container {
+    static_assert(!Partitioner::ordered, "hcl::flat_unordered_map requires a hash partitioner, range partitioning is for hcl::map");
+    static_assert(std::is_trivially_copyable<KeyType>::value,
+                  "hcl::flat_unordered_map requires a trivially copyable KeyType");
+    static_assert(std::is_trivially_copyable<MappedType>::value,
+                  "hcl::flat_unordered_map requires a trivially copyable MappedType");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free,
+                  "hcl::flat_unordered_map shares atomics between processes");
+
+  private:
+    /** Slot states **/
+    enum SlotState : uint32_t { EMPTY = 0, READY = 2, ERASED = 3 };
+    /*
+     * A slot is EMPTY until a key is first stored in it and never again
+     * after, erased slots stay ERASED until a key reuses them. version is odd
+     * while a writer holds the slot: state, key and value only change then.
+     */
+    struct Slot {
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> version;
+        KeyType key;
+        MappedType value;
+        Slot() : state(EMPTY), version(0), key(), value() {}
+    };
+    /* spin locks of new keys, by home slot */
+    static constexpr size_t insert_stripes = 64;
+    struct InsertLock {
+        std::atomic<uint32_t> &lock;
+        explicit InsertLock(std::atomic<uint32_t> &lock_) : lock(lock_) {
+            while (lock.exchange(1, std::memory_order_acquire) != 0) std::this_thread::yield();
+        }
+        ~InsertLock() { lock.store(0, std::memory_order_release); }
+    };
+    /** Class attributes**/
+    Hash keyHash;
+    Partitioner partitioner;
+    size_t capacity;
+    Slot *slots;
+    std::atomic<uint32_t> *insert_locks;
+
+    /* The table uses what the partitioner left of the hash, so that the keys of one server spread over it. */
+    inline size_t get_slot(const KeyType &key) {
+        return partitioner.local_hash(keyHash(key)) & (capacity - 1);
+    }
+    uint32_t LockSlot(Slot &slot);
+    uint32_t ReadSlot(Slot &slot, KeyType &key, MappedType *value);
+    Slot *FindSlot(KeyType &key);
+    Slot *FindFree(KeyType &key);
+    bool StoreValue(Slot &slot, KeyType &key, MappedType &data);
+    bool ClaimSlot(Slot &slot, KeyType &key, MappedType &data);
+
+  public:
+    explicit flat_unordered_map(CharStruct name_ = std::string("TEST_FLAT_UNORDERED_MAP"),
+                                uint16_t port = HCL_CONF->RPC_PORT,
+                                size_t capacity_ = HCL_CONF->FLAT_MAP_CAPACITY);
+
+    void construct_shared_memory() override {
+        /* Construct the table in the shared memory space. */
+        slots = segment.construct<Slot>(name.c_str())[capacity]();
+        insert_locks = segment.construct<std::atomic<uint32_t>>("flat_insert_locks")[insert_stripes](0);
+    }
+
+    void open_shared_memory() override;
+
+    void recover_shared_memory() override;
+
+    void bind_functions() override;
+
+    size_t Capacity() const { return capacity; }
+
+    bool LocalPut(KeyType &key, MappedType &data);
+    std::pair<bool, MappedType> LocalGet(KeyType &key);
+    std::pair<bool, MappedType> LocalErase(KeyType &key);
+    std::vector<std::pair<KeyType, MappedType>> LocalGetAllDataInServer();
+
+    bool Put(KeyType key, MappedType data);
+    std::pair<bool, MappedType> Get(KeyType &key);
+    std::pair<bool, MappedType> Erase(KeyType &key);
+    std::future<bool> AsyncPut(KeyType key, MappedType data);
+    std::future<std::pair<bool, MappedType>> AsyncGet(KeyType &key);
+    std::vector<std::pair<KeyType, MappedType>> GetAllData();
+    std::vector<std::pair<KeyType, MappedType>> GetAllDataInServer();
+};
+
+#include "flat_unordered_map.cpp"
+
+}  // namespace hcl
+
+#endif  // INCLUDE_HCL_FLAT_UNORDERED_MAP_FLAT_UNORDERED_MAP_H_
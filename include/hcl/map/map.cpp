@@ -19,14 +19,66 @@
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-bool map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalPut(KeyType &key,
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalPut(KeyType &key,
                                                  MappedType &data) {
     AutoTrace trace = AutoTrace("hcl::map::Put(local)", key, data);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mutex);
-    auto value = GetData<Allocator, MappedType, SharedType>(data);
-    mymap->insert_or_assign(key, value);
-    return true;
+    std::vector<std::future<bool>> applied;
+    bool result = WithSegment([&]() {
+        applied.clear();
+        WriteLock lock(*mutex);
+        auto iterator = InsertEntry(key, data);
+        Replicate(key, &iterator->second, applied);
+        return true;
+    }, true);
+    return wait_applied(applied) && result;
+}
+
+/**
+ * Put the data into the local map for a limited time.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @param ttl_ms, milliseconds until the entry expires, 0 for never
+ * @return bool, true if Put was successful else false.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalPutWithTTL(KeyType &key, MappedType &data, really_long ttl_ms) {
+    AutoTrace trace = AutoTrace("hcl::map::PutWithTTL(local)", key, data);
+    std::vector<std::future<bool>> applied;
+    bool result = WithSegment([&]() {
+        applied.clear();
+        WriteLock lock(*mutex);
+        auto iterator = InsertEntry(key, data, expiry_time(ttl_ms));
+        Replicate(key, &iterator->second, applied);
+        return true;
+    }, true);
+    return wait_applied(applied) && result;
+}
+
+/**
+ * Reclaim expired entries among the next TTL_SWEEP_BATCH keys. Runs on the
+ * maintenance thread of servers; expired entries are invisible before already.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+void map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::SweepExpired() {
+    std::vector<std::future<bool>> applied;
+    WithSegment([&]() {
+        WriteLock lock(*mutex);
+        auto iterator = sweep_cursor ? mymap->lower_bound(*sweep_cursor) : mymap->begin();
+        really_long now = now_ms();
+        for (size_t visited = 0; visited < HCL_CONF->TTL_SWEEP_BATCH && iterator != mymap->end(); ++visited) {
+            really_long expires_at = iterator->second.expires_at;
+            if (expires_at != 0 && expires_at <= now) {
+                Replicate(iterator->first, nullptr, applied);
+                iterator = mymap->erase(iterator);
+            } else {
+                ++iterator;
+            }
+        }
+        if (iterator == mymap->end()) sweep_cursor.reset();
+        else sweep_cursor = iterator->first;
+        return true;
+    }, true);
 }
 
 /**
@@ -35,38 +87,132 @@ bool map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalPut(KeyType
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-bool map<KeyType, MappedType, Compare, Allocator , SharedType>::Put(KeyType &key,
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Put(KeyType &key,
                                             MappedType &data) {
-    size_t key_hash = keyHash(key);
-    uint16_t key_int = static_cast<uint16_t>(key_hash % num_servers);
+    uint16_t key_int = ServerOf(key);
     if (is_local(key_int)) {
         return LocalPut(key, data);
     } else {
         AutoTrace trace = AutoTrace("hcl::map::Put(remote)", key, data);
+        ForgetLease(key);
         return RPC_CALL_WRAPPER("_Put", key_int, bool,
                                 key, data);
     }
 }
 
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Put(KeyType &key, MappedType &data, std::chrono::milliseconds ttl) {
+    uint16_t key_int = ServerOf(key);
+    really_long ttl_ms = ttl.count();
+    if (is_local(key_int)) {
+        return LocalPutWithTTL(key, data, ttl_ms);
+    } else {
+        AutoTrace trace = AutoTrace("hcl::map::PutWithTTL(remote)", key, data);
+        ForgetLease(key);
+        return RPC_CALL_WRAPPER("_PutWithTTL", key_int, bool, key, data, ttl_ms);
+    }
+}
+
 /**
  * Get the data in the local map.
  * @param key, key to get
  * @return return a pair of bool and Value. If bool is true then
  * data was found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGet(KeyType &key) {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGet(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::map::Get(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
-    typename MyMap::iterator iterator = mymap->find(key);
-    if (iterator != mymap->end()) {
-        return std::pair<bool, MappedType>(true, iterator->second);
-    } else {
+    return WithSegment([&]() {
+        ReadLock lock(*mutex);
+        typename MyMap::iterator iterator = FindLive(key);
+        if (iterator != mymap->end()) {
+            return std::pair<bool, MappedType>(true, iterator->second.value);
+        } else {
+            return std::pair<bool, MappedType>(false, MappedType());
+        }
+    });
+}
+
+/**
+ * Read a value of the local map in place.
+ * @param key, key to get
+ * @param visitor, called with the stored value if the key is found
+ * @return bool, true if the key was found and visitor ran.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Visitor>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetView(KeyType &key, Visitor &&visitor) {
+    AutoTrace trace = AutoTrace("hcl::map::GetView(local)", key);
+    return WithSegment([&]() {
+        ReadLock lock(*mutex);
+        typename MyMap::iterator iterator = FindLive(key);
+        if (iterator == mymap->end()) return false;
+        const MappedType &value = iterator->second.value;
+        visitor(value);
+        return true;
+    });
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Visitor>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetView(KeyType &key, Visitor &&visitor) {
+    uint16_t key_int = ServerOf(key);
+    if (is_local(key_int)) return LocalGetView(key, std::forward<Visitor>(visitor));
+    auto result = Get(key);
+    if (result.first) visitor(static_cast<const MappedType &>(result.second));
+    return result.first;
+}
+
+/**
+ * Get the data in the local map for the lease cache of a client.
+ * @param key, key to get
+ * @param known_version, version of the value the client has, 0 for none
+ * @return return a pair of the version and the value, version 0 if the key
+ * was not found. The value is left out if the version is known_version.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::pair<uint64_t, MappedType>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetLeased(KeyType &key, uint64_t known_version) {
+    AutoTrace trace = AutoTrace("hcl::map::GetLeased(local)", key);
+    return WithSegment([&]() {
+        ReadLock lock(*mutex);
+        typename MyMap::iterator iterator = FindLive(key);
+        if (iterator == mymap->end()) return std::pair<uint64_t, MappedType>(0, MappedType());
+        if (iterator->second.version == known_version)
+            return std::pair<uint64_t, MappedType>(known_version, MappedType());
+        return std::pair<uint64_t, MappedType>(iterator->second.version, iterator->second.value);
+    });
+}
+
+/**
+ * Get the data of a remote server through the lease cache.
+ * @param key, key to get
+ * @param key_int, the server of key
+ * @return return a pair of bool and Value, as returned by Get.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::pair<bool, MappedType>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetLeased(KeyType &key, uint16_t key_int) {
+    typedef std::pair<uint64_t, MappedType> ret_type;
+    auto requested = LeaseCache<KeyType, MappedType>::clock::now();
+    MappedType cached = MappedType();
+    uint64_t version = 0;
+    auto state = lease_cache->Lookup(key, cached, version, requested);
+    if (state == LeaseCache<KeyType, MappedType>::VALID) return std::pair<bool, MappedType>(true, cached);
+    AutoTrace trace = AutoTrace("hcl::map::GetLeased(remote)", key);
+    ret_type result = RPC_CALL_WRAPPER("_GetLeased", key_int, ret_type, key, version);
+    if (result.first == 0) {
+        lease_cache->Forget(key);
         return std::pair<bool, MappedType>(false, MappedType());
     }
+    if (result.first == version) {
+        lease_cache->Renew(key, version, requested);
+        return std::pair<bool, MappedType>(true, cached);
+    }
+    lease_cache->Store(key, result.second, result.first, requested);
+    return std::pair<bool, MappedType>(true, result.second);
 }
 
 /**
@@ -75,13 +221,20 @@ map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGet(KeyType &key
  * @return return a pair of bool and Value. If bool is true then
  * data was found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::Get(KeyType &key) {
-    size_t key_hash = keyHash(key);
-    uint16_t key_int = key_hash % num_servers;
-    if (is_local(key_int)) {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Get(KeyType &key) {
+    uint16_t key_int = ServerOf(key);
+    uint16_t reader = ReadServer(key, key_int);
+    if (reader != key_int) {
+        if (is_local(reader)) return LocalGetReplica(key);
+        AutoTrace trace = AutoTrace("hcl::map::GetReplica(remote)", key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER("_GetReplica", reader, ret_type, key);
+    } else if (is_local(key_int)) {
         return LocalGet(key);
+    } else if (lease_cache) {
+        return GetLeased(key, key_int);
     } else {
         AutoTrace trace = AutoTrace("hcl::map::Get(remote)", key);
         typedef std::pair<bool, MappedType> ret_type;
@@ -90,40 +243,108 @@ map<KeyType, MappedType, Compare, Allocator , SharedType>::Get(KeyType &key) {
     }
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalErase(KeyType &key) {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalErase(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::map::Erase(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
-    size_t s = mymap->erase(key);
-    return std::pair<bool, MappedType>(s > 0, MappedType());
+    std::vector<std::future<bool>> applied;
+    auto result = WithSegment([&]() {
+        applied.clear();
+        WriteLock lock(*mutex);
+        bool erased = EraseEntry(key);
+        Replicate(key, nullptr, applied);
+        return std::pair<bool, MappedType>(erased, MappedType());
+    }, true);
+    wait_applied(applied);
+    return result;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::Erase(KeyType &key) {
-    size_t key_hash = keyHash(key);
-    uint16_t key_int = key_hash % num_servers;
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Erase(KeyType &key) {
+    uint16_t key_int = ServerOf(key);
     if (is_local(key_int)) {
         return LocalErase(key);
     } else {
         AutoTrace trace = AutoTrace("hcl::map::Erase(remote)", key);
+        ForgetLease(key);
         typedef std::pair<bool, MappedType> ret_type;
         return RPC_CALL_WRAPPER("_Erase", key_int, ret_type, key);
     }
 }
 
+/**
+ * Put the data into the map without waiting for the remote server.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @return future of bool, true if Put was successful else false.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::future<bool>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::AsyncPut(KeyType &key, MappedType &data) {
+    uint16_t key_int = ServerOf(key);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPut(key, data));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::map::AsyncPut(remote)", key, data);
+        ForgetLease(key);
+        return RPC_CALL_WRAPPER_ASYNC("_Put", key_int, bool, key, data);
+    }
+}
+
+/**
+ * Get the data in the map without waiting for the remote server.
+ * @param key, key to get
+ * @return future of a pair of bool and Value, as returned by Get.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::future<std::pair<bool, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::AsyncGet(KeyType &key) {
+    uint16_t key_int = ServerOf(key);
+    uint16_t reader = ReadServer(key, key_int);
+    typedef std::pair<bool, MappedType> ret_type;
+    if (reader != key_int) {
+        if (is_local(reader)) return make_ready_future(LocalGetReplica(key));
+        AutoTrace trace = AutoTrace("hcl::map::AsyncGetReplica(remote)", key);
+        return RPC_CALL_WRAPPER_ASYNC("_GetReplica", reader, ret_type, key);
+    } else if (is_local(key_int)) {
+        return make_ready_future(LocalGet(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::map::AsyncGet(remote)", key);
+        return RPC_CALL_WRAPPER_ASYNC("_Get", key_int, ret_type, key);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::future<std::pair<bool, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::AsyncErase(KeyType &key) {
+    uint16_t key_int = ServerOf(key);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalErase(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::map::AsyncErase(remote)", key);
+        ForgetLease(key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC("_Erase", key_int, ret_type, key);
+    }
+}
+
 /**
  * Get the data into the map. Uses key to decide the server to hash it to,
  * @param key, key to get
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::Contains(KeyType &key_start,KeyType &key_end) {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Contains(KeyType &key_start,KeyType &key_end) {
     AutoTrace trace = AutoTrace("hcl::map::Contains", key_start,key_end);
+    if constexpr (Partitioner::ordered) {
+        typedef std::vector<std::pair<KeyType, MappedType>> ret_type;
+        return InOrder(partitioner.overlapping(key_start, key_end),
+                       [&]() { return LocalContainsInServer(key_start, key_end); },
+                       [&](uint16_t server) { return RPC_CALL_WRAPPER_ASYNC("_Contains", server, ret_type, key_start, key_end); });
+    }
     auto final_values = std::vector<std::pair<KeyType, MappedType>>();
     auto current_server = ContainsInServer(key_start,key_end);
     final_values.insert(final_values.end(), current_server.begin(), current_server.end());
@@ -137,10 +358,324 @@ map<KeyType, MappedType, Compare, Allocator , SharedType>::Contains(KeyType &key
     return final_values;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+/**
+ * Put a batch of data into the local map under a single lock acquisition.
+ * @param data, the key value pairs for put
+ * @return bool, true if all Puts were successful else false.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalPutBatch(std::vector<std::pair<KeyType, MappedType>> &data) {
+    AutoTrace trace = AutoTrace("hcl::map::PutBatch(local)", data.size());
+    std::vector<std::future<bool>> applied;
+    bool result = WithSegment([&]() {
+        applied.clear();
+        WriteLock lock(*mutex);
+        for (auto &entry : data) {
+            auto iterator = InsertEntry(entry.first, entry.second);
+            Replicate(entry.first, &iterator->second, applied);
+        }
+        return true;
+    }, true);
+    return wait_applied(applied) && result;
+}
+
+/**
+ * Put a batch of data into the map. Keys are grouped by the server they hash
+ * to and each server receives a single RPC carrying all of its keys.
+ * @param data, the key value pairs for put
+ * @return bool, true if all Puts were successful else false.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::PutBatch(std::vector<std::pair<KeyType, MappedType>> &data) {
+    AutoTrace trace = AutoTrace("hcl::map::PutBatch", data.size());
+    std::vector<std::vector<std::pair<KeyType, MappedType>>> server_data(num_servers);
+    for (auto &entry : data) {
+        server_data[ServerOf(entry.first)].push_back(entry);
+        ForgetLease(entry.first);
+    }
+    bool result = true;
+    std::vector<std::future<bool>> responses;
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (server_data[server].empty() || is_local(server)) continue;
+        auto response = RPC_CALL_WRAPPER_ASYNC("_PutBatch", server, bool, server_data[server]);
+        responses.push_back(std::move(response));
+    }
+    /* the local group is applied while the remote groups are in flight */
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (!server_data[server].empty() && is_local(server))
+            result = LocalPutBatch(server_data[server]) && result;
+    }
+    for (auto &response : responses) result = response.get() && result;
+    return result;
+}
+
+/**
+ * Get a batch of keys from the local map under a single lock acquisition.
+ * @param keys, keys to get
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetBatch(std::vector<KeyType> &keys) {
+    AutoTrace trace = AutoTrace("hcl::map::GetBatch(local)", keys.size());
+    return WithSegment([&]() {
+        std::vector<std::pair<bool, MappedType>> final_values;
+        final_values.reserve(keys.size());
+        ReadLock lock(*mutex);
+        for (auto &key : keys) {
+            auto iterator = FindLive(key);
+            if (iterator != mymap->end()) {
+                final_values.emplace_back(true, iterator->second.value);
+            } else {
+                final_values.emplace_back(false, MappedType());
+            }
+        }
+        return final_values;
+    });
+}
+
+/**
+ * Get a batch of keys from the map, sending one RPC per server that owns
+ * any of the keys.
+ * @param keys, keys to get
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetBatch(std::vector<KeyType> &keys) {
+    AutoTrace trace = AutoTrace("hcl::map::GetBatch", keys.size());
+    typedef std::vector<std::pair<bool, MappedType>> ret_type;
+    std::vector<std::vector<KeyType>> server_keys(num_servers);
+    std::vector<std::vector<size_t>> server_positions(num_servers);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint16_t key_int = ServerOf(keys[i]);
+        server_keys[key_int].push_back(keys[i]);
+        server_positions[key_int].push_back(i);
+    }
+    std::vector<std::pair<uint16_t, std::future<ret_type>>> responses;
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (server_keys[server].empty() || is_local(server)) continue;
+        auto response = RPC_CALL_WRAPPER_ASYNC("_GetBatch", server, ret_type, server_keys[server]);
+        responses.emplace_back(server, std::move(response));
+    }
+    ret_type final_values(keys.size());
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (server_keys[server].empty() || !is_local(server)) continue;
+        auto values = LocalGetBatch(server_keys[server]);
+        for (size_t i = 0; i < values.size(); ++i) final_values[server_positions[server][i]] = std::move(values[i]);
+    }
+    for (auto &response : responses) {
+        auto values = response.second.get();
+        auto &positions = server_positions[response.first];
+        for (size_t i = 0; i < values.size(); ++i) final_values[positions[i]] = std::move(values[i]);
+    }
+    return final_values;
+}
+
+/**
+ * Erase a batch of keys from the local map under a single lock acquisition.
+ * @param keys, keys to erase
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalEraseBatch(std::vector<KeyType> &keys) {
+    AutoTrace trace = AutoTrace("hcl::map::EraseBatch(local)", keys.size());
+    std::vector<std::future<bool>> applied;
+    auto final_values = WithSegment([&]() {
+        applied.clear();
+        std::vector<std::pair<bool, MappedType>> values;
+        values.reserve(keys.size());
+        WriteLock lock(*mutex);
+        for (auto &key : keys) {
+            values.emplace_back(EraseEntry(key), MappedType());
+            Replicate(key, nullptr, applied);
+        }
+        return values;
+    }, true);
+    wait_applied(applied);
+    return final_values;
+}
+
+/**
+ * Erase a batch of keys from the map, sending one RPC per server that owns
+ * any of the keys.
+ * @param keys, keys to erase
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::EraseBatch(std::vector<KeyType> &keys) {
+    AutoTrace trace = AutoTrace("hcl::map::EraseBatch", keys.size());
+    typedef std::vector<std::pair<bool, MappedType>> ret_type;
+    std::vector<std::vector<KeyType>> server_keys(num_servers);
+    std::vector<std::vector<size_t>> server_positions(num_servers);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ForgetLease(keys[i]);
+        uint16_t key_int = ServerOf(keys[i]);
+        server_keys[key_int].push_back(keys[i]);
+        server_positions[key_int].push_back(i);
+    }
+    std::vector<std::pair<uint16_t, std::future<ret_type>>> responses;
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (server_keys[server].empty() || is_local(server)) continue;
+        auto response = RPC_CALL_WRAPPER_ASYNC("_EraseBatch", server, ret_type, server_keys[server]);
+        responses.emplace_back(server, std::move(response));
+    }
+    ret_type final_values(keys.size());
+    for (uint16_t server = 0; server < num_servers; ++server) {
+        if (server_keys[server].empty() || !is_local(server)) continue;
+        auto values = LocalEraseBatch(server_keys[server]);
+        for (size_t i = 0; i < values.size(); ++i) final_values[server_positions[server][i]] = std::move(values[i]);
+    }
+    for (auto &response : responses) {
+        auto values = response.second.get();
+        auto &positions = server_positions[response.first];
+        for (size_t i = 0; i < values.size(); ++i) final_values[positions[i]] = std::move(values[i]);
+    }
+    return final_values;
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::SendChanges(uint16_t server, std::vector<Change> &changes) {
+    AutoTrace trace = AutoTrace("hcl::map::Apply(remote)", server, changes.size());
+    std::vector<std::pair<KeyType, MappedType>> entries;
+    std::vector<really_long> ttl_ms;
+    std::vector<KeyType> erased;
+    for (auto &change : changes) {
+        if (change.erased) {
+            erased.push_back(change.key);
+        } else {
+            entries.emplace_back(change.key, change.value);
+            ttl_ms.push_back(time_left(change.expires_at));
+        }
+    }
+    bool stored = RPC_CALL_WRAPPER("_Apply", server, bool, entries, ttl_ms, erased);
+    return stored;
+}
+
+/**
+ * Apply changes a primary made to keys this server keeps copies of.
+ * @param entries, the stored entries
+ * @param ttl_ms, milliseconds each entry has left, 0 for never
+ * @param erased, the erased keys
+ * @return bool, true once all are applied.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalApply(std::vector<std::pair<KeyType, MappedType>> &entries,
+                                                                  std::vector<really_long> &ttl_ms,
+                                                                  std::vector<KeyType> &erased) {
+    AutoTrace trace = AutoTrace("hcl::map::Apply(local)", entries.size(), erased.size());
+    return WithSegment([&]() {
+        WriteLock lock(*mutex);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            auto &&value = GetData<Allocator, MappedType, SharedType>(entries[i].second);
+            replicamap->insert_or_assign(entries[i].first, Entry(value, expiry_time(ttl_ms[i]), ++*writes));
+        }
+        for (auto &key : erased) replicamap->erase(key);
+        return true;
+    }, true);
+}
+
+/**
+ * Get the copy of a key this server keeps as a backup.
+ * @param key, key to get
+ * @return return a pair of bool and Value, as returned by LocalGet.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::pair<bool, MappedType>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetReplica(KeyType &key) {
+    AutoTrace trace = AutoTrace("hcl::map::GetReplica(local)", key);
+    return WithSegment([&]() {
+        ReadLock lock(*mutex);
+        auto iterator = replicamap->find(key);
+        if (iterator == replicamap->end() || is_expired(iterator->second.expires_at))
+            return std::pair<bool, MappedType>(false, MappedType());
+        return std::pair<bool, MappedType>(true, iterator->second.value);
+    });
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Local, typename Remote>
+std::vector<std::pair<KeyType, MappedType>>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::InOrder(const std::vector<uint16_t> &servers, Local local, Remote remote) {
+    std::vector<std::future<std::vector<std::pair<KeyType, MappedType>>>> responses;
+    for (uint16_t server : servers) {
+        if (!is_local(server)) responses.push_back(remote(server));
+    }
+    auto final_values = std::vector<std::pair<KeyType, MappedType>>();
+    auto response = responses.begin();
+    for (uint16_t server : servers) {
+        auto values = is_local(server) ? local() : (response++)->get();
+        final_values.insert(final_values.end(), values.begin(), values.end());
+    }
+    return final_values;
+}
+
+/**
+ * Take the split points of the partition map. Servers keep their own, after
+ * checking them against the first server: a server given other points would
+ * take keys the clients send elsewhere. The first server may still be
+ * starting, so the others ask it for up to REBALANCE_TIMEOUT_MS.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+void map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LoadPartitionMap() {
+    if constexpr (Partitioner::ordered) {
+        std::vector<KeyType> points;
+        typedef std::vector<KeyType> ret_type;
+        uint16_t first_server = partitioner.ordered_servers().front();
+        if (is_server || server_on_node) {
+            points = LocalSplitPoints();
+        } else {
+            AutoTrace trace = AutoTrace("hcl::map::SplitPoints(remote)");
+            points = RPC_CALL_WRAPPER1("_SplitPoints", first_server, ret_type);
+        }
+        partitioner.split(points);
+        if (!is_server || num_servers == 1) return;
+        if (partitioner.split_points().empty())
+            throw std::invalid_argument("hcl::map " + name.string() + ": no split points for " +
+                                        std::to_string(num_servers) + " servers");
+        if (my_server == first_server) return;
+        AutoTrace trace = AutoTrace("hcl::map::SplitPoints(check)");
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HCL_CONF->REBALANCE_TIMEOUT_MS);
+        ret_type first_points;
+        while (true) {
+            try {
+                first_points = RPC_CALL_WRAPPER1("_SplitPoints", first_server, ret_type);
+                break;
+            } catch (const std::exception &) {
+                if (std::chrono::steady_clock::now() >= deadline) throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        if (!partitioner.same_split(first_points))
+            throw std::runtime_error("hcl::map " + name.string() + ": server " + std::to_string(my_server) +
+                                     " has other split points than server " + std::to_string(first_server));
+    }
+}
+
+/**
+ * The split points in the partition map of this server.
+ * @return the split points, sorted.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::vector<KeyType> map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalSplitPoints() {
+    AutoTrace trace = AutoTrace("hcl::map::SplitPoints(local)");
+    return WithSegment([&]() {
+        ReadLock lock(*mutex);
+        return std::vector<KeyType>(partition_map->begin(), partition_map->end());
+    });
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllData() {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetAllData() {
     AutoTrace trace = AutoTrace("hcl::map::GetAllData");
+    if constexpr (Partitioner::ordered) {
+        typedef std::vector<std::pair<KeyType, MappedType>> ret_type;
+        return InOrder(partitioner.ordered_servers(), [&]() { return LocalGetAllDataInServer(); },
+                       [&](uint16_t server) { return RPC_CALL_WRAPPER_ASYNC1("_GetAllData", server, ret_type); });
+    }
     auto final_values = std::vector<std::pair<KeyType, MappedType>>();
     auto current_server = GetAllDataInServer();
     final_values.insert(final_values.end(), current_server.begin(), current_server.end());
@@ -154,41 +689,48 @@ map<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllData() {
     return final_values;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalContainsInServer(KeyType &key_start,KeyType &key_end) {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalContainsInServer(KeyType &key_start,KeyType &key_end) {
     AutoTrace trace = AutoTrace("hcl::map::ContainsInServer", key_start,key_end);
-    auto final_values = std::vector<std::pair<KeyType, MappedType>>();
-    {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mutex);
-        typename MyMap::iterator lower_bound;
-        size_t size = mymap->size();
-        if (size == 0) {
-        } else if (size == 1) {
-            lower_bound = mymap->begin();
+    return WithSegment([&]() {
+        auto final_values = std::vector<std::pair<KeyType, MappedType>>();
+        {
+            ReadLock lock(*mutex);
+            typename MyMap::iterator lower_bound;
+            size_t size = mymap->size();
+            really_long now = now_ms();
+            auto live = [now](typename MyMap::iterator iterator) {
+                return iterator->second.expires_at == 0 || iterator->second.expires_at > now;
+            };
+            if (size == 0) {
+            } else if (size == 1) {
+                lower_bound = mymap->begin();
 
-            if(lower_bound->first > key_start)
-                final_values.insert(final_values.end(), std::pair<KeyType, MappedType>(lower_bound->first, lower_bound->second));
-        } else {
-            lower_bound = mymap->lower_bound(key_start);
-            if (lower_bound == mymap->end()) return final_values;
-            if (lower_bound != mymap->begin()) {
-                --lower_bound;
-                if (key_start > lower_bound->first) lower_bound++;
-            }
-            while (lower_bound != mymap->end()) {
-                if (lower_bound->first > key_end) break;
-                final_values.insert(final_values.end(), std::pair<KeyType, MappedType>(lower_bound->first, lower_bound->second));
-                lower_bound++;
+                if (!(key_start > lower_bound->first) && !(lower_bound->first > key_end) && live(lower_bound))
+                    final_values.insert(final_values.end(), std::pair<KeyType, MappedType>(lower_bound->first, lower_bound->second.value));
+            } else {
+                lower_bound = mymap->lower_bound(key_start);
+                if (lower_bound == mymap->end()) return final_values;
+                if (lower_bound != mymap->begin()) {
+                    --lower_bound;
+                    if (key_start > lower_bound->first) lower_bound++;
+                }
+                while (lower_bound != mymap->end()) {
+                    if (lower_bound->first > key_end) break;
+                    if (live(lower_bound))
+                        final_values.insert(final_values.end(), std::pair<KeyType, MappedType>(lower_bound->first, lower_bound->second.value));
+                    lower_bound++;
+                }
             }
         }
-    }
-    return final_values;
+        return final_values;
+    });
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::ContainsInServer(KeyType &key_start,KeyType &key_end) {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::ContainsInServer(KeyType &key_start,KeyType &key_end) {
     if (is_local()) {
         return LocalContainsInServer(key_start,key_end);
     }
@@ -199,27 +741,32 @@ map<KeyType, MappedType, Compare, Allocator , SharedType>::ContainsInServer(KeyT
     }
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGetAllDataInServer() {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetAllDataInServer() {
     AutoTrace trace = AutoTrace("hcl::map::GetAllDataInServer", NULL);
-    auto final_values = std::vector<std::pair<KeyType, MappedType>>();
-    {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mutex);
-        typename MyMap::iterator lower_bound;
-        lower_bound = mymap->begin();
-        while (lower_bound != mymap->end()) {
-            final_values.insert(final_values.end(), std::pair<KeyType, MappedType>(
-                lower_bound->first, lower_bound->second));
-            lower_bound++;
+    return WithSegment([&]() {
+        auto final_values = std::vector<std::pair<KeyType, MappedType>>();
+        {
+            ReadLock lock(*mutex);
+            typename MyMap::iterator lower_bound;
+            really_long now = now_ms();
+            lower_bound = mymap->begin();
+            while (lower_bound != mymap->end()) {
+                really_long expires_at = lower_bound->second.expires_at;
+                if (expires_at == 0 || expires_at > now)
+                    final_values.insert(final_values.end(), std::pair<KeyType, MappedType>(
+                        lower_bound->first, lower_bound->second.value));
+                lower_bound++;
+            }
         }
-    }
-    return final_values;
+        return final_values;
+    });
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-map<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllDataInServer() {
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetAllDataInServer() {
     if (is_local()) {
         return LocalGetAllDataInServer();
     }
@@ -230,7 +777,135 @@ map<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllDataInServer()
    }
 }
 
+/**
+ * Register a callback on every rank and, on servers, bind the Put and Get
+ * variants running it.
+ * @param cb_name, name the callback is called with
+ * @param callback, function applied to the stored value
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+void map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::BindCallback(CharStruct cb_name,
+        std::function<Ret(MappedType &, CB_Args...)> callback) {
+    RegisterCallback(cb_name, callback);
+    if (!is_server) return;
+    std::function<std::pair<bool, Ret>(KeyType &, MappedType &, CB_Args...)> putFunc(
+        [this, cb_name](KeyType &key, MappedType &data, CB_Args... cb_args) {
+            return this->template LocalPutWithCallback<Ret, CB_Args...>(key, data, cb_name, std::forward<CB_Args>(cb_args)...);
+        });
+    std::function<std::pair<bool, Ret>(KeyType &, CB_Args...)> getFunc(
+        [this, cb_name](KeyType &key, CB_Args... cb_args) {
+            return this->template LocalGetWithCallback<Ret, CB_Args...>(key, cb_name, std::forward<CB_Args>(cb_args)...);
+        });
+    rpc->bind_function(func_prefix+"_PutWithCallback_"+cb_name, putFunc);
+    rpc->bind_function(func_prefix+"_GetWithCallback_"+cb_name, getFunc);
+}
 
+/**
+ * Put the data into the local map and run a callback on the stored value.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalPutWithCallback(KeyType &key, MappedType &data,
+                                                                        CharStruct cb_name, CB_Args... cb_args) {
+    AutoTrace trace = AutoTrace("hcl::map::PutWithCallback(local)", key, data);
+    std::vector<std::future<bool>> applied;
+    auto result = WithSegment([&]() {
+        applied.clear();
+        auto &callback = GetCallback<std::function<Ret(MappedType &, CB_Args...)>>(cb_name);
+        WriteLock lock(*mutex);
+        auto iterator = InsertEntry(key, data);
+        std::pair<bool, Ret> called(true, callback(iterator->second.value, std::forward<CB_Args>(cb_args)...));
+        Replicate(key, &iterator->second, applied);
+        return called;
+    }, true);
+    result.first = wait_applied(applied) && result.first;
+    return result;
+}
+
+/**
+ * Run a callback on a value of the local map.
+ * @param key, key to get
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback. If bool is
+ * false the key was not found and the callback did not run.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetWithCallback(KeyType &key, CharStruct cb_name,
+                                                                        CB_Args... cb_args) {
+    AutoTrace trace = AutoTrace("hcl::map::GetWithCallback(local)", key);
+    std::vector<std::future<bool>> applied;
+    auto result = WithSegment([&]() {
+        applied.clear();
+        auto &callback = GetCallback<std::function<Ret(MappedType &, CB_Args...)>>(cb_name);
+        WriteLock lock(*mutex);
+        typename MyMap::iterator iterator = FindLive(key);
+        if (iterator == mymap->end()) return std::pair<bool, Ret>(false, Ret());
+        /* the callback may modify the value */
+        iterator->second.version = ++*writes;
+        std::pair<bool, Ret> called(true, callback(iterator->second.value, std::forward<CB_Args>(cb_args)...));
+        Replicate(key, &iterator->second, applied);
+        return called;
+    }, true);
+    wait_applied(applied);
+    return result;
+}
 
+/**
+ * Put the data into the map and run a callback on the server the key hashes to.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::PutWithCallback(KeyType &key, MappedType &data,
+                                                                   CharStruct cb_name, CB_Args... cb_args) {
+    uint16_t key_int = ServerOf(key);
+    if (is_local(key_int)) {
+        return LocalPutWithCallback<Ret, CB_Args...>(key, data, cb_name, std::forward<CB_Args>(cb_args)...);
+    } else {
+        AutoTrace trace = AutoTrace("hcl::map::PutWithCallback(remote)", key, data);
+        ForgetLease(key);
+        typedef std::pair<bool, Ret> ret_type;
+        return RPC_CALL_WRAPPER_CB(func_prefix+"_PutWithCallback_"+cb_name, key_int, ret_type, key, data);
+    }
+}
+
+/**
+ * Run a callback on a value of the map on the server the key hashes to.
+ * @param key, key to get
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback. If bool is
+ * false the key was not found and the callback did not run.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+map<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetWithCallback(KeyType &key, CharStruct cb_name,
+                                                                   CB_Args... cb_args) {
+    uint16_t key_int = ServerOf(key);
+    if (is_local(key_int)) {
+        return LocalGetWithCallback<Ret, CB_Args...>(key, cb_name, std::forward<CB_Args>(cb_args)...);
+    } else {
+        AutoTrace trace = AutoTrace("hcl::map::GetWithCallback(remote)", key);
+        ForgetLease(key);
+        typedef std::pair<bool, Ret> ret_type;
+        return RPC_CALL_WRAPPER_CB(func_prefix+"_GetWithCallback_"+cb_name, key_int, ret_type, key);
+    }
+}
 
 #endif  // INCLUDE_HCL_MAP_MAP_CPP_
@@ -39,19 +39,27 @@
 /** Boost Headers **/
 #include <boost/interprocess/managed_mapped_file.hpp>
 #include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/containers/vector.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/sync/interprocess_mutex.hpp>
 #include <boost/interprocess/sync/scoped_lock.hpp>
 #include <boost/algorithm/string.hpp>
 /** Standard C++ Headers**/
+#include <chrono>
 #include <iostream>
 #include <functional>
+#include <optional>
+#include <stdexcept>
+#include <thread>
 #include <utility>
 #include <memory>
 #include <string>
 #include <map>
 #include <vector>
 #include <hcl/common/container.h>
+#include <hcl/common/lease_cache.h>
+#include <hcl/common/partitioner.h>
+#include <hcl/common/replicator.h>
 
 namespace hcl {
 
@@ -62,115 +70,201 @@ namespace hcl {
  * achieve the data structure.
  *
  * @tparam MappedType, the value of the Map
+ * @tparam Partitioner, maps the hash of a key to its server (see partitioner.h)
  */
-    template<typename KeyType, typename MappedType, typename Compare = std::less<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t>
+    template<typename KeyType, typename MappedType, typename Compare = std::less<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t,
+             typename Partitioner = ring_partitioner>
     class map : public container {
     private:
+        /*
+         * A stored value, its expiry time (a time of container::now_ms or 0)
+         * and its version for the lease caches of clients, see LocalGetLeased.
+         */
+        struct Entry {
+            MappedType value;
+            really_long expires_at;
+            uint64_t version;
+            template<typename Value>
+            Entry(Value &&value_, really_long expires_at_, uint64_t version_)
+                    : value(std::forward<Value>(value_)), expires_at(expires_at_), version(version_) {}
+        };
         /** Class Typedefs for ease of use **/
-        typedef std::pair<const KeyType, MappedType> ValueType;
+        typedef std::pair<const KeyType, Entry> ValueType;
         typedef boost::interprocess::allocator <ValueType, boost::interprocess::managed_mapped_file::segment_manager>
                 ShmemAllocator;
-        typedef boost::interprocess::map <KeyType, MappedType, Compare, ShmemAllocator> MyMap;
+        typedef boost::interprocess::map <KeyType, Entry, Compare, ShmemAllocator> MyMap;
         /** Class attributes**/
+        Partitioner partitioner;
         MyMap *mymap;
+        /* writes so far, the version of the last written value */
+        uint64_t *writes;
         std::hash<KeyType> keyHash;
+        /* The server owning key: ordered partitioners take the key itself, the others its hash. */
+        uint16_t ServerOf(const KeyType &key) {
+            if constexpr (Partitioner::ordered) return partitioner(key);
+            else return partitioner(keyHash(key));
+        }
+        std::vector<uint16_t> ServersOf(const KeyType &key, uint16_t count) {
+            if constexpr (Partitioner::ordered) return partitioner.replicas(key, count);
+            else return partitioner.replicas(keyHash(key), count);
+        }
+        /*
+         * With an ordered partitioner the split points are kept in the
+         * segment of every server, as the partition map clients read. They
+         * are fixed once a server stored them.
+         */
+        typedef boost::interprocess::allocator<KeyType, boost::interprocess::managed_mapped_file::segment_manager>
+                KeyAllocator;
+        typedef boost::interprocess::vector<KeyType, KeyAllocator> PartitionMap;
+        PartitionMap *partition_map;
+        void LoadPartitionMap();
+        /* Results of servers, in their order: the remote ones are all asked before local runs. */
+        template<typename Local, typename Remote>
+        std::vector<std::pair<KeyType, MappedType>> InOrder(const std::vector<uint16_t> &servers, Local local,
+                                                            Remote remote);
+        /* next key SweepExpired looks at, on servers */
+        std::optional<KeyType> sweep_cursor;
+
+        /* Find key, as end() once it expired. */
+        typename MyMap::iterator FindLive(const KeyType &key) {
+            auto iterator = mymap->find(key);
+            if (iterator != mymap->end() && is_expired(iterator->second.expires_at)) return mymap->end();
+            return iterator;
+        }
+        typename MyMap::iterator InsertEntry(KeyType &key, MappedType &data, really_long expires_at = 0) {
+            auto &&value = GetData<Allocator, MappedType, SharedType>(data);
+            return mymap->insert_or_assign(key, Entry(value, expires_at, ++*writes)).first;
+        }
+        /* Erase key, returns false if it was missing or expired. */
+        bool EraseEntry(const KeyType &key) {
+            auto iterator = mymap->find(key);
+            if (iterator == mymap->end()) return false;
+            bool live = !is_expired(iterator->second.expires_at);
+            mymap->erase(iterator);
+            return live;
+        }
+        void SweepExpired();
+        /* values of remote Gets, with CLIENT_CACHE_LEASE_MS */
+        std::unique_ptr<LeaseCache<KeyType, MappedType>> lease_cache;
+        void ForgetLease(const KeyType &key) {
+            if (lease_cache) lease_cache->Forget(key);
+        }
+        std::pair<bool, MappedType> GetLeased(KeyType &key, uint16_t key_int);
+        /*
+         * With a replication factor above 1, the servers following the primary
+         * of a key on the ring keep copies of it in replicamap. The primary
+         * queues every change of its keys, expirations included, for them.
+         * Only servers queue changes, so clients on their node use RPC.
+         */
+        struct Change {
+            KeyType key;
+            MappedType value;
+            really_long expires_at;
+            bool erased;
+        };
+        MyMap *replicamap;
+        std::unique_ptr<Replicator<Change>> replicator;
+        /* Queue the entry of key, or its erase if entry is null, for the backups; the map lock is held. */
+        void Replicate(const KeyType &key, const Entry *entry, std::vector<std::future<bool>> &applied) {
+            if (!replicator) return;
+            Change change{key, entry ? MappedType(entry->value) : MappedType(), entry ? entry->expires_at : 0,
+                          entry == nullptr};
+            replicator->Push(ServersOf(key, replicator->Copies()), change, applied);
+        }
+        bool SendChanges(uint16_t server, std::vector<Change> &changes);
+        /* The server a Get of a key goes to; with a lease cache the primary, which the versions come from. */
+        uint16_t ReadServer(const KeyType &key, uint16_t primary) {
+            if (!replicator || lease_cache) return primary;
+            return replicator->Reader(ServersOf(key, replicator->Copies()));
+        }
 
 
     public:
         ~map() {
-            this->container::~container();
+            /* the sweeps queue changes too; what is queued is sent before the replicator goes */
+            StopMaintenance();
+            replicator.reset();
         }
 
         void construct_shared_memory() override {
             ShmemAllocator alloc_inst(segment.get_segment_manager());
             /* Construct map in the shared memory space. */
             mymap = segment.construct<MyMap>(name.c_str())(Compare(), alloc_inst);
+            writes = segment.construct<uint64_t>("map_writes")(first_version());
+            if (replicator) replicamap = segment.construct<MyMap>((name.string() + "_replica").c_str())(Compare(), alloc_inst);
+            if constexpr (Partitioner::ordered) {
+                auto &points = partitioner.split_points();
+                partition_map = segment.construct<PartitionMap>("map_partition")(
+                        points.begin(), points.end(), KeyAllocator(segment.get_segment_manager()));
+            }
         }
         void open_shared_memory() override {
             std::pair<MyMap*, boost::interprocess::managed_mapped_file::size_type> res;
             res = segment.find<MyMap> (name.c_str());
             mymap = res.first;
+            writes = segment.find<uint64_t>("map_writes").first;
+            if (replicator) replicamap = segment.find<MyMap>((name.string() + "_replica").c_str()).first;
+            if constexpr (Partitioner::ordered) partition_map = segment.find<PartitionMap>("map_partition").first;
+        }
+        void recover_shared_memory() override {
+            open_shared_memory();
+            *writes = first_version();
+            /* the sweep starts over, also on a restored map */
+            sweep_cursor.reset();
         }
         void bind_functions()  override{
 /* Create a RPC server and map the methods to it. */
-            switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-                case RPCLIB: {
-                    std::function<bool(KeyType &, MappedType &)> putFunc(
-                            std::bind(&map<KeyType, MappedType, Compare>::LocalPut, this,
-                                      std::placeholders::_1, std::placeholders::_2));
-                    std::function<std::pair<bool, MappedType>(KeyType &)> getFunc(
-                            std::bind(&map<KeyType, MappedType, Compare>::LocalGet, this,
-                                      std::placeholders::_1));
-                    std::function<std::pair<bool, MappedType>(KeyType &)> eraseFunc(
-                            std::bind(&map<KeyType, MappedType, Compare>::LocalErase, this,
-                                      std::placeholders::_1));
-                    std::function<std::vector<std::pair<KeyType, MappedType>>(void)>
-                            getAllDataInServerFunc(std::bind(
-                            &map<KeyType, MappedType, Compare>::LocalGetAllDataInServer,
-                            this));
-                    std::function<std::vector<std::pair<KeyType, MappedType>>(KeyType &,KeyType&)>
-                            containsInServerFunc(std::bind(&map<KeyType, MappedType,
-                                                                   Compare>::LocalContainsInServer, this,
-                                                           std::placeholders::_1, std::placeholders::_2));
-
-                    rpc->bind(func_prefix+"_Put", putFunc);
-                    rpc->bind(func_prefix+"_Get", getFunc);
-                    rpc->bind(func_prefix+"_Erase", eraseFunc);
-                    rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-                    rpc->bind(func_prefix+"_Contains", containsInServerFunc);
-                    break;
-                }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-                    case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-                    case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-                    {
-
-                    std::function<void(const tl::request &, KeyType &, MappedType &)> putFunc(
-                        std::bind(&map<KeyType, MappedType, Compare>::ThalliumLocalPut, this,
-                                  std::placeholders::_1, std::placeholders::_2,
-                                  std::placeholders::_3));
-                    std::function<void(const tl::request &, KeyType &)> getFunc(
-                        std::bind(&map<KeyType, MappedType, Compare>::ThalliumLocalGet, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-                    std::function<void(const tl::request &, KeyType &)> eraseFunc(
-                        std::bind(&map<KeyType, MappedType, Compare>::ThalliumLocalErase, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-                    std::function<void(const tl::request &)>
-                            getAllDataInServerFunc(std::bind(
-                                &map<KeyType, MappedType, Compare>::ThalliumLocalGetAllDataInServer,
-                                this, std::placeholders::_1));
-                    std::function<void(const tl::request &, KeyType &, KeyType &)>
-                            containsInServerFunc(std::bind(&map<KeyType, MappedType,
-                                                           Compare>::ThalliumLocalContainsInServer, this,
-                                                           std::placeholders::_1,
-							   std::placeholders::_2,
-							   std::placeholders::_3));
-
-                    rpc->bind(func_prefix+"_Put", putFunc);
-                    rpc->bind(func_prefix+"_Get", getFunc);
-                    rpc->bind(func_prefix+"_Erase", eraseFunc);
-                    rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-                    rpc->bind(func_prefix+"_Contains", containsInServerFunc);
-                    break;
-                }
-#endif
+            rpc->bind_method(func_prefix+"_Put", this, &map::LocalPut);
+            rpc->bind_method(func_prefix+"_PutWithTTL", this, &map::LocalPutWithTTL);
+            rpc->bind_method(func_prefix+"_Get", this, &map::LocalGet);
+            rpc->bind_method(func_prefix+"_GetLeased", this, &map::LocalGetLeased);
+            rpc->bind_method(func_prefix+"_Erase", this, &map::LocalErase);
+            rpc->bind_method(func_prefix+"_GetAllData", this, &map::LocalGetAllDataInServer);
+            rpc->bind_method(func_prefix+"_Contains", this, &map::LocalContainsInServer);
+            rpc->bind_method(func_prefix+"_PutBatch", this, &map::LocalPutBatch);
+            rpc->bind_method(func_prefix+"_GetBatch", this, &map::LocalGetBatch);
+            rpc->bind_method(func_prefix+"_EraseBatch", this, &map::LocalEraseBatch);
+            if constexpr (Partitioner::ordered)
+                rpc->bind_method(func_prefix+"_SplitPoints", this, &map::LocalSplitPoints);
+            if (replicator) {
+                rpc->bind_method(func_prefix+"_Apply", this, &map::LocalApply);
+                rpc->bind_method(func_prefix+"_GetReplica", this, &map::LocalGetReplica);
             }
+            bind_segment_functions();
         }
 
-        explicit map(CharStruct name_ = "TEST_MAP", uint16_t port = HCL_CONF->RPC_PORT) :container(name_,port), mymap(){
+        /**
+         * split_points only matter with an ordered partitioner such as
+         * range_partitioner: servers store them unless they recover a map,
+         * clients read them from the servers. With more than one server they
+         * must not be empty and every server must have the points of the
+         * first one, else the constructor throws on the servers.
+         */
+        explicit map(CharStruct name_ = "TEST_MAP", uint16_t port = HCL_CONF->RPC_PORT,
+                     std::vector<KeyType> split_points = std::vector<KeyType>(),
+                     ReplicationOptions replication = ReplicationOptions())
+                :container(name_,port), partitioner(num_servers), mymap(), writes(), partition_map(), replicamap(){
             AutoTrace trace = AutoTrace("hcl::map");
+            guarded = true;
+            if constexpr (Partitioner::ordered) partitioner.split(split_points);
+            if (replication.enabled()) {
+                if (!is_server) server_on_node = false;
+                replicator.reset(new Replicator<Change>(
+                        [this](uint16_t server, std::vector<Change> &changes) { return SendChanges(server, changes); },
+                        replication, my_server));
+            }
             if (is_server) {
-                construct_shared_memory();
+                init_shared_memory();
                 bind_functions();
             }else if (!is_server && server_on_node) {
                 open_shared_memory();
             }
+            if constexpr (Partitioner::ordered) LoadPartitionMap();
+            if (is_server && HCL_CONF->TTL_SWEEP_INTERVAL_MS != 0)
+                StartMaintenance(std::chrono::milliseconds(HCL_CONF->TTL_SWEEP_INTERVAL_MS), [this]() { SweepExpired(); });
+            if (HCL_CONF->CLIENT_CACHE_LEASE_MS != 0)
+                lease_cache.reset(new LeaseCache<KeyType, MappedType>(
+                        std::chrono::milliseconds(HCL_CONF->CLIENT_CACHE_LEASE_MS), HCL_CONF->CLIENT_CACHE_ENTRIES));
         }
 
         MyMap *data() {
@@ -181,28 +275,66 @@ namespace hcl {
 
         bool LocalPut(KeyType &key, MappedType &data);
 
+        bool LocalPutWithTTL(KeyType &key, MappedType &data, really_long ttl_ms);
+
         std::pair<bool, MappedType> LocalGet(KeyType &key);
 
+        std::pair<uint64_t, MappedType> LocalGetLeased(KeyType &key, uint64_t known_version);
+
+        /**
+         * Run visitor(const MappedType &) on the value in the segment, under
+         * the read lock of the map, instead of copying it out. The reference
+         * must not escape visitor, and visitor must not call into this container.
+         */
+        template<typename Visitor>
+        bool LocalGetView(KeyType &key, Visitor &&visitor);
+
         std::pair<bool, MappedType> LocalErase(KeyType &key);
 
         std::vector<std::pair<KeyType, MappedType>> LocalGetAllDataInServer();
 
         std::vector<std::pair<KeyType, MappedType>> LocalContainsInServer(KeyType &key_start, KeyType &key_end);
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-        THALLIUM_DEFINE(LocalPut, (key,data), KeyType &key, MappedType &data)
-        THALLIUM_DEFINE(LocalGet, (key), KeyType &key)
-        THALLIUM_DEFINE(LocalErase, (key), KeyType &key)
-        THALLIUM_DEFINE(LocalContainsInServer, (key_start, key_end), KeyType &key_start, KeyType &key_end)
-        THALLIUM_DEFINE1(LocalGetAllDataInServer)
-#endif
+        bool LocalPutBatch(std::vector<std::pair<KeyType, MappedType>> &data);
+
+        std::vector<std::pair<bool, MappedType>> LocalGetBatch(std::vector<KeyType> &keys);
+
+        std::vector<std::pair<bool, MappedType>> LocalEraseBatch(std::vector<KeyType> &keys);
+
+        bool LocalApply(std::vector<std::pair<KeyType, MappedType>> &entries, std::vector<really_long> &ttl_ms,
+                        std::vector<KeyType> &erased);
+
+        std::pair<bool, MappedType> LocalGetReplica(KeyType &key);
+
+        std::vector<KeyType> LocalSplitPoints();
+
 
         bool Put(KeyType &key, MappedType &data);
 
+        /* The entry expires after ttl: Get, Contains and GetAllData no longer return it and the server reclaims it. */
+        bool Put(KeyType &key, MappedType &data, std::chrono::milliseconds ttl);
+
         std::pair<bool, MappedType> Get(KeyType &key);
 
+        /* LocalGetView on the node of the server, visitor on a copy of the value elsewhere. */
+        template<typename Visitor>
+        bool GetView(KeyType &key, Visitor &&visitor);
+
         std::pair<bool, MappedType> Erase(KeyType &key);
 
+        std::future<bool> AsyncPut(KeyType &key, MappedType &data);
+
+        std::future<std::pair<bool, MappedType>> AsyncGet(KeyType &key);
+
+        std::future<std::pair<bool, MappedType>> AsyncErase(KeyType &key);
+
+        bool PutBatch(std::vector<std::pair<KeyType, MappedType>> &data);
+
+        std::vector<std::pair<bool, MappedType>> GetBatch(std::vector<KeyType> &keys);
+
+        std::vector<std::pair<bool, MappedType>> EraseBatch(std::vector<KeyType> &keys);
+
+        /* With an ordered partitioner, only the servers overlapping the range are asked and the data is sorted. */
         std::vector<std::pair<KeyType, MappedType>> Contains(KeyType &key_start, KeyType &key_end);
 
         std::vector<std::pair<KeyType, MappedType>> GetAllData();
@@ -210,6 +342,27 @@ namespace hcl {
         std::vector<std::pair<KeyType, MappedType>> ContainsInServer(KeyType &key_start, KeyType &key_end);
 
         std::vector<std::pair<KeyType, MappedType>> GetAllDataInServer();
+
+        /**
+         * Callbacks run on the server owning the key, on the stored value and
+         * under the exclusive container lock, since they may modify it; only
+         * their result is sent back. The CB_Args of a call have to match the
+         * ones the callback was bound with.
+         */
+        template<typename Ret, typename... CB_Args>
+        void BindCallback(CharStruct cb_name, std::function<Ret(MappedType &, CB_Args...)> callback);
+
+        template<typename Ret, typename... CB_Args>
+        std::pair<bool, Ret> LocalPutWithCallback(KeyType &key, MappedType &data, CharStruct cb_name, CB_Args... cb_args);
+
+        template<typename Ret, typename... CB_Args>
+        std::pair<bool, Ret> LocalGetWithCallback(KeyType &key, CharStruct cb_name, CB_Args... cb_args);
+
+        template<typename Ret, typename... CB_Args>
+        std::pair<bool, Ret> PutWithCallback(KeyType &key, MappedType &data, CharStruct cb_name, CB_Args... cb_args);
+
+        template<typename Ret, typename... CB_Args>
+        std::pair<bool, Ret> GetWithCallback(KeyType &key, CharStruct cb_name, CB_Args... cb_args);
     };
 
 #include "map.cpp"
@@ -14,17 +14,16 @@
 #define INCLUDE_HCL_MULTIMAP_MULTIMAP_CPP_
 
 /* Constructor to deallocate the shared memory*/
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::~multimap() {
-    this->container::~container();
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::~multimap() {
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::multimap(CharStruct name_, uint16_t port)
-                 : container(name_,port),mymap() {
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::multimap(CharStruct name_, uint16_t port)
+                 : container(name_,port), partitioner(num_servers), mymap() {
     AutoTrace trace = AutoTrace("hcl::multimap");
     if (is_server) {
-        construct_shared_memory();
+        init_shared_memory();
         bind_functions();
     }else if (!is_server && server_on_node) {
         open_shared_memory();
@@ -37,17 +36,16 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::multimap(CharStr
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-bool multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalPut(KeyType &key,
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalPut(KeyType &key,
                                                       MappedType &data) {
     AutoTrace trace = AutoTrace("hcl::multimap::Put(local)", key, data);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
+    WriteLock lock(*mutex);
     typename MyMap::iterator iterator = mymap->find(key);
     if (iterator != mymap->end()) {
         mymap->erase(iterator);
     }
-    auto value = GetData<Allocator, MappedType, SharedType>(data);
+    auto &&value = GetData<Allocator, MappedType, SharedType>(data);
     mymap->insert(std::pair<KeyType, MappedType>(key, value));
     return true;
 }
@@ -59,11 +57,11 @@ bool multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalPut(Ke
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-bool multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Put(KeyType &key,
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+bool multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Put(KeyType &key,
                                                  MappedType &data) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = static_cast<uint16_t>(key_hash % num_servers);
+    uint16_t key_int = partitioner(key_hash);
     if (is_local(key_int)) {
         return LocalPut(key, data);
     } else {
@@ -80,12 +78,11 @@ bool multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Put(KeyType
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGet(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGet(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::multimap::Get(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
+    ReadLock lock(*mutex);
     typename MyMap::iterator iterator = mymap->find(key);
     if (iterator != mymap->end()) {
         return std::pair<bool, MappedType>(true, iterator->second);
@@ -101,11 +98,11 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGet(KeyType
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Get(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Get(KeyType &key) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = key_hash % num_servers;
+    uint16_t key_int = partitioner(key_hash);
     if (is_local(key_int)) {
         return LocalGet(key);
     } else {
@@ -116,21 +113,20 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Get(KeyType &key
     }
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalErase(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalErase(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::multimap::Erase(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
+    WriteLock lock(*mutex);
     size_t s = mymap->erase(key);
     return std::pair<bool, MappedType>(s > 0, MappedType());
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Erase(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Erase(KeyType &key) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = key_hash % num_servers;
+    uint16_t key_int = partitioner(key_hash);
     if (is_local(key_int)) {
         return LocalErase(key);
     } else {
@@ -147,9 +143,61 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Erase(KeyType &k
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+/**
+ * Put the data into the multimap without waiting for the remote server.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @return future of bool, true if Put was successful else false.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::future<bool>
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::AsyncPut(KeyType &key, MappedType &data) {
+    size_t key_hash = keyHash(key);
+    uint16_t key_int = partitioner(key_hash);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPut(key, data));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::multimap::AsyncPut(remote)", key, data);
+        return RPC_CALL_WRAPPER_ASYNC("_Put", key_int, bool, key, data);
+    }
+}
+
+/**
+ * Get the data in the multimap without waiting for the remote server.
+ * @param key, key to get
+ * @return future of a pair of bool and Value, as returned by Get.
+ */
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::future<std::pair<bool, MappedType>>
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::AsyncGet(KeyType &key) {
+    size_t key_hash = keyHash(key);
+    uint16_t key_int = partitioner(key_hash);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalGet(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::multimap::AsyncGet(remote)", key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC("_Get", key_int, ret_type, key);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+std::future<std::pair<bool, MappedType>>
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::AsyncErase(KeyType &key) {
+    size_t key_hash = keyHash(key);
+    uint16_t key_int = partitioner(key_hash);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalErase(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::multimap::AsyncErase(remote)", key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC("_Erase", key_int, ret_type, key);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Contains(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::Contains(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::multimap::Contains", key);
     std::vector<std::pair<KeyType, MappedType>> final_values =
             std::vector<std::pair<KeyType, MappedType>>();
@@ -167,9 +215,9 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::Contains(KeyType
     return final_values;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllData() {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetAllData() {
     AutoTrace trace = AutoTrace("hcl::multimap::GetAllData");
     std::vector<std::pair<KeyType, MappedType>> final_values =
             std::vector<std::pair<KeyType, MappedType>>();
@@ -186,15 +234,14 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllData() {
     return final_values;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalContainsInServer(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalContainsInServer(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::multimap::ContainsInServer", key);
     std::vector<std::pair<KeyType, MappedType>> final_values =
             std::vector<std::pair<KeyType, MappedType>>();
     {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-                lock(*mutex);
+        ReadLock lock(*mutex);
         typename MyMap::iterator lower_bound;
         size_t size = mymap->size();
         if (size == 0) {
@@ -222,9 +269,9 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalContainsInS
     return final_values;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::ContainsInServer(KeyType &key) {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::ContainsInServer(KeyType &key) {
     if (is_local()) {
         return LocalContainsInServer(key);
     }
@@ -236,15 +283,14 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::ContainsInServer
     }
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGetAllDataInServer() {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::LocalGetAllDataInServer() {
     AutoTrace trace = AutoTrace("hcl::multimap::GetAllDataInServer");
     std::vector<std::pair<KeyType, MappedType>> final_values =
             std::vector<std::pair<KeyType, MappedType>>();
     {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-                lock(*mutex);
+        ReadLock lock(*mutex);
         typename MyMap::iterator lower_bound;
         lower_bound = mymap->begin();
         while (lower_bound != mymap->end()) {
@@ -256,9 +302,9 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGetAllDataI
     return final_values;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-multimap<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllDataInServer() {
+multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::GetAllDataInServer() {
     if (is_local()) {
         return LocalGetAllDataInServer();
     }
@@ -269,91 +315,29 @@ multimap<KeyType, MappedType, Compare, Allocator , SharedType>::GetAllDataInServ
     }
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-void multimap<KeyType, MappedType, Compare, Allocator , SharedType>::construct_shared_memory() {
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+void multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::construct_shared_memory() {
     ShmemAllocator alloc_inst(segment.get_segment_manager());
     /* Construct Multimap in the shared memory space. */
     mymap = segment.construct<MyMap>(name.c_str())(Compare(), alloc_inst);
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-void multimap<KeyType, MappedType, Compare, Allocator , SharedType>::open_shared_memory() {
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+void multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::open_shared_memory() {
     std::pair<MyMap*, boost::interprocess:: managed_mapped_file::size_type>
             res;
     res = segment.find<MyMap>(name.c_str());
     mymap = res.first;
 }
 
-template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType>
-void multimap<KeyType, MappedType, Compare, Allocator , SharedType>::bind_functions() {
+template<typename KeyType, typename MappedType, typename Compare, typename Allocator , typename SharedType, typename Partitioner>
+void multimap<KeyType, MappedType, Compare, Allocator , SharedType, Partitioner>::bind_functions() {
     /* Create a RPC server and map the methods to it. */
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            std::function<bool(KeyType &, MappedType &)> putFunc(
-                    std::bind(&multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalPut, this,
-                              std::placeholders::_1, std::placeholders::_2));
-            std::function<std::pair<bool, MappedType>(KeyType &)> getFunc(
-                    std::bind(&multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGet, this,
-                              std::placeholders::_1));
-            std::function<std::pair<bool, MappedType>(KeyType &)> eraseFunc(
-                    std::bind(&multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalErase, this,
-                              std::placeholders::_1));
-            std::function<std::vector<std::pair<KeyType, MappedType>>(void)>
-                    getAllDataInServerFunc(std::bind(
-                    &multimap<KeyType, MappedType, Compare, Allocator , SharedType>::LocalGetAllDataInServer,
-                    this));
-            std::function<std::vector<std::pair<KeyType, MappedType>>(KeyType &)>
-                    containsInServerFunc(std::bind(&multimap<KeyType, MappedType,
-                                                           Compare>::LocalContainsInServer, this,
-                                                   std::placeholders::_1));
-
-            rpc->bind(func_prefix+"_Put", putFunc);
-            rpc->bind(func_prefix+"_Get", getFunc);
-            rpc->bind(func_prefix+"_Erase", eraseFunc);
-            rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-            rpc->bind(func_prefix+"_Contains", containsInServerFunc);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-            case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-            case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-            {
-
-                    std::function<void(const tl::request &, KeyType &, MappedType &)> putFunc(
-                        std::bind(&multimap<KeyType, MappedType, Compare, Allocator , SharedType>::ThalliumLocalPut, this,
-                                  std::placeholders::_1, std::placeholders::_2,
-                                  std::placeholders::_3));
-                    std::function<void(const tl::request &, KeyType &)> getFunc(
-                        std::bind(&multimap<KeyType, MappedType, Compare, Allocator , SharedType>::ThalliumLocalGet, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-                    std::function<void(const tl::request &, KeyType &)> eraseFunc(
-                        std::bind(&multimap<KeyType, MappedType, Compare, Allocator , SharedType>::ThalliumLocalErase, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-                    std::function<void(const tl::request &)>
-                            getAllDataInServerFunc(std::bind(
-                                &multimap<KeyType, MappedType, Compare, Allocator , SharedType>::ThalliumLocalGetAllDataInServer,
-                                this, std::placeholders::_1));
-                    std::function<void(const tl::request &, KeyType &)>
-                            containsInServerFunc(std::bind(&multimap<KeyType, MappedType,
-                                                           Compare>::ThalliumLocalContainsInServer, this,
-                                                           std::placeholders::_1,
-							   std::placeholders::_2));
-
-                    rpc->bind(func_prefix+"_Put", putFunc);
-                    rpc->bind(func_prefix+"_Get", getFunc);
-                    rpc->bind(func_prefix+"_Erase", eraseFunc);
-                    rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-                    rpc->bind(func_prefix+"_Contains", containsInServerFunc);
-                    break;
-                }
-#endif
-    }
+    rpc->bind_method(func_prefix+"_Put", this, &multimap::LocalPut);
+    rpc->bind_method(func_prefix+"_Get", this, &multimap::LocalGet);
+    rpc->bind_method(func_prefix+"_Erase", this, &multimap::LocalErase);
+    rpc->bind_method(func_prefix+"_GetAllData", this, &multimap::LocalGetAllDataInServer);
+    rpc->bind_method(func_prefix+"_Contains", this, &multimap::LocalContainsInServer);
 }
 
 #endif  // INCLUDE_HCL_MULTIMAP_MULTIMAP_CPP_
@@ -48,6 +48,7 @@
 #include <string>
 #include <vector>
 #include <hcl/common/container.h>
+#include <hcl/common/partitioner.h>
 
 namespace hcl {
 /**
@@ -55,10 +56,13 @@ namespace hcl {
  * achieve the data structure.
  *
  * @tparam MappedType, the value of the MultiMap
+ * @tparam Partitioner, maps the hash of a key to its server (see partitioner.h)
  */
 template<typename KeyType, typename MappedType, typename Compare =
-         std::less<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t>
+         std::less<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t,
+         typename Partitioner = ring_partitioner>
 class multimap:public container {
+    static_assert(!Partitioner::ordered, "hcl::multimap requires a hash partitioner, range partitioning is for hcl::map");
   private:
     /** Class Typedefs for ease of use **/
     typedef std::pair<const KeyType, MappedType> ValueType;
@@ -69,6 +73,7 @@ class multimap:public container {
                                           ShmemAllocator> MyMap;
     /** Class attributes**/
     std::hash<KeyType> keyHash;
+    Partitioner partitioner;
     MyMap *mymap;
 
   public:
@@ -93,18 +98,14 @@ class multimap:public container {
     std::vector<std::pair<KeyType, MappedType>> LocalContainsInServer(KeyType &key);
     std::vector<std::pair<KeyType, MappedType>> LocalGetAllDataInServer();
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE(LocalPut, (key, data), KeyType &key, MappedType &data)
-    THALLIUM_DEFINE(LocalGet, (key), KeyType &key)
-    THALLIUM_DEFINE(LocalErase, (key), KeyType &key)
-    THALLIUM_DEFINE(LocalContainsInServer, (key), KeyType &key)
-    THALLIUM_DEFINE1(LocalGetAllDataInServer)
-#endif
 
     bool Put(KeyType &key, MappedType &data);
     std::pair<bool, MappedType> Get(KeyType &key);
 
     std::pair<bool, MappedType> Erase(KeyType &key);
+    std::future<bool> AsyncPut(KeyType &key, MappedType &data);
+    std::future<std::pair<bool, MappedType>> AsyncGet(KeyType &key);
+    std::future<std::pair<bool, MappedType>> AsyncErase(KeyType &key);
     std::vector<std::pair<KeyType, MappedType>> Contains(KeyType &key);
 
     std::vector<std::pair<KeyType, MappedType>> GetAllData();
@@ -16,14 +16,13 @@
 /* Constructor to deallocate the shared memory*/
 template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
 priority_queue<MappedType, Compare, Allocator , SharedType>::~priority_queue() {
-    this->container::~container();
 }
 
 template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
 priority_queue<MappedType, Compare, Allocator , SharedType>::priority_queue(CharStruct name_, uint16_t port):container(name_,port),queue(){
     AutoTrace trace = AutoTrace("hcl::priority_queue");
     if (is_server) {
-        construct_shared_memory();
+        init_shared_memory();
         bind_functions();
     }else if (!is_server && server_on_node) {
         open_shared_memory();
@@ -39,8 +38,8 @@ priority_queue<MappedType, Compare, Allocator , SharedType>::priority_queue(Char
 template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
 bool priority_queue<MappedType, Compare, Allocator , SharedType>::LocalPush(MappedType &data) {
     AutoTrace trace = AutoTrace("hcl::priority_queue::Push(local)", data);
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
-    auto value = GetData<Allocator, MappedType, SharedType>(data);
+    WriteLock lock(*mutex);
+    auto &&value = GetData<Allocator, MappedType, SharedType>(data);
     queue->push(value);
     return true;
 }
@@ -75,7 +74,7 @@ template<typename MappedType, typename Compare, typename Allocator , typename Sh
 std::pair<bool, MappedType>
 priority_queue<MappedType, Compare, Allocator , SharedType>::LocalPop() {
     AutoTrace trace = AutoTrace("hcl::priority_queue::Pop(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    WriteLock lock(*mutex);
     if (queue->size() > 0) {
         MappedType value = queue->top();
         queue->pop();
@@ -104,6 +103,44 @@ priority_queue<MappedType, Compare, Allocator , SharedType>::Pop(uint16_t &key_i
     }
 }
 
+/**
+ * Push the data into the priority queue without waiting for the remote
+ * server.
+ * @param data, the value for put
+ * @param key_int, key_int to know which server
+ * @return future of bool, true if Push was successful else false.
+ */
+template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
+std::future<bool> priority_queue<MappedType, Compare, Allocator , SharedType>::AsyncPush(MappedType &data,
+                                                                                     uint16_t &key_int) {
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPush(data));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::priority_queue::AsyncPush(remote)",
+                                    data, key_int);
+        return RPC_CALL_WRAPPER_ASYNC("_Push", key_int, bool, data);
+    }
+}
+
+/**
+ * Get the data from the priority queue without waiting for the remote
+ * server.
+ * @param key_int, key_int to know which server
+ * @return future of a pair of bool and Value, as returned by Pop.
+ */
+template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
+std::future<std::pair<bool, MappedType>>
+priority_queue<MappedType, Compare, Allocator , SharedType>::AsyncPop(uint16_t &key_int) {
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPop());
+    } else {
+        AutoTrace trace = AutoTrace("hcl::priority_queue::AsyncPop(remote)",
+                                    key_int);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC1("_Pop", key_int, ret_type);
+    }
+}
+
 /**
  * Get the data from the local priority queue.
  * @param key_int, key_int to know which server
@@ -114,7 +151,7 @@ template<typename MappedType, typename Compare, typename Allocator , typename Sh
 std::pair<bool, MappedType>
 priority_queue<MappedType, Compare, Allocator , SharedType>::LocalTop() {
     AutoTrace trace = AutoTrace("hcl::priority_queue::Top(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    ReadLock lock(*mutex);
     if (queue->size() > 0) {
         MappedType value = queue->top();
         return std::pair<bool, MappedType>(true, value);
@@ -150,7 +187,7 @@ priority_queue<MappedType, Compare, Allocator , SharedType>::Top(uint16_t &key_i
 template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
 size_t priority_queue<MappedType, Compare, Allocator , SharedType>::LocalSize() {
     AutoTrace trace = AutoTrace("hcl::priority_queue::Size(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    ReadLock lock(*mutex);
     size_t value = queue->size();
     return value;
 }
@@ -189,59 +226,10 @@ void priority_queue<MappedType, Compare, Allocator , SharedType>::open_shared_me
 template<typename MappedType, typename Compare, typename Allocator , typename SharedType>
 void priority_queue<MappedType, Compare, Allocator , SharedType>::bind_functions() {
     /* Create a RPC server and map the methods to it. */
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            std::function<bool(MappedType &)> pushFunc(
-                    std::bind(&hcl::priority_queue<MappedType,
-                                      Compare>::LocalPush, this,
-                              std::placeholders::_1));
-            std::function<std::pair<bool, MappedType>(void)> popFunc(std::bind(
-                    &hcl::priority_queue<MappedType,
-                            Compare>::LocalPop, this));
-            std::function<size_t(void)> sizeFunc(std::bind(
-                    &hcl::priority_queue<MappedType,
-                            Compare>::LocalSize, this));
-            std::function<std::pair<bool, MappedType>(void)> topFunc(std::bind(
-                    &hcl::priority_queue<MappedType,
-                            Compare>::LocalTop, this));
-            rpc->bind(func_prefix+"_Push", pushFunc);
-            rpc->bind(func_prefix+"_Pop", popFunc);
-            rpc->bind(func_prefix+"_Top", topFunc);
-            rpc->bind(func_prefix+"_Size", sizeFunc);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-            case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-            case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-            {
-                    std::function<void(const tl::request &, MappedType &)> pushFunc(
-                        std::bind(&hcl::priority_queue<MappedType,
-                                  Compare>::ThalliumLocalPush, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-                    std::function<void(const tl::request &)> popFunc(std::bind(
-                        &hcl::priority_queue<MappedType,
-                        Compare>::ThalliumLocalPop, this, std::placeholders::_1));
-                    std::function<void(const tl::request &)> sizeFunc(std::bind(
-                        &hcl::priority_queue<MappedType,
-                        Compare>::ThalliumLocalSize, this, std::placeholders::_1));
-                    std::function<void(const tl::request &)> topFunc(std::bind(
-                        &hcl::priority_queue<MappedType,
-                        Compare>::ThalliumLocalTop, this,
-                        std::placeholders::_1));
-                    rpc->bind(func_prefix+"_Push", pushFunc);
-                    rpc->bind(func_prefix+"_Pop", popFunc);
-                    rpc->bind(func_prefix+"_Top", topFunc);
-                    rpc->bind(func_prefix+"_Size", sizeFunc);
-                    break;
-                }
-#endif
-    }
+    rpc->bind_method(func_prefix+"_Push", this, &priority_queue::LocalPush);
+    rpc->bind_method(func_prefix+"_Pop", this, &priority_queue::LocalPop);
+    rpc->bind_method(func_prefix+"_Top", this, &priority_queue::LocalTop);
+    rpc->bind_method(func_prefix+"_Size", this, &priority_queue::LocalSize);
 }
 
 #endif  // INCLUDE_HCL_PRIORITY_QUEUE_PRIORITY_QUEUE_CPP_
@@ -91,17 +91,13 @@ class priority_queue:public container {
     std::pair<bool, MappedType> LocalTop();
     size_t LocalSize();
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE(LocalPush, (data), MappedType &data)
-    THALLIUM_DEFINE1(LocalPop)
-    THALLIUM_DEFINE1(LocalTop)
-    THALLIUM_DEFINE1(LocalSize)
-#endif
 
     bool Push(MappedType &data, uint16_t &key_int);
     std::pair<bool, MappedType> Pop(uint16_t &key_int);
     std::pair<bool, MappedType> Top(uint16_t &key_int);
     size_t Size(uint16_t &key_int);
+    std::future<bool> AsyncPush(MappedType &data, uint16_t &key_int);
+    std::future<std::pair<bool, MappedType>> AsyncPop(uint16_t &key_int);
 };
 
 #include "priority_queue.cpp"
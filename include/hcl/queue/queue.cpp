@@ -12,13 +12,12 @@
 
 template<typename MappedType, typename Allocator , typename SharedType>
 queue<MappedType, Allocator , SharedType>::~queue() {
-    this->container::~container();
 }
 template<typename MappedType, typename Allocator , typename SharedType>
 queue<MappedType, Allocator , SharedType>::queue(CharStruct name_, uint16_t port):container(name_,port),my_queue(){
     AutoTrace trace = AutoTrace("hcl::queue(local)");
     if (is_server) {
-        construct_shared_memory();
+        init_shared_memory();
         bind_functions();
     }else if (!is_server && server_on_node) {
         open_shared_memory();
@@ -34,8 +33,8 @@ queue<MappedType, Allocator , SharedType>::queue(CharStruct name_, uint16_t port
 template<typename MappedType, typename Allocator , typename SharedType>
 bool queue<MappedType, Allocator , SharedType>::LocalPush(MappedType &data) {
     AutoTrace trace = AutoTrace("hcl::queue::Push(local)", data);
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
-    auto value = GetData<Allocator, MappedType, SharedType>(data);
+    WriteLock lock(*mutex);
+    auto &&value = GetData<Allocator, MappedType, SharedType>(data);
     my_queue->push_back(std::move(value));
     return true;
 }
@@ -69,7 +68,7 @@ template<typename MappedType, typename Allocator , typename SharedType>
 std::pair<bool, MappedType>
 queue<MappedType, Allocator , SharedType>::LocalPop() {
     AutoTrace trace = AutoTrace("hcl::queue::Pop(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    WriteLock lock(*mutex);
     if (my_queue->size() > 0) {
         MappedType value = my_queue->front();
         my_queue->pop_front();
@@ -98,6 +97,42 @@ queue<MappedType, Allocator , SharedType>::Pop(uint16_t &key_int) {
     }
 }
 
+/**
+ * Push the data into the queue without waiting for the remote server.
+ * @param data, the value for put
+ * @param key_int, key_int to know which server
+ * @return future of bool, true if Push was successful else false.
+ */
+template<typename MappedType, typename Allocator , typename SharedType>
+std::future<bool> queue<MappedType, Allocator , SharedType>::AsyncPush(MappedType &data,
+                                                                  uint16_t &key_int) {
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPush(data));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::queue::AsyncPush(remote)", data,
+                                    key_int);
+        return RPC_CALL_WRAPPER_ASYNC("_Push", key_int, bool, data);
+    }
+}
+
+/**
+ * Get the data from the queue without waiting for the remote server.
+ * @param key_int, key_int to know which server
+ * @return future of a pair of bool and Value, as returned by Pop.
+ */
+template<typename MappedType, typename Allocator , typename SharedType>
+std::future<std::pair<bool, MappedType>>
+queue<MappedType, Allocator , SharedType>::AsyncPop(uint16_t &key_int) {
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPop());
+    } else {
+        AutoTrace trace = AutoTrace("hcl::queue::AsyncPop(remote)",
+                                    key_int);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC1("_Pop", key_int, ret_type);
+    }
+}
+
 template<typename MappedType, typename Allocator , typename SharedType>
 bool queue<MappedType, Allocator , SharedType>::LocalWaitForElement() {
     AutoTrace trace = AutoTrace("hcl::queue::WaitForElement(local)");
@@ -129,7 +164,7 @@ bool queue<MappedType, Allocator , SharedType>::WaitForElement(uint16_t &key_int
 template<typename MappedType, typename Allocator , typename SharedType>
 size_t queue<MappedType, Allocator , SharedType>::LocalSize() {
     AutoTrace trace = AutoTrace("hcl::queue::Size(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    ReadLock lock(*mutex);
     size_t value = my_queue->size();
     return value;
 }
@@ -167,50 +202,9 @@ void queue<MappedType, Allocator , SharedType>::open_shared_memory() {
 template<typename MappedType, typename Allocator , typename SharedType>
 void queue<MappedType, Allocator , SharedType>::bind_functions() {
     /* Create a RPC server and map the methods to it. */
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            std::function<bool(MappedType &)> pushFunc(
-                    std::bind(&hcl::queue<MappedType, Allocator , SharedType>::LocalPush, this,
-                              std::placeholders::_1));
-            std::function<std::pair<bool, MappedType>(void)> popFunc(std::bind(
-                    &hcl::queue<MappedType, Allocator , SharedType>::LocalPop, this));
-            std::function<size_t(void)> sizeFunc(std::bind(
-                    &hcl::queue<MappedType, Allocator , SharedType>::LocalSize, this));
-            std::function<bool(void)> waitForElementFunc(std::bind(
-                    &hcl::queue<MappedType, Allocator , SharedType>::LocalWaitForElement, this));
-            rpc->bind(func_prefix+"_Push", pushFunc);
-            rpc->bind(func_prefix+"_Pop", popFunc);
-            rpc->bind(func_prefix+"_WaitForElement", waitForElementFunc);
-            rpc->bind(func_prefix+"_Size", sizeFunc);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-            case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-            case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-            {
-                    std::function<void(const tl::request &, MappedType &)> pushFunc(
-                        std::bind(&hcl::queue<MappedType, Allocator , SharedType>::ThalliumLocalPush, this,
-                                  std::placeholders::_1, std::placeholders::_2));
-                    std::function<void(const tl::request &)> popFunc(std::bind(
-                        &hcl::queue<MappedType, Allocator , SharedType>::ThalliumLocalPop, this, std::placeholders::_1));
-                    std::function<void(const tl::request &)> sizeFunc(std::bind(
-                        &hcl::queue<MappedType, Allocator , SharedType>::ThalliumLocalSize, this, std::placeholders::_1));
-                    std::function<void(const tl::request &)> waitForElementFunc(std::bind(
-                        &hcl::queue<MappedType, Allocator , SharedType>::ThalliumLocalWaitForElement, this,
-                        std::placeholders::_1));
-                    rpc->bind(func_prefix+"_Push", pushFunc);
-                    rpc->bind(func_prefix+"_Pop", popFunc);
-                    rpc->bind(func_prefix+"_WaitForElement", waitForElementFunc);
-                    rpc->bind(func_prefix+"_Size", sizeFunc);
-                    break;
-                }
-#endif
-    }
+    rpc->bind_method(func_prefix+"_Push", this, &queue::LocalPush);
+    rpc->bind_method(func_prefix+"_Pop", this, &queue::LocalPop);
+    rpc->bind_method(func_prefix+"_WaitForElement", this, &queue::LocalWaitForElement);
+    rpc->bind_method(func_prefix+"_Size", this, &queue::LocalSize);
 }
 // template class queue<int>;
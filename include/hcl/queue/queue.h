@@ -88,17 +88,13 @@ class queue :public container{
     bool LocalWaitForElement();
     size_t LocalSize();
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE(LocalPush, (data), MappedType &data)
-    THALLIUM_DEFINE1(LocalPop)
-    THALLIUM_DEFINE1(LocalWaitForElement)
-    THALLIUM_DEFINE1(LocalSize)
-#endif    
 
     bool Push(MappedType &data, uint16_t &key_int);
     std::pair<bool, MappedType> Pop(uint16_t &key_int);
     bool WaitForElement(uint16_t &key_int);
     size_t Size(uint16_t &key_int);
+    std::future<bool> AsyncPush(MappedType &data, uint16_t &key_int);
+    std::future<std::pair<bool, MappedType>> AsyncPop(uint16_t &key_int);
 };
 
 #include "queue.cpp"
@@ -37,7 +37,6 @@ class global_sequence :public container{
 
   public:
     ~global_sequence() {
-        this->container::~container();
     }
 
     void construct_shared_memory() override {
@@ -51,38 +50,14 @@ class global_sequence :public container{
     }
 
     void bind_functions() override {
-        switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-            case RPCLIB: {
-                std::function<uint64_t(void)> getNextSequence(std::bind(
-                &hcl::global_sequence::LocalGetNextSequence, this));
-                rpc->bind(func_prefix+"_GetNextSequence", getNextSequence);
-                break;
-            }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-                case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-                case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-                {
-                    std::function<void(const tl::request &)> getNextSequence(std::bind(
-                            &hcl::global_sequence::ThalliumLocalGetNextSequence, this,
-                            std::placeholders::_1));
-                    rpc->bind(func_prefix+"_GetNextSequence", getNextSequence);
-                    break;
-                }
-#endif
-        }
+        rpc->bind_method(func_prefix+"_GetNextSequence", this, &global_sequence::LocalGetNextSequence);
     }
 
     global_sequence(CharStruct name_ = "TEST_GLOBAL_SEQUENCE", uint16_t port=HCL_CONF->RPC_PORT)
             : container(name_,port) {
         AutoTrace trace = AutoTrace("hcl::global_sequence");
         if (is_server) {
-            construct_shared_memory();
+            init_shared_memory();
             bind_functions();
         }else if (!is_server && server_on_node) {
             open_shared_memory();
@@ -111,14 +86,10 @@ class global_sequence :public container{
     }
 
     uint64_t LocalGetNextSequence() {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-                lock(*mutex);
+        WriteLock lock(*mutex);
         return ++*value;
     }
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE1(LocalGetNextSequence)
-#endif
 
 };
 
@@ -14,16 +14,24 @@
 #define INCLUDE_HCL_SET_SET_CPP_
 
 /* Constructor to deallocate the shared memory*/
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-set<KeyType, Hash, Compare, Allocator , SharedType>::~set() {
-    this->container::~container();
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::~set() {
+    /* what is queued is sent before the replicator goes */
+    replicator.reset();
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-set<KeyType, Hash, Compare, Allocator , SharedType>::set(CharStruct name_, uint16_t port): container(name_, port), myset() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::set(CharStruct name_, uint16_t port,
+                                                                      ReplicationOptions replication): container(name_, port), partitioner(num_servers), myset(), replicaset() {
     AutoTrace trace = AutoTrace("hcl::set");
+    if (replication.enabled()) {
+        if (!is_server) server_on_node = false;
+        replicator.reset(new Replicator<Change>(
+                [this](uint16_t server, std::vector<Change> &changes) { return SendChanges(server, changes); },
+                replication, my_server));
+    }
     if (is_server) {
-        construct_shared_memory();
+        init_shared_memory();
         bind_functions();
     }else if (!is_server && server_on_node) {
         open_shared_memory();
@@ -36,14 +44,17 @@ set<KeyType, Hash, Compare, Allocator , SharedType>::set(CharStruct name_, uint1
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-bool set<KeyType, Hash, Compare, Allocator , SharedType>::LocalPut(KeyType &key) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalPut(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::set::Put(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mutex);
-    auto value = GetData<Allocator, KeyType, SharedType>(key);
-    myset->insert(value);
-
-    return true;
+    std::vector<std::future<bool>> applied;
+    {
+        WriteLock lock(*mutex);
+        auto &&value = GetData<Allocator, KeyType, SharedType>(key);
+        myset->insert(value);
+        Replicate(key, false, applied);
+    }
+    return wait_applied(applied);
 }
 
 /**
@@ -52,10 +63,10 @@ bool set<KeyType, Hash, Compare, Allocator , SharedType>::LocalPut(KeyType &key)
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-bool set<KeyType, Hash, Compare, Allocator , SharedType>::Put(KeyType &key) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::Put(KeyType &key) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = static_cast<uint16_t>(key_hash % num_servers);
+    uint16_t key_int = partitioner(key_hash);
     if (is_local(key_int)) {
         return LocalPut(key);
     } else {
@@ -70,11 +81,10 @@ bool set<KeyType, Hash, Compare, Allocator , SharedType>::Put(KeyType &key) {
  * @return return a pair of bool and Value. If bool is true then
  * data was found and is present in value part else bool is set to false
  */
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-bool set<KeyType, Hash, Compare, Allocator , SharedType>::LocalGet(KeyType &key) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalGet(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::set::Get(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
+    ReadLock lock(*mutex);
     typename MySet::iterator iterator = myset->find(key);
     if (iterator != myset->end()) {
         return true;
@@ -89,11 +99,17 @@ bool set<KeyType, Hash, Compare, Allocator , SharedType>::LocalGet(KeyType &key)
  * @return return a pair of bool and Value. If bool is true then
  * data was found and is present in value part else bool is set to false
  */
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-bool set<KeyType, Hash, Compare, Allocator , SharedType>::Get(KeyType &key) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::Get(KeyType &key) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = key_hash % num_servers;
-    if (is_local(key_int)) {
+    uint16_t key_int = partitioner(key_hash);
+    uint16_t reader = replicator ? replicator->Reader(partitioner.replicas(key_hash, replicator->Copies())) : key_int;
+    if (reader != key_int) {
+        if (is_local(reader)) return LocalGetReplica(key);
+        AutoTrace trace = AutoTrace("hcl::set::GetReplica(remote)", key);
+        typedef bool ret_type;
+        return RPC_CALL_WRAPPER("_GetReplica", reader, ret_type, key);
+    } else if (is_local(key_int)) {
         return LocalGet(key);
     } else {
         AutoTrace trace = AutoTrace("hcl::set::Get(remote)", key);
@@ -102,20 +118,25 @@ bool set<KeyType, Hash, Compare, Allocator , SharedType>::Get(KeyType &key) {
     }
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-bool set<KeyType, Hash, Compare, Allocator , SharedType>::LocalErase(KeyType &key) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalErase(KeyType &key) {
     AutoTrace trace = AutoTrace("hcl::set::Erase(local)", key);
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mutex);
-    size_t s = myset->erase(key);
-
+    std::vector<std::future<bool>> applied;
+    size_t s;
+    {
+        WriteLock lock(*mutex);
+        s = myset->erase(key);
+        Replicate(key, true, applied);
+    }
+    wait_applied(applied);
     return s > 0;
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
 bool
-set<KeyType, Hash, Compare, Allocator , SharedType>::Erase(KeyType &key) {
+set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::Erase(KeyType &key) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = key_hash % num_servers;
+    uint16_t key_int = partitioner(key_hash);
     if (is_local(key_int)) {
         return LocalErase(key);
     } else {
@@ -125,15 +146,61 @@ set<KeyType, Hash, Compare, Allocator , SharedType>::Erase(KeyType &key) {
     }
 }
 
+/**
+ * Put the data into the set without waiting for the remote server.
+ * @param key, the key for put
+ * @return future of bool, true if Put was successful else false.
+ */
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::future<bool> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::AsyncPut(KeyType &key) {
+    size_t key_hash = keyHash(key);
+    uint16_t key_int = partitioner(key_hash);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPut(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::set::AsyncPut(remote)", key);
+        return RPC_CALL_WRAPPER_ASYNC("_Put", key_int, bool, key);
+    }
+}
+
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::future<bool> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::AsyncGet(KeyType &key) {
+    size_t key_hash = keyHash(key);
+    uint16_t key_int = partitioner(key_hash);
+    uint16_t reader = replicator ? replicator->Reader(partitioner.replicas(key_hash, replicator->Copies())) : key_int;
+    if (reader != key_int) {
+        if (is_local(reader)) return make_ready_future(LocalGetReplica(key));
+        AutoTrace trace = AutoTrace("hcl::set::AsyncGetReplica(remote)", key);
+        return RPC_CALL_WRAPPER_ASYNC("_GetReplica", reader, bool, key);
+    } else if (is_local(key_int)) {
+        return make_ready_future(LocalGet(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::set::AsyncGet(remote)", key);
+        return RPC_CALL_WRAPPER_ASYNC("_Get", key_int, bool, key);
+    }
+}
+
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::future<bool> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::AsyncErase(KeyType &key) {
+    size_t key_hash = keyHash(key);
+    uint16_t key_int = partitioner(key_hash);
+    if (is_local(key_int)) {
+        return make_ready_future(LocalErase(key));
+    } else {
+        AutoTrace trace = AutoTrace("hcl::set::AsyncErase(remote)", key);
+        return RPC_CALL_WRAPPER_ASYNC("_Erase", key_int, bool, key);
+    }
+}
+
 /**
  * Get the data into the set. Uses key to decide the server to hash it to,
  * @param key, key to get
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
 std::vector<KeyType>
-set<KeyType, Hash, Compare, Allocator , SharedType>::Contains(KeyType &key_start, KeyType &key_end) {
+set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::Contains(KeyType &key_start, KeyType &key_end) {
     AutoTrace trace = AutoTrace("hcl::set::Contains", key_start,key_end);
     std::vector<KeyType> final_values = std::vector<KeyType>();
     auto current_server = ContainsInServer(key_start,key_end);
@@ -148,8 +215,8 @@ set<KeyType, Hash, Compare, Allocator , SharedType>::Contains(KeyType &key_start
     return final_values;
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::GetAllData() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::GetAllData() {
     AutoTrace trace = AutoTrace("hcl::set::GetAllData");
     std::vector<KeyType> final_values = std::vector<KeyType>();
     auto current_server = GetAllDataInServer();
@@ -164,12 +231,12 @@ std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::GetAll
     return final_values;
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalContainsInServer(KeyType &key_start, KeyType &key_end) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalContainsInServer(KeyType &key_start, KeyType &key_end) {
     AutoTrace trace = AutoTrace("hcl::set::ContainsInServer", key_start,key_end);
     std::vector<KeyType> final_values = std::vector<KeyType>();
     {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(*mutex);
+        ReadLock lock(*mutex);
         typename MySet::iterator lower_bound;
         size_t size = myset->size();
         if (size == 0) {
@@ -197,9 +264,9 @@ std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalC
     return final_values;
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
 std::vector<KeyType>
-set<KeyType, Hash, Compare, Allocator , SharedType>::ContainsInServer(KeyType &key_start, KeyType &key_end) {
+set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::ContainsInServer(KeyType &key_start, KeyType &key_end) {
     if (is_local()) {
         return LocalContainsInServer(key_start,key_end);
     }
@@ -210,13 +277,12 @@ set<KeyType, Hash, Compare, Allocator , SharedType>::ContainsInServer(KeyType &k
     }
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalGetAllDataInServer() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalGetAllDataInServer() {
     AutoTrace trace = AutoTrace("hcl::set::GetAllDataInServer", NULL);
     std::vector<KeyType> final_values = std::vector<KeyType>();
     {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-                lock(*mutex);
+        ReadLock lock(*mutex);
         typename MySet::iterator lower_bound;
         lower_bound = myset->begin();
         while (lower_bound != myset->end()) {
@@ -227,9 +293,9 @@ std::vector<KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalG
     return final_values;
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
 std::vector<KeyType>
-set<KeyType, Hash, Compare, Allocator , SharedType>::GetAllDataInServer() {
+set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::GetAllDataInServer() {
     if (is_local()) {
         return LocalGetAllDataInServer();
     }
@@ -240,10 +306,10 @@ set<KeyType, Hash, Compare, Allocator , SharedType>::GetAllDataInServer() {
    }
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalSeekFirst() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalSeekFirst() {
     AutoTrace trace = AutoTrace("hcl::set::SeekFirst(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    ReadLock lock(*mutex);
     if (myset->size() > 0) {
         auto iterator = myset->begin();  // We want First (smallest) value in set
         KeyType value = *iterator;
@@ -252,8 +318,8 @@ std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::Lo
     return std::pair<bool, KeyType>(false, KeyType());
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::SeekFirst(uint16_t &key_int) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::SeekFirst(uint16_t &key_int) {
     if (is_local(key_int)) {
         return LocalSeekFirst();
     } else {
@@ -264,10 +330,10 @@ std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::Se
     }
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::pair<bool, std::vector<KeyType>> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalSeekFirstN(uint32_t n){
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, std::vector<KeyType>> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalSeekFirstN(uint32_t n){
     AutoTrace trace = AutoTrace("hcl::set::LocalSeekFirstN(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
+    ReadLock lock(*mutex);
     auto keys = std::vector<KeyType>();
     auto iterator = myset->begin();
     int i=0;
@@ -279,8 +345,8 @@ std::pair<bool, std::vector<KeyType>> set<KeyType, Hash, Compare, Allocator , Sh
     return std::pair<bool, std::vector<KeyType>>(i>0, keys);
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::pair<bool, std::vector<KeyType>> set<KeyType, Hash, Compare, Allocator , SharedType>::SeekFirstN(uint16_t &key_int,uint32_t n){
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, std::vector<KeyType>> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::SeekFirstN(uint16_t &key_int,uint32_t n){
     if (is_local(key_int)) {
         return LocalSeekFirstN(n);
     } else {
@@ -290,21 +356,26 @@ std::pair<bool, std::vector<KeyType>> set<KeyType, Hash, Compare, Allocator , Sh
     }
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::LocalPopFirst() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalPopFirst() {
     AutoTrace trace = AutoTrace("hcl::set::PopFirst(local)");
-    bip::scoped_lock<bip::interprocess_mutex> lock(*mutex);
-    if (myset->size() > 0) {
-        auto iterator = myset->begin();  // We want First (smallest) value in set
-        KeyType value = *iterator;
-        myset->erase(iterator);
-        return std::pair<bool, KeyType>(true, value);
+    std::vector<std::future<bool>> applied;
+    std::pair<bool, KeyType> result(false, KeyType());
+    {
+        WriteLock lock(*mutex);
+        if (myset->size() > 0) {
+            auto iterator = myset->begin();  // We want First (smallest) value in set
+            result = std::pair<bool, KeyType>(true, *iterator);
+            myset->erase(iterator);
+            Replicate(result.second, true, applied);
+        }
     }
-    return std::pair<bool, KeyType>(false, KeyType());
+    wait_applied(applied);
+    return result;
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::PopFirst(uint16_t &key_int) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::PopFirst(uint16_t &key_int) {
     if (is_local(key_int)) {
         return LocalPopFirst();
     } else {
@@ -315,14 +386,14 @@ std::pair<bool, KeyType> set<KeyType, Hash, Compare, Allocator , SharedType>::Po
     }
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-size_t set<KeyType, Hash, Compare, Allocator , SharedType>::LocalSize() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+size_t set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalSize() {
     AutoTrace trace = AutoTrace("hcl::set::Size(local)");
     return myset->size();
 }
 
-template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType>
-size_t set<KeyType, Hash, Compare, Allocator , SharedType>::Size(uint16_t &key_int) {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+size_t set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::Size(uint16_t &key_int) {
     if (is_local(key_int)) {
         return LocalSize();
     } else {
@@ -332,119 +403,74 @@ size_t set<KeyType, Hash, Compare, Allocator , SharedType>::Size(uint16_t &key_i
     }
 }
 
-template<typename KeyType, typename Hash, typename Compare, typename Allocator ,typename SharedType>
-void set<KeyType, Hash, Compare, Allocator , SharedType>::construct_shared_memory() {
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::SendChanges(uint16_t server, std::vector<Change> &changes) {
+    AutoTrace trace = AutoTrace("hcl::set::Apply(remote)", server, changes.size());
+    std::vector<KeyType> keys, erased;
+    for (auto &change : changes) (change.erased ? erased : keys).push_back(change.key);
+    bool stored = RPC_CALL_WRAPPER("_Apply", server, bool, keys, erased);
+    return stored;
+}
+
+/**
+ * Apply changes a primary made to keys this server keeps copies of.
+ * @param keys, the inserted keys
+ * @param erased, the erased keys
+ * @return bool, true once all are applied.
+ */
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalApply(std::vector<KeyType> &keys, std::vector<KeyType> &erased) {
+    AutoTrace trace = AutoTrace("hcl::set::Apply(local)", keys.size(), erased.size());
+    WriteLock lock(*mutex);
+    for (auto &key : keys) {
+        auto &&value = GetData<Allocator, KeyType, SharedType>(key);
+        replicaset->insert(value);
+    }
+    for (auto &key : erased) replicaset->erase(key);
+    return true;
+}
+
+/* Whether the copies this server keeps as a backup hold key. */
+template<typename KeyType,  typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+bool set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::LocalGetReplica(KeyType &key) {
+    AutoTrace trace = AutoTrace("hcl::set::GetReplica(local)", key);
+    ReadLock lock(*mutex);
+    return replicaset->find(key) != replicaset->end();
+}
+
+template<typename KeyType, typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+void set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::construct_shared_memory() {
     ShmemAllocator alloc_inst(segment.get_segment_manager());
     /* Construct set in the shared memory space. */
     myset = segment.construct<MySet>(name.c_str())(Compare(), alloc_inst);
+    if (replicator) replicaset = segment.construct<MySet>((name.string() + "_replica").c_str())(Compare(), alloc_inst);
 }
 
-template<typename KeyType, typename Hash, typename Compare, typename Allocator ,typename SharedType>
-void set<KeyType, Hash, Compare, Allocator , SharedType>::open_shared_memory() {
+template<typename KeyType, typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+void set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::open_shared_memory() {
     std::pair<MySet*,
             boost::interprocess::managed_mapped_file::size_type> res;
     res = segment.find<MySet> (name.c_str());
     myset = res.first;
+    if (replicator) replicaset = segment.find<MySet>((name.string() + "_replica").c_str()).first;
 }
 
-template<typename KeyType, typename Hash, typename Compare, typename Allocator ,typename SharedType>
-void set<KeyType, Hash, Compare, Allocator , SharedType>::bind_functions() {
+template<typename KeyType, typename Hash, typename Compare, typename Allocator ,typename SharedType, typename Partitioner>
+void set<KeyType, Hash, Compare, Allocator , SharedType, Partitioner>::bind_functions() {
     /* Create a RPC server and map the methods to it. */
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            std::function<bool(KeyType &)> putFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalPut, this,
-                              std::placeholders::_1));
-            std::function<bool(KeyType &)> getFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalGet, this,
-                              std::placeholders::_1));
-            std::function<bool(KeyType &)> eraseFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalErase, this,
-                              std::placeholders::_1));
-            std::function<std::vector<KeyType>(void)>
-                    getAllDataInServerFunc(std::bind(
-                    &set<KeyType, Hash, Compare, Allocator , SharedType>::LocalGetAllDataInServer,
-                    this));
-            std::function<std::vector<KeyType>(KeyType &, KeyType &)>
-                    containsInServerFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalContainsInServer, this,
-                                                   std::placeholders::_1,
-                                                   std::placeholders::_2));
-            std::function<std::pair<bool, KeyType>(void)>
-                    seekFirstFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalSeekFirst, this));
-            std::function<std::pair<bool, KeyType>(void)>
-                    popFirstFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalPopFirst, this));
-            std::function<size_t(void)>
-                    sizeFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalSize, this));
-            std::function<std::pair<bool, std::vector<KeyType>>(uint32_t)> localSeekFirstNFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::LocalSeekFirstN, this,
-                              std::placeholders::_1));
-            rpc->bind(func_prefix+"_Put", putFunc);
-            rpc->bind(func_prefix+"_Get", getFunc);
-            rpc->bind(func_prefix+"_Erase", eraseFunc);
-            rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-            rpc->bind(func_prefix+"_Contains", containsInServerFunc);
-
-            rpc->bind(func_prefix+"_SeekFirst", seekFirstFunc);
-            rpc->bind(func_prefix+"_PopFirst", popFirstFunc);
-            rpc->bind(func_prefix+"_SeekFirstN", localSeekFirstNFunc);
-            rpc->bind(func_prefix+"_Size", sizeFunc);
-            break;
-        }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-            case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-            case THALLIUM_ROCE:
-#endif
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-            {
-
-                std::function<void(const tl::request &, KeyType &)> putFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalPut, this,
-                              std::placeholders::_1, std::placeholders::_2));
-                std::function<void(const tl::request &, KeyType &)> getFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalGet, this,
-                              std::placeholders::_1, std::placeholders::_2));
-                std::function<void(const tl::request &, KeyType &)> eraseFunc(
-                    std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalErase, this,
-                              std::placeholders::_1, std::placeholders::_2));
-                std::function<void(const tl::request &)>
-                        getAllDataInServerFunc(std::bind(
-                            &set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalGetAllDataInServer,
-                            this, std::placeholders::_1));
-                std::function<void(const tl::request &, KeyType &, KeyType &)>
-                        containsInServerFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalContainsInServer, this,
-                                                       std::placeholders::_1,
-                                                       std::placeholders::_2,
-						       std::placeholders::_3));
-                std::function<void(const tl::request &)>
-                        seekFirstFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalSeekFirst, this,
-						std::placeholders::_1));
-                std::function<void(const tl::request &)>
-                        popFirstFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalPopFirst, this,
-					       std::placeholders::_1));
-                std::function<void(const tl::request &)>
-                        sizeFunc(std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalSize, this,
-					   std::placeholders::_1));
-                std::function<void(const tl::request &, uint32_t)> localSeekFirstNFunc(
-                        std::bind(&set<KeyType, Hash, Compare, Allocator , SharedType>::ThalliumLocalSeekFirstN, this,
-				  std::placeholders::_1,
-				  std::placeholders::_2));
-                rpc->bind(func_prefix+"_Put", putFunc);
-                rpc->bind(func_prefix+"_Get", getFunc);
-                rpc->bind(func_prefix+"_Erase", eraseFunc);
-                rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-                rpc->bind(func_prefix+"_Contains", containsInServerFunc);
-
-                rpc->bind(func_prefix+"_SeekFirst", seekFirstFunc);
-                rpc->bind(func_prefix+"_PopFirst", popFirstFunc);
-                // rpc->bind(func_prefix+"_SeekFirstN", localSeekFirstNFunc);
-                rpc->bind(func_prefix+"_Size", sizeFunc);
-		break;
-                }
-#endif
+    rpc->bind_method(func_prefix+"_Put", this, &set::LocalPut);
+    rpc->bind_method(func_prefix+"_Get", this, &set::LocalGet);
+    rpc->bind_method(func_prefix+"_Erase", this, &set::LocalErase);
+    rpc->bind_method(func_prefix+"_GetAllData", this, &set::LocalGetAllDataInServer);
+    rpc->bind_method(func_prefix+"_Contains", this, &set::LocalContainsInServer);
+
+    rpc->bind_method(func_prefix+"_SeekFirst", this, &set::LocalSeekFirst);
+    rpc->bind_method(func_prefix+"_PopFirst", this, &set::LocalPopFirst);
+    rpc->bind_method(func_prefix+"_SeekFirstN", this, &set::LocalSeekFirstN);
+    rpc->bind_method(func_prefix+"_Size", this, &set::LocalSize);
+    if (replicator) {
+        rpc->bind_method(func_prefix+"_Apply", this, &set::LocalApply);
+        rpc->bind_method(func_prefix+"_GetReplica", this, &set::LocalGetReplica);
     }
 }
 
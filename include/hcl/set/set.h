@@ -51,6 +51,8 @@
 #include <vector>
 #include <boost/interprocess/managed_mapped_file.hpp>
 #include <hcl/common/container.h>
+#include <hcl/common/partitioner.h>
+#include <hcl/common/replicator.h>
 
 namespace hcl {
 /**
@@ -58,11 +60,14 @@ namespace hcl {
  * achieve the data structure.
  *
  * @tparam MappedType, the value of the Set
+ * @tparam Partitioner, maps the hash of a key to its server (see partitioner.h)
  */
 
 template<typename KeyType, typename Hash = std::hash<KeyType>, typename Compare =
-         std::less<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t>
+         std::less<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t,
+         typename Partitioner = ring_partitioner>
 class set :public container {
+    static_assert(!Partitioner::ordered, "hcl::set requires a hash partitioner, range partitioning is for hcl::map");
   private:
     /** Class Typedefs for ease of use **/
     typedef boost::interprocess::allocator<KeyType, boost::interprocess::managed_mapped_file::segment_manager>
@@ -71,7 +76,25 @@ class set :public container {
     MySet;
     /** Class attributes**/
     Hash keyHash;
+    Partitioner partitioner;
     MySet *myset;
+    /*
+     * With a replication factor above 1, the servers following the primary
+     * of a key on the ring keep copies of it in replicaset. Only servers queue
+     * changes, so clients on their node use RPC.
+     */
+    struct Change {
+        KeyType key;
+        bool erased;
+    };
+    MySet *replicaset;
+    std::unique_ptr<Replicator<Change>> replicator;
+    /* Queue the insert or the erase of key for the backups; the set lock is held. */
+    void Replicate(const KeyType &key, bool erased, std::vector<std::future<bool>> &applied) {
+        if (!replicator) return;
+        replicator->Push(partitioner.replicas(keyHash(key), replicator->Copies()), Change{key, erased}, applied);
+    }
+    bool SendChanges(uint16_t server, std::vector<Change> &changes);
 
   public:
     ~set();
@@ -86,7 +109,8 @@ class set :public container {
         if(server_on_node || is_server) return myset;
         else nullptr;
     }
-    explicit set(CharStruct name_ = "TEST_SET", uint16_t port=HCL_CONF->RPC_PORT);
+    explicit set(CharStruct name_ = "TEST_SET", uint16_t port=HCL_CONF->RPC_PORT,
+                 ReplicationOptions replication = ReplicationOptions());
 
     bool LocalPut(KeyType &key);
     bool LocalGet(KeyType &key);
@@ -97,26 +121,18 @@ class set :public container {
     std::pair<bool, KeyType> LocalPopFirst();
     size_t LocalSize();
     std::pair<bool, std::vector<KeyType>> LocalSeekFirstN(uint32_t n);
+    bool LocalApply(std::vector<KeyType> &keys, std::vector<KeyType> &erased);
+    bool LocalGetReplica(KeyType &key);
 
 
-#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE(LocalPut, (key), KeyType &key)
-    THALLIUM_DEFINE(LocalGet, (key), KeyType &key)
-    THALLIUM_DEFINE(LocalErase, (key), KeyType &key)
-    THALLIUM_DEFINE(LocalContainsInServer, (key_start, key_end), KeyType &key_start,
-		    KeyType &key_end)
-    THALLIUM_DEFINE(LocalSeekFirstN, (n), uint32_t n)
-
-    THALLIUM_DEFINE1(LocalSize)
-    THALLIUM_DEFINE1(LocalSeekFirst)
-    THALLIUM_DEFINE1(LocalPopFirst)
-    THALLIUM_DEFINE1(LocalGetAllDataInServer)
-#endif
     
     bool Put(KeyType &key);
     bool Get(KeyType &key);
 
     bool Erase(KeyType &key);
+    std::future<bool> AsyncPut(KeyType &key);
+    std::future<bool> AsyncGet(KeyType &key);
+    std::future<bool> AsyncErase(KeyType &key);
     std::vector<KeyType> Contains(KeyType &key_start,KeyType &key_end);
 
     std::vector<KeyType> GetAllData();
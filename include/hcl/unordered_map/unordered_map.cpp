@@ -16,22 +16,54 @@
 #include <boost/interprocess/file_mapping.hpp>
 
 /* Constructor to deallocate the shared memory*/
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::~unordered_map() {
-    this->container::~container();
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::~unordered_map() {
+    migration_cancelled = true;
+    if (migration.valid()) migration.wait();
+    /* the sweeps queue changes too; what is queued is sent before the replicator goes */
+    StopMaintenance();
+    replicator.reset();
 }
 
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::unordered_map(CharStruct name_, uint16_t port)
-        : container(name_,port), myHashMap(), size_occupied(0){
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::unordered_map(CharStruct name_, uint16_t port,
+                                                                          ReplicationOptions replication)
+        : container(name_,port), partitioner(num_servers), num_shards(std::max<uint16_t>(HCL_CONF->UNORDERED_MAP_SHARDS, 1)), myHashMap(),
+          shard_mutexes(), shard_states(), usage(), bulk_transfer_threshold(HCL_CONF->BULK_TRANSFER_THRESHOLD),
+          dynamic(HCL_CONF->DYN_CONFIG), members(all_servers(num_servers)), membership_epoch(0), next_epoch(0),
+          migration_cancelled(false), table_sets(replication.enabled() ? 2 : 1), size_occupied(0){
     // init my_server, num_servers, server_on_node, processor_name from RPC
     AutoTrace trace = AutoTrace("hcl::unordered_map");
+    guarded = true;
+    if (dynamic && !Partitioner::consistent)
+        throw std::invalid_argument("hcl: DYN_CONFIG needs a consistent partitioner such as ring_partitioner");
+    /* only the server knows which of its keys already moved, so clients on its node use RPC as well */
+    if (dynamic && !is_server) server_on_node = false;
+    if (replication.enabled()) {
+        if (dynamic) throw std::invalid_argument("hcl: REPLICATION_FACTOR needs fixed servers, without DYN_CONFIG");
+        if (!is_server) server_on_node = false;
+        replicator.reset(new Replicator<Change>(
+                [this](uint16_t server, std::vector<Change> &changes) { return SendChanges(server, changes); },
+                replication, my_server));
+    }
     if (is_server) {
-        construct_shared_memory();
+        init_shared_memory();
         bind_functions();
+        if (HCL_CONF->TTL_SWEEP_INTERVAL_MS != 0) {
+            sweep_hands.assign(num_shards * table_sets, 0);
+            StartMaintenance(std::chrono::milliseconds(HCL_CONF->TTL_SWEEP_INTERVAL_MS), [this]() { SweepExpired(); });
+        }
     }else if (!is_server && server_on_node) {
         open_shared_memory();
     }
+    if (dynamic && !is_server) {
+        RefreshMembership();
+        if (HCL_CONF->MEMBERSHIP_REFRESH_MS != 0)
+            StartMaintenance(std::chrono::milliseconds(HCL_CONF->MEMBERSHIP_REFRESH_MS), [this]() { RefreshMembership(); });
+    }
+    if (HCL_CONF->CLIENT_CACHE_LEASE_MS != 0)
+        lease_cache.reset(new LeaseCache<KeyType, MappedType, Hash>(
+                std::chrono::milliseconds(HCL_CONF->CLIENT_CACHE_LEASE_MS), HCL_CONF->CLIENT_CACHE_ENTRIES));
 }
 
 /**
@@ -40,31 +72,244 @@ unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::unordered_map(C
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
-bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalPut(KeyType &key,
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalPut(KeyType &key,
                                                   MappedType &data) {
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>lock(*mutex);
-    auto value = GetData<Allocator, MappedType, SharedType>(data);
-    auto iter = myHashMap->insert_or_assign(key, value);
-    if(iter.second) size_occupied += CalculateSize<KeyType>().GetSize(key) + CalculateSize<MappedType>().GetSize(data);
+    uint16_t owner = my_server;
+    std::vector<std::future<bool>> applied;
+    bool result = WithSegment([&]() {
+        applied.clear();
+        uint16_t shard = get_shard(key);
+        WriteLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return false;
+        auto iterator = InsertEntry(shard, key, data);
+        Replicate(key, &iterator->second, applied);
+        return true;
+    }, true);
+    if (owner == my_server) return wait_applied(applied) && result;
+    return RPC_CALL_WRAPPER("_Put", owner, bool, key, data);
+}
+
+/**
+ * Put the data into the local unordered map for a limited time.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @param ttl_ms, milliseconds until the entry expires, 0 for never
+ * @return bool, true if Put was successful else false.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalPutWithTTL(KeyType &key, MappedType &data, really_long ttl_ms) {
+    uint16_t owner = my_server;
+    std::vector<std::future<bool>> applied;
+    bool result = WithSegment([&]() {
+        applied.clear();
+        uint16_t shard = get_shard(key);
+        WriteLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return false;
+        auto iterator = InsertEntry(shard, key, data, expiry_time(ttl_ms));
+        Replicate(key, &iterator->second, applied);
+        return true;
+    }, true);
+    if (owner == my_server) return wait_applied(applied) && result;
+    return RPC_CALL_WRAPPER("_PutWithTTL", owner, bool, key, data, ttl_ms);
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+typename unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::MyHashMap::iterator
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::InsertEntry(uint16_t shard, KeyType &key, MappedType &data,
+                                                                      really_long expires_at) {
+    /* the shard lock is held exclusively */
+    ShardState &state = shard_states[shard];
+    really_long size = CalculateSize<KeyType>().GetSize(key) + CalculateSize<MappedType>().GetSize(data);
+    auto &&value = GetData<Allocator, MappedType, SharedType>(data);
+    auto iter = myHashMap[shard].find(key);
+    if (iter == myHashMap[shard].end()) {
+        iter = myHashMap[shard].try_emplace(key, value, 0, expires_at, ++state.writes).first;
+        state.entries++;
+        state.bytes += size;
+        size_occupied += size;
+        if (shard < num_shards) {
+            usage->entries++;
+            usage->bytes += size;
+        }
+    } else {
+        really_long old_size = CalculateSize<KeyType>().GetSize(key) + CalculateSize<MappedType>().GetSize(iter->second.value);
+        state.bytes += size - old_size;
+        size_occupied += size - old_size;
+        if (shard < num_shards) usage->bytes += size - old_size;
+        iter->second.value = value;
+        iter->second.expires_at = expires_at;
+        iter->second.version = ++state.writes;
+    }
+    Touch(shard, iter->second);
+    /* copies follow the evictions of their primary instead */
+    if (state.bounded() && shard < num_shards) Evict(shard, key);
+    return iter;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::RemoveEntry(uint16_t shard, typename MyHashMap::iterator iterator) {
+    really_long size = CalculateSize<KeyType>().GetSize(iterator->first) + CalculateSize<MappedType>().GetSize(iterator->second.value);
+    shard_states[shard].entries--;
+    shard_states[shard].bytes -= size;
+    size_occupied -= size;
+    if (shard < num_shards) {
+        usage->entries--;
+        usage->bytes -= size;
+    }
+    myHashMap[shard].erase(iterator);
+}
+
+/* Erase key from a shard whose lock is held exclusively; returns false if it was missing or expired. */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::EraseEntry(uint16_t shard, const KeyType &key) {
+    auto iterator = myHashMap[shard].find(key);
+    if (iterator == myHashMap[shard].end()) return false;
+    bool live = !is_expired(iterator->second.expires_at);
+    RemoveEntry(shard, iterator);
+    return live;
+}
+
+/**
+ * Reclaim expired entries in the next TTL_SWEEP_BATCH buckets of each shard.
+ * Runs on the maintenance thread of servers; expired entries are invisible
+ * before already.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::SweepExpired() {
+    size_t batch = HCL_CONF->TTL_SWEEP_BATCH;
+    std::vector<std::future<bool>> applied;
+    for (uint16_t shard = 0; shard < num_shards * table_sets; ++shard) {
+        WithSegment([&]() {
+            WriteLock lock(shard_mutexes[shard]);
+            MyHashMap &table = myHashMap[shard];
+            size_t buckets = table.bucket_count();
+            really_long now = now_ms();
+            std::vector<KeyType> expired;
+            for (size_t visited = 0; visited < std::min(batch, buckets); ++visited) {
+                size_t bucket = sweep_hands[shard]++ % buckets;
+                for (auto iter = table.begin(bucket); iter != table.end(bucket); ++iter)
+                    if (iter->second.expires_at != 0 && iter->second.expires_at <= now) expired.push_back(iter->first);
+            }
+            for (auto &key : expired) {
+                RemoveEntry(shard, table.find(key));
+                if (shard < num_shards) Replicate(key, nullptr, applied);
+            }
+            return true;
+        }, true);
+    }
+}
+
+/**
+ * Evict entries until the server is within its bounds again, from shard,
+ * whose lock is held exclusively, or once shard holds nothing but keep, from
+ * other shards whose lock is free.
+ * @param shard, the shard written to
+ * @param keep, the key just written, which is never evicted
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Evict(uint16_t shard, const KeyType &keep) {
+    ShardState &state = shard_states[shard];
+    auto over = [&state, this]() {
+        return (state.capacity_entries != 0 && usage->entries.load() > state.capacity_entries) ||
+               (state.capacity_bytes != 0 && usage->bytes.load() > state.capacity_bytes);
+    };
+    while (over()) {
+        if (EvictOne(shard, keep)) continue;
+        bool evicted = false;
+        for (uint16_t next = 1; next < num_shards && !evicted; ++next) {
+            uint16_t other = (shard + next) % num_shards;
+            /* waiting could deadlock with a writer of other evicting from shard */
+            WriteLock lock(shard_mutexes[other], boost::interprocess::try_to_lock);
+            if (lock.owns()) evicted = EvictOne(other, keep);
+        }
+        if (!evicted) break;
+    }
+}
+
+/**
+ * Evict one entry of a shard whose lock is held exclusively. EVICT_LRU
+ * removes the least recently used of lru_samples entries following the hand,
+ * EVICT_CLOCK the first entry the hand finds unreferenced since its last pass.
+ * @param shard, the shard to evict from
+ * @param keep, the key just written, which is never evicted
+ * @return bool, false if the shard has no entry but keep.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::EvictOne(uint16_t shard, const KeyType &keep) {
+    ShardState &state = shard_states[shard];
+    MyHashMap &table = myHashMap[shard];
+    size_t buckets = table.bucket_count();
+    typename MyHashMap::local_iterator victim;
+    bool found = false;
+    size_t sampled = 0;
+    /* the first pass of CLOCK clears every reference bit, so two passes find a victim */
+    for (size_t visited = 0; visited < 2 * buckets && state.entries != 0; ++visited) {
+        size_t bucket = state.hand++ % buckets;
+        for (auto iter = table.begin(bucket); iter != table.end(bucket); ++iter) {
+            if (iter->first == keep) continue;
+            if (state.policy == EVICT_CLOCK) {
+                if (iter->second.last_access.exchange(0, std::memory_order_relaxed) != 0) continue;
+                victim = iter;
+                found = true;
+                break;
+            }
+            if (!found || iter->second.last_access.load(std::memory_order_relaxed) <
+                          victim->second.last_access.load(std::memory_order_relaxed)) {
+                victim = iter;
+                found = true;
+            }
+            ++sampled;
+        }
+        if (found && (state.policy == EVICT_CLOCK || sampled >= lru_samples)) break;
+    }
+    if (!found) return false;
+    KeyType victim_key = victim->first;
+    RemoveEntry(shard, table.find(victim_key));
+    state.evictions.fetch_add(1, std::memory_order_relaxed);
+    std::vector<std::future<bool>> applied;
+    Replicate(victim_key, nullptr, applied);
     return true;
 }
+
 /**
  * Put the data into the unordered map. Uses key to decide the server to hash it to,
  * @param key, the key for put
  * @param data, the value for put
  * @return bool, true if Put was successful else false.
  */
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
-bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::Put(KeyType key,
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Put(KeyType key,
                                              MappedType data) {
-    uint16_t key_int = (uint16_t)keyHash(key)% num_servers;
-    if (is_local(key_int)) {
-        return LocalPut(key, data);
-    } else {
-        return RPC_CALL_WRAPPER("_Put", key_int, bool,
-                                key, data);
-    }
+    return Routed(keyHash(key), [&](uint16_t key_int) {
+        if (is_local(key_int)) {
+            return LocalPut(key, data);
+        } else {
+            ForgetLease(key);
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+            if (use_bulk_transfer()) {
+                tl::bulk bulk_handle = rpc->expose_bulk(key_int, &data, sizeof(MappedType), tl::bulk_mode::read_only);
+                return rpc->call<tl::packed_response>(key_int, func_prefix+"_PutBulk", key, bulk_handle).template as<bool>();
+            }
+#endif
+            return RPC_CALL_WRAPPER("_Put", key_int, bool,
+                                    key, data);
+        }
+    });
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Put(KeyType key, MappedType data,
+                                             std::chrono::milliseconds ttl) {
+    really_long ttl_ms = ttl.count();
+    return Routed(keyHash(key), [&](uint16_t key_int) {
+        if (is_local(key_int)) {
+            return LocalPutWithTTL(key, data, ttl_ms);
+        } else {
+            ForgetLease(key);
+            return RPC_CALL_WRAPPER("_PutWithTTL", key_int, bool, key, data, ttl_ms);
+        }
+    });
 }
 
 
@@ -74,17 +319,119 @@ bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::Put(KeyTyp
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalGet(KeyType &key) {
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
-    typename MyHashMap::iterator iterator = myHashMap->find(key);
-    if (iterator != myHashMap->end()) {
-        return std::pair<bool, MappedType>(true, iterator->second);
-    } else {
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGet(KeyType &key) {
+    typedef std::pair<bool, MappedType> ret_type;
+    uint16_t owner = my_server;
+    ret_type result = WithSegment([&]() {
+        uint16_t shard = get_shard(key);
+        ReadLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return ret_type(false, MappedType());
+        typename MyHashMap::iterator iterator = FindLive(shard, key);
+        if (iterator != myHashMap[shard].end()) {
+            Touch(shard, iterator->second);
+            return ret_type(true, iterator->second.value);
+        } else {
+            return ret_type(false, MappedType());
+        }
+    });
+    if (owner == my_server) return result;
+    return RPC_CALL_WRAPPER("_Get", owner, ret_type, key);
+}
+
+/**
+ * Read a value of the local unordered map in place.
+ * @param key, key to get
+ * @param visitor, called with the stored value if the key is found
+ * @return bool, true if the key was found and visitor ran.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Visitor>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetView(KeyType &key, Visitor &&visitor) {
+    uint16_t owner = my_server;
+    bool found = WithSegment([&]() {
+        uint16_t shard = get_shard(key);
+        ReadLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return false;
+        typename MyHashMap::iterator iterator = FindLive(shard, key);
+        if (iterator == myHashMap[shard].end()) return false;
+        Touch(shard, iterator->second);
+        const MappedType &value = iterator->second.value;
+        visitor(value);
+        return true;
+    });
+    if (owner == my_server) return found;
+    /* the key moved: visit a copy, as clients on other nodes do */
+    typedef std::pair<bool, MappedType> ret_type;
+    ret_type result = RPC_CALL_WRAPPER("_Get", owner, ret_type, key);
+    if (result.first) visitor(static_cast<const MappedType &>(result.second));
+    return result.first;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Visitor>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetView(KeyType &key, Visitor &&visitor) {
+    uint16_t key_int = route(keyHash(key));
+    if (is_local(key_int)) return LocalGetView(key, std::forward<Visitor>(visitor));
+    auto result = Get(key);
+    if (result.first) visitor(static_cast<const MappedType &>(result.second));
+    return result.first;
+}
+
+/**
+ * Get the data in the local unordered map for the lease cache of a client.
+ * @param key, key to get
+ * @param known_version, version of the value the client has, 0 for none
+ * @return return a pair of the version and the value, version 0 if the key
+ * was not found. The value is left out if the version is known_version.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<uint64_t, MappedType>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetLeased(KeyType &key, uint64_t known_version) {
+    typedef std::pair<uint64_t, MappedType> ret_type;
+    uint16_t owner = my_server;
+    ret_type result = WithSegment([&]() {
+        uint16_t shard = get_shard(key);
+        ReadLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return ret_type(0, MappedType());
+        typename MyHashMap::iterator iterator = FindLive(shard, key);
+        if (iterator == myHashMap[shard].end()) return ret_type(0, MappedType());
+        Touch(shard, iterator->second);
+        if (iterator->second.version == known_version)
+            return ret_type(known_version, MappedType());
+        return ret_type(iterator->second.version, iterator->second.value);
+    });
+    if (owner == my_server) return result;
+    return RPC_CALL_WRAPPER("_GetLeased", owner, ret_type, key, known_version);
+}
+
+/**
+ * Get the data of a remote server through the lease cache.
+ * @param key, key to get
+ * @param key_int, the server of key
+ * @return return a pair of bool and Value, as returned by Get.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, MappedType>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetLeased(KeyType &key, uint16_t key_int) {
+    typedef std::pair<uint64_t, MappedType> ret_type;
+    auto requested = LeaseCache<KeyType, MappedType, Hash>::clock::now();
+    MappedType cached = MappedType();
+    uint64_t version = 0;
+    auto state = lease_cache->Lookup(key, cached, version, requested);
+    if (state == LeaseCache<KeyType, MappedType, Hash>::VALID) return std::pair<bool, MappedType>(true, cached);
+    ret_type result = RPC_CALL_WRAPPER("_GetLeased", key_int, ret_type, key, version);
+    if (result.first == 0) {
+        lease_cache->Forget(key);
         return std::pair<bool, MappedType>(false, MappedType());
     }
+    if (result.first == version) {
+        lease_cache->Renew(key, version, requested);
+        return std::pair<bool, MappedType>(true, cached);
+    }
+    lease_cache->Store(key, result.second, result.first, requested);
+    return std::pair<bool, MappedType>(true, result.second);
 }
 
 /**
@@ -93,62 +440,426 @@ unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalGet(KeyTyp
  * @return return a pair of bool and Value. If bool is true then data was
  * found and is present in value part else bool is set to false
  */
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::Get(KeyType &key) {
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Get(KeyType &key) {
+    typedef std::pair<bool, MappedType> ret_type;
     size_t key_hash = keyHash(key);
-    uint16_t key_int = static_cast<uint16_t>(key_hash % num_servers);
-    if (is_local(key_int)) {
-        return LocalGet(key);
-    } else {
+    return Routed(key_hash, [&](uint16_t key_int) {
+        uint16_t reader = ReadServer(key_hash, key_int);
+        if (reader != key_int) {
+            return GetReplica(key, reader);
+        } else if (is_local(key_int)) {
+            return LocalGet(key);
+        } else if (lease_cache) {
+            return GetLeased(key, key_int);
+        } else {
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+            if (use_bulk_transfer()) {
+                ret_type result(false, MappedType());
+                tl::bulk bulk_handle = rpc->expose_bulk(key_int, &result.second, sizeof(MappedType), tl::bulk_mode::write_only);
+                result.first = rpc->call<tl::packed_response>(key_int, func_prefix+"_GetBulk", key, bulk_handle).template as<bool>();
+                return result;
+            }
+#endif
+           return RPC_CALL_WRAPPER("_Get", key_int, ret_type,key);
+        }
+    });
+}
+
+#if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
+/**
+ * Put a value exposed by the client into the local unordered map. The value
+ * is pulled with a bulk transfer before taking the lock: the process-shared
+ * mutex would otherwise block the whole Argobots stream while the handler
+ * waits on the network.
+ * @param thallium_req, the request of the client exposing the value
+ * @param key, the key for put
+ * @param bulk_handle, the read only handle of the value on the client
+ * @return bool, true if Put was successful else false.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalPutBulk(const tl::request &thallium_req, KeyType &key,
+                                                       tl::bulk &bulk_handle) {
+    /* heap allocated since handlers run on small user level thread stacks */
+    std::unique_ptr<MappedType> data(new MappedType());
+    if (rpc->pull_bulk(thallium_req, bulk_handle, data.get(), sizeof(MappedType)) != sizeof(MappedType)) return false;
+    return LocalPut(key, *data);
+}
+
+/**
+ * Get a value from the local unordered map into a buffer exposed by the
+ * client. The value is copied out under the lock and pushed after releasing it.
+ * @param thallium_req, the request of the client exposing the buffer
+ * @param key, key to get
+ * @param bulk_handle, the write only handle of the buffer on the client
+ * @return bool, true if the data was found and transferred else false.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetBulk(const tl::request &thallium_req, KeyType &key,
+                                                       tl::bulk &bulk_handle) {
+    std::unique_ptr<MappedType> data(new MappedType());
+    uint16_t owner = my_server;
+    bool found = WithSegment([&]() {
+        uint16_t shard = get_shard(key);
+        ReadLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return false;
+        typename MyHashMap::iterator iterator = FindLive(shard, key);
+        if (iterator == myHashMap[shard].end()) return false;
+        Touch(shard, iterator->second);
+        *data = iterator->second.value;
+        return true;
+    });
+    if (owner != my_server) {
         typedef std::pair<bool, MappedType> ret_type;
-       return RPC_CALL_WRAPPER("_Get", key_int, ret_type,key);
+        ret_type result = RPC_CALL_WRAPPER("_Get", owner, ret_type, key);
+        found = result.first;
+        *data = result.second;
     }
+    if (!found) return false;
+    return rpc->push_bulk(thallium_req, bulk_handle, data.get(), sizeof(MappedType)) == sizeof(MappedType);
 }
+#endif
 
 
 
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalErase(KeyType &key) {
-    boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-            lock(*mutex);
-    typename MyHashMap::iterator iterator = myHashMap->find(key);
-    if (iterator != myHashMap->end()) {
-        size_occupied -= CalculateSize<KeyType>().GetSize(key) + CalculateSize<MappedType>().GetSize(iterator->second);
-        myHashMap->erase(iterator);
-        return std::pair<bool, MappedType>(true, MappedType());
-    }else return std::pair<bool, MappedType>(false, MappedType());
-}
-
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalErase(KeyType &key) {
+    typedef std::pair<bool, MappedType> ret_type;
+    uint16_t owner = my_server;
+    std::vector<std::future<bool>> applied;
+    ret_type result = WithSegment([&]() {
+        applied.clear();
+        uint16_t shard = get_shard(key);
+        WriteLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return ret_type(false, MappedType());
+        bool erased = EraseEntry(shard, key);
+        Replicate(key, nullptr, applied);
+        return ret_type(erased, MappedType());
+    }, true);
+    if (owner == my_server) {
+        /* erased tells whether the key was there, the backups only whether the erase reached them */
+        wait_applied(applied);
+        return result;
+    }
+    return RPC_CALL_WRAPPER("_Erase", owner, ret_type, key);
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::pair<bool, MappedType>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::Erase(KeyType &key) {
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Erase(KeyType &key) {
+    typedef std::pair<bool, MappedType> ret_type;
+    return Routed(keyHash(key), [&](uint16_t key_int) {
+        if (is_local(key_int)) {
+            return LocalErase(key);
+        } else {
+          ForgetLease(key);
+          return RPC_CALL_WRAPPER("_Erase", key_int, ret_type,
+			          key);
+          // return rpc->call(key_int, func_prefix+"_Erase",
+          //                  key).template as<std::pair<bool, MappedType>>();
+        }
+    });
+}
+
+/**
+ * Put the data into the unordered map without waiting for the remote server.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @return future of bool, true if Put was successful else false.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::future<bool>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::AsyncPut(KeyType key, MappedType data) {
+    uint16_t key_int = route(keyHash(key));
+    if (is_local(key_int)) {
+        return make_ready_future(LocalPut(key, data));
+    } else {
+        ForgetLease(key);
+        return RPC_CALL_WRAPPER_ASYNC("_Put", key_int, bool, key, data);
+    }
+}
+
+/**
+ * Get the data in the unordered map without waiting for the remote server.
+ * @param key, key to get
+ * @return future of a pair of bool and Value, as returned by Get.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::future<std::pair<bool, MappedType>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::AsyncGet(KeyType &key) {
     size_t key_hash = keyHash(key);
-    uint16_t key_int = static_cast<uint16_t>(key_hash % num_servers);
+    uint16_t key_int = ReadServer(key_hash, route(key_hash));
+    typedef std::pair<bool, MappedType> ret_type;
     if (is_local(key_int)) {
-        return LocalErase(key);
+        if (key_int != route(key_hash)) return make_ready_future(LocalGetReplica(key));
+        return make_ready_future(LocalGet(key));
+    } else if (key_int != route(key_hash)) {
+        return RPC_CALL_WRAPPER_ASYNC("_GetReplica", key_int, ret_type, key);
     } else {
-      typedef std::pair<bool, MappedType> ret_type;
-      return RPC_CALL_WRAPPER("_Erase", key_int, ret_type,
-			      key);
-      // return rpc->call(key_int, func_prefix+"_Erase",
-      //                  key).template as<std::pair<bool, MappedType>>();
+        return RPC_CALL_WRAPPER_ASYNC("_Get", key_int, ret_type, key);
     }
 }
 
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::future<std::pair<bool, MappedType>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::AsyncErase(KeyType &key) {
+    uint16_t key_int = route(keyHash(key));
+    if (is_local(key_int)) {
+        return make_ready_future(LocalErase(key));
+    } else {
+        ForgetLease(key);
+        typedef std::pair<bool, MappedType> ret_type;
+        return RPC_CALL_WRAPPER_ASYNC("_Erase", key_int, ret_type, key);
+    }
+}
+/**
+ * Put a batch of data into the local unordered_map, taking the lock of each shard once.
+ * @param data, the key value pairs for put
+ * @return bool, true if all Puts were successful else false.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalPutBatch(std::vector<std::pair<KeyType, MappedType>> &data) {
+    /* entries of keys that moved, by the server they moved to */
+    std::map<uint16_t, std::vector<std::pair<KeyType, MappedType>>> redirected;
+    std::vector<std::future<bool>> applied;
+    bool result = WithSegment([&]() {
+        redirected.clear();
+        applied.clear();
+        auto shard_entries = GroupByShard(data.size(), [&data](size_t i) -> KeyType & { return data[i].first; });
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            if (shard_entries[shard].empty()) continue;
+            WriteLock lock(shard_mutexes[shard]);
+            for (size_t i : shard_entries[shard]) {
+                uint16_t owner = Redirect(shard, data[i].first, lock);
+                if (owner != my_server) {
+                    redirected[owner].push_back(data[i]);
+                    continue;
+                }
+                auto iterator = InsertEntry(shard, data[i].first, data[i].second);
+                Replicate(data[i].first, &iterator->second, applied);
+            }
+        }
+        return true;
+    }, true);
+    result = wait_applied(applied) && result;
+    for (auto &group : redirected) {
+        uint16_t owner = group.first;
+        bool stored = RPC_CALL_WRAPPER("_PutBatch", owner, bool, group.second);
+        result = stored && result;
+    }
+    return result;
+}
 
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
+/**
+ * Put a batch of data into the unordered_map. Keys are grouped by the server they hash
+ * to and each server receives a single RPC carrying all of its keys.
+ * @param data, the key value pairs for put
+ * @return bool, true if all Puts were successful else false.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::PutBatch(std::vector<std::pair<KeyType, MappedType>> &data) {
+    AutoTrace trace = AutoTrace("hcl::unordered_map::PutBatch", data.size());
+    size_t server_slots = 0;
+    auto owners = RouteAll(data.size(), [&data](size_t i) -> KeyType & { return data[i].first; }, server_slots);
+    std::vector<std::vector<std::pair<KeyType, MappedType>>> server_data(server_slots);
+    for (size_t i = 0; i < data.size(); ++i) {
+        server_data[owners[i]].push_back(data[i]);
+        ForgetLease(data[i].first);
+    }
+    bool result = true;
+    std::vector<std::future<bool>> responses;
+    for (uint16_t server = 0; server < server_slots; ++server) {
+        if (server_data[server].empty() || is_local(server)) continue;
+        auto response = RPC_CALL_WRAPPER_ASYNC("_PutBatch", server, bool, server_data[server]);
+        responses.push_back(std::move(response));
+    }
+    /* the local group is applied while the remote groups are in flight */
+    for (uint16_t server = 0; server < server_slots; ++server) {
+        if (!server_data[server].empty() && is_local(server))
+            result = LocalPutBatch(server_data[server]) && result;
+    }
+    for (auto &response : responses) result = response.get() && result;
+    return result;
+}
+
+/**
+ * Get a batch of keys from the local unordered_map, taking the lock of each shard once.
+ * @param keys, keys to get
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetBatch(std::vector<KeyType> &keys) {
+    typedef std::vector<std::pair<bool, MappedType>> ret_type;
+    /* positions of keys that moved, by the server they moved to */
+    std::map<uint16_t, std::vector<size_t>> redirected;
+    ret_type final_values = WithSegment([&]() {
+        redirected.clear();
+        ret_type values(keys.size(), std::pair<bool, MappedType>(false, MappedType()));
+        auto shard_keys = GroupByShard(keys.size(), [&keys](size_t i) -> KeyType & { return keys[i]; });
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            if (shard_keys[shard].empty()) continue;
+            ReadLock lock(shard_mutexes[shard]);
+            for (size_t i : shard_keys[shard]) {
+                uint16_t owner = Redirect(shard, keys[i], lock);
+                if (owner != my_server) {
+                    redirected[owner].push_back(i);
+                    continue;
+                }
+                auto iterator = FindLive(shard, keys[i]);
+                if (iterator != myHashMap[shard].end()) {
+                    Touch(shard, iterator->second);
+                    values[i] = std::pair<bool, MappedType>(true, iterator->second.value);
+                }
+            }
+        }
+        return values;
+    });
+    for (auto &group : redirected) {
+        std::vector<KeyType> moved_keys;
+        for (size_t i : group.second) moved_keys.push_back(keys[i]);
+        uint16_t owner = group.first;
+        ret_type values = RPC_CALL_WRAPPER("_GetBatch", owner, ret_type, moved_keys);
+        for (size_t i = 0; i < values.size(); ++i) final_values[group.second[i]] = std::move(values[i]);
+    }
+    return final_values;
+}
+
+/**
+ * Get a batch of keys from the unordered_map, sending one RPC per server that owns
+ * any of the keys.
+ * @param keys, keys to get
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetBatch(std::vector<KeyType> &keys) {
+    AutoTrace trace = AutoTrace("hcl::unordered_map::GetBatch", keys.size());
+    typedef std::vector<std::pair<bool, MappedType>> ret_type;
+    size_t server_slots = 0;
+    auto owners = RouteAll(keys.size(), [&keys](size_t i) -> KeyType & { return keys[i]; }, server_slots);
+    std::vector<std::vector<KeyType>> server_keys(server_slots);
+    std::vector<std::vector<size_t>> server_positions(server_slots);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        server_keys[owners[i]].push_back(keys[i]);
+        server_positions[owners[i]].push_back(i);
+    }
+    std::vector<std::pair<uint16_t, std::future<ret_type>>> responses;
+    for (uint16_t server = 0; server < server_slots; ++server) {
+        if (server_keys[server].empty() || is_local(server)) continue;
+        auto response = RPC_CALL_WRAPPER_ASYNC("_GetBatch", server, ret_type, server_keys[server]);
+        responses.emplace_back(server, std::move(response));
+    }
+    ret_type final_values(keys.size());
+    for (uint16_t server = 0; server < server_slots; ++server) {
+        if (server_keys[server].empty() || !is_local(server)) continue;
+        auto values = LocalGetBatch(server_keys[server]);
+        for (size_t i = 0; i < values.size(); ++i) final_values[server_positions[server][i]] = std::move(values[i]);
+    }
+    for (auto &response : responses) {
+        auto values = response.second.get();
+        auto &positions = server_positions[response.first];
+        for (size_t i = 0; i < values.size(); ++i) final_values[positions[i]] = std::move(values[i]);
+    }
+    return final_values;
+}
+
+/**
+ * Erase a batch of keys from the local unordered_map, taking the lock of each shard once.
+ * @param keys, keys to erase
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalEraseBatch(std::vector<KeyType> &keys) {
+    typedef std::vector<std::pair<bool, MappedType>> ret_type;
+    /* positions of keys that moved, by the server they moved to */
+    std::map<uint16_t, std::vector<size_t>> redirected;
+    std::vector<std::future<bool>> applied;
+    ret_type final_values = WithSegment([&]() {
+        redirected.clear();
+        applied.clear();
+        ret_type values(keys.size(), std::pair<bool, MappedType>(false, MappedType()));
+        auto shard_keys = GroupByShard(keys.size(), [&keys](size_t i) -> KeyType & { return keys[i]; });
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            if (shard_keys[shard].empty()) continue;
+            WriteLock lock(shard_mutexes[shard]);
+            for (size_t i : shard_keys[shard]) {
+                uint16_t owner = Redirect(shard, keys[i], lock);
+                if (owner != my_server) {
+                    redirected[owner].push_back(i);
+                    continue;
+                }
+                values[i].first = EraseEntry(shard, keys[i]);
+                Replicate(keys[i], nullptr, applied);
+            }
+        }
+        return values;
+    }, true);
+    wait_applied(applied);
+    for (auto &group : redirected) {
+        std::vector<KeyType> moved_keys;
+        for (size_t i : group.second) moved_keys.push_back(keys[i]);
+        uint16_t owner = group.first;
+        ret_type values = RPC_CALL_WRAPPER("_EraseBatch", owner, ret_type, moved_keys);
+        for (size_t i = 0; i < values.size(); ++i) final_values[group.second[i]] = std::move(values[i]);
+    }
+    return final_values;
+}
+
+/**
+ * Erase a batch of keys from the unordered_map, sending one RPC per server that owns
+ * any of the keys.
+ * @param keys, keys to erase
+ * @return a pair of bool and Value for each key, in the order of keys.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<std::pair<bool, MappedType>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::EraseBatch(std::vector<KeyType> &keys) {
+    AutoTrace trace = AutoTrace("hcl::unordered_map::EraseBatch", keys.size());
+    typedef std::vector<std::pair<bool, MappedType>> ret_type;
+    size_t server_slots = 0;
+    auto owners = RouteAll(keys.size(), [&keys](size_t i) -> KeyType & { return keys[i]; }, server_slots);
+    std::vector<std::vector<KeyType>> server_keys(server_slots);
+    std::vector<std::vector<size_t>> server_positions(server_slots);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ForgetLease(keys[i]);
+        server_keys[owners[i]].push_back(keys[i]);
+        server_positions[owners[i]].push_back(i);
+    }
+    std::vector<std::pair<uint16_t, std::future<ret_type>>> responses;
+    for (uint16_t server = 0; server < server_slots; ++server) {
+        if (server_keys[server].empty() || is_local(server)) continue;
+        auto response = RPC_CALL_WRAPPER_ASYNC("_EraseBatch", server, ret_type, server_keys[server]);
+        responses.emplace_back(server, std::move(response));
+    }
+    ret_type final_values(keys.size());
+    for (uint16_t server = 0; server < server_slots; ++server) {
+        if (server_keys[server].empty() || !is_local(server)) continue;
+        auto values = LocalEraseBatch(server_keys[server]);
+        for (size_t i = 0; i < values.size(); ++i) final_values[server_positions[server][i]] = std::move(values[i]);
+    }
+    for (auto &response : responses) {
+        auto values = response.second.get();
+        auto &positions = server_positions[response.first];
+        for (size_t i = 0; i < values.size(); ++i) final_values[positions[i]] = std::move(values[i]);
+    }
+    return final_values;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::GetAllData() {
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetAllData() {
     std::vector<std::pair<KeyType, MappedType>> final_values =
             std::vector<std::pair<KeyType, MappedType>>();
-    auto current_server = GetAllDataInServer();
-    final_values.insert(final_values.end(), current_server.begin(),
-                        current_server.end());
-    for (int i = 0; i < num_servers; ++i) {
-        if (i != my_server) {
-	  
+    for (uint16_t i : Members()) {
+        if (i == my_server) {
+            auto current_server = GetAllDataInServer();
+            final_values.insert(final_values.end(), current_server.begin(),
+                                current_server.end());
+        } else {
             typedef std::vector<std::pair<KeyType, MappedType> > ret_type;
             auto server = RPC_CALL_WRAPPER1("_GetAllData",i, ret_type);
             final_values.insert(final_values.end(), server.begin(), server.end());
@@ -157,30 +868,38 @@ unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::GetAllData() {
     return final_values;
 }
 
-template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType>
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalGetAllDataInServer() {
-    std::vector<std::pair<KeyType, MappedType>> final_values =
-            std::vector<std::pair<KeyType, MappedType>>();
-    {
-        boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>
-                lock(*mutex);
-        typename MyHashMap::iterator lower_bound;
-        if (myHashMap->size() > 0) {
-            lower_bound = myHashMap->begin();
-            while (lower_bound != myHashMap->end()) {
-                final_values.push_back(std::pair<KeyType, MappedType>(
-                    lower_bound->first, lower_bound->second));
-                lower_bound++;
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetAllDataInServer() {
+    return WithSegment([&]() {
+        std::vector<std::pair<KeyType, MappedType>> final_values =
+                std::vector<std::pair<KeyType, MappedType>>();
+        /* shards are copied one at a time, so this is not a snapshot of the whole map */
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            ReadLock lock(shard_mutexes[shard]);
+            typename MyHashMap::iterator lower_bound;
+            if (myHashMap[shard].size() > 0) {
+                really_long now = now_ms();
+                lower_bound = myHashMap[shard].begin();
+                while (lower_bound != myHashMap[shard].end()) {
+                    really_long expires_at = lower_bound->second.expires_at;
+                    if (expires_at != 0 && expires_at <= now) {
+                        lower_bound++;
+                        continue;
+                    }
+                    final_values.push_back(std::pair<KeyType, MappedType>(
+                        lower_bound->first, lower_bound->second.value));
+                    lower_bound++;
+                }
             }
         }
-    }
-    return final_values;
+        return final_values;
+    });
 }
 
-template<typename KeyType, typename MappedType, typename Hash, typename Allocator ,typename SharedType>
+template<typename KeyType, typename MappedType, typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
 std::vector<std::pair<KeyType, MappedType>>
-unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::GetAllDataInServer() {
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetAllDataInServer() {
     if (is_local()) {
         return LocalGetAllDataInServer();
     }
@@ -191,76 +910,887 @@ unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::GetAllDataInSer
     }
 }
 
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+really_long unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalEvictions() {
+    return WithSegment([&]() {
+        really_long evictions = 0;
+        for (uint16_t shard = 0; shard < num_shards; ++shard)
+            evictions += shard_states[shard].evictions.load(std::memory_order_relaxed);
+        return evictions;
+    });
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+really_long unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Evictions() {
+    really_long evictions = 0;
+    for (uint16_t server : Members()) {
+        if (is_local(server)) {
+            evictions += LocalEvictions();
+        } else {
+            really_long server_evictions = RPC_CALL_WRAPPER1("_Evictions", server, really_long);
+            evictions += server_evictions;
+        }
+    }
+    return evictions;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::vector<uint16_t> unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Members() {
+    if (!dynamic) return members;
+    std::shared_lock<std::shared_mutex> lock(routing_mutex);
+    return members;
+}
 
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename GetKey>
+std::vector<uint16_t> unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::RouteAll(size_t count, GetKey get_key, size_t &server_slots) {
+    std::vector<uint16_t> owners(count);
+    std::shared_lock<std::shared_mutex> lock(routing_mutex, std::defer_lock);
+    if (dynamic) lock.lock();
+    server_slots = std::max<size_t>(num_servers, *std::max_element(members.begin(), members.end()) + 1);
+    for (size_t i = 0; i < count; ++i) owners[i] = partitioner(keyHash(get_key(i)));
+    return owners;
+}
 
-template<typename KeyType, typename MappedType, typename Hash, typename Allocator ,typename SharedType>
-void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::open_shared_memory() {
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Call>
+auto unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Routed(size_t key_hash, Call &&call) -> decltype(call(uint16_t())) {
+    uint16_t key_int = route(key_hash);
+    if (!dynamic) return call(key_int);
+    try {
+        return call(key_int);
+    } catch (const std::exception &) {
+        /* the server may have left since the servers were last refreshed */
+        RefreshMembership();
+        if (route(key_hash) == key_int) throw;
+    }
+    return call(route(key_hash));
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Lock>
+uint16_t unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Redirect(uint16_t shard, const KeyType &key, Lock &lock) {
+    if (!dynamic) return my_server;
+    size_t key_hash = keyHash(key);
+    std::shared_lock<std::shared_mutex> routing(routing_mutex);
+    while (true) {
+        uint16_t owner = partitioner(key_hash);
+        if (!next_partitioner) return owner;
+        /* while keys move, a key stays with its old server until its shard handed it over */
+        uint16_t next = (*next_partitioner)(key_hash);
+        /* keys this server handed back after an abort go to their server again */
+        if (next == my_server) return returned_shards.count(std::make_pair(shard, owner)) ? owner : my_server;
+        if (owner != my_server) return owner;
+        if (moved_shards[shard] != SHARD_HANDING_OVER) return moved_shards[shard] == SHARD_MOVED ? next : my_server;
+        /* the shard lock is left to the keys that stay; it comes before routing_mutex */
+        lock.unlock();
+        handed_over.wait(routing, [&]() { return moved_shards[shard] != SHARD_HANDING_OVER; });
+        routing.unlock();
+        lock.lock();
+        routing.lock();
+    }
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::AdoptMembership(std::pair<uint64_t, std::vector<uint16_t>> &membership,
+                                                                                 bool force) {
+    if (membership.second.empty()) return false;
+    Partitioner adopted(membership.second);
+    std::unique_lock<std::shared_mutex> lock(routing_mutex);
+    /* every server starts from the whole server list at epoch 0, so only later epochs are news */
+    if (!force && membership.first <= membership_epoch) return false;
+    partitioner = std::move(adopted);
+    members = membership.second;
+    membership_epoch = membership.first;
+    return true;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::RefreshMembership(bool force) {
+    std::vector<uint16_t> servers = Members();
+    if (!is_server) servers.insert(servers.begin(), my_server);
+    for (uint16_t server : servers) {
+        if (is_server && server == my_server) continue;
+        typedef std::pair<uint64_t, std::vector<uint16_t>> ret_type;
+        try {
+            ret_type membership = RPC_CALL_WRAPPER1("_Membership", server, ret_type);
+            return AdoptMembership(membership, force);
+        } catch (const std::exception &) {
+            /* ask the next one */
+        }
+    }
+    return false;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<uint64_t, std::vector<uint16_t>> unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalMembership() {
+    std::shared_lock<std::shared_mutex> lock(routing_mutex);
+    return std::make_pair(membership_epoch, members);
+}
+
+/**
+ * Send entries to their new servers, REBALANCE_BATCH at a time.
+ * @param outgoing, the entries by server, emptied of erased keys
+ * @return false if a server did not store some of them.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::SendEntries(std::map<uint16_t, Outgoing> &outgoing) {
+    bool result = true;
+    size_t batch = std::max<size_t>(HCL_CONF->REBALANCE_BATCH, 1);
+    for (auto &group : outgoing) {
+        uint16_t server = group.first;
+        Outgoing &out = group.second;
+        size_t sent = 0;
+        do {
+            size_t end = std::min(out.entries.size(), sent + batch);
+            std::vector<std::pair<KeyType, MappedType>> entries(out.entries.begin() + sent, out.entries.begin() + end);
+            std::vector<really_long> ttl_ms(out.ttl_ms.begin() + sent, out.ttl_ms.begin() + end);
+            std::vector<KeyType> erased;
+            if (sent == 0) erased.swap(out.erased);
+            try {
+                bool stored = RPC_CALL_WRAPPER("_MoveIn", server, bool, entries, ttl_ms, erased);
+                result = stored && result;
+            } catch (const std::exception &) {
+                result = false;
+            }
+            sent = end;
+        } while (sent < out.entries.size());
+    }
+    return result;
+}
+
+/**
+ * Hand the keys of a shard that change server over to their new servers.
+ * They are copied while the shard keeps serving. Then, under the exclusive
+ * lock, the shard collects what changed meanwhile and starts handing over;
+ * those changes are sent once the lock is released, while operations on
+ * the leaving keys wait, and the keys leave the shard, which forwards them
+ * from then on. A shard whose keys could not all be sent keeps them and
+ * goes on serving them.
+ * @param shard, the shard to move
+ * @return false if the shard did not move.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::MigrateShard(uint16_t shard) {
+    if (migration_cancelled) return false;
+    const Partitioner &next = *next_partitioner;
+    std::map<uint16_t, Outgoing> outgoing;
+    /* versions of the entries sent while the shard kept serving */
+    std::unordered_map<KeyType, uint64_t, Hash> sent;
+    WithSegment([&]() {
+        outgoing.clear();
+        sent.clear();
+        ReadLock lock(shard_mutexes[shard]);
+        for (auto &entry : myHashMap[shard]) {
+            uint16_t owner = next(keyHash(entry.first));
+            if (owner == my_server || is_expired(entry.second.expires_at)) continue;
+            Outgoing &out = outgoing[owner];
+            out.entries.push_back(std::pair<KeyType, MappedType>(entry.first, entry.second.value));
+            out.ttl_ms.push_back(time_left(entry.second.expires_at));
+            sent.emplace(entry.first, entry.second.version);
+        }
+        return true;
+    });
+    if (!SendEntries(outgoing) || migration_cancelled) return false;
+    WithSegment([&]() {
+        outgoing.clear();
+        WriteLock lock(shard_mutexes[shard]);
+        for (auto &entry : myHashMap[shard]) {
+            uint16_t owner = next(keyHash(entry.first));
+            if (owner == my_server) continue;
+            auto previous = sent.find(entry.first);
+            bool expired = is_expired(entry.second.expires_at);
+            if (expired) {
+                if (previous != sent.end()) outgoing[owner].erased.push_back(entry.first);
+            } else if (previous == sent.end() || previous->second != entry.second.version) {
+                Outgoing &out = outgoing[owner];
+                out.entries.push_back(std::pair<KeyType, MappedType>(entry.first, entry.second.value));
+                out.ttl_ms.push_back(time_left(entry.second.expires_at));
+            }
+        }
+        for (auto &previous : sent) {
+            if (myHashMap[shard].find(previous.first) == myHashMap[shard].end())
+                outgoing[next(keyHash(previous.first))].erased.push_back(previous.first);
+        }
+        std::unique_lock<std::shared_mutex> routing(routing_mutex);
+        moved_shards[shard] = SHARD_HANDING_OVER;
+        return true;
+    }, true);
+    bool handed = SendEntries(outgoing);
+    WithSegment([&]() {
+        WriteLock lock(shard_mutexes[shard]);
+        if (handed) {
+            std::vector<typename MyHashMap::iterator> leaving;
+            for (auto iterator = myHashMap[shard].begin(); iterator != myHashMap[shard].end(); ++iterator)
+                if (next(keyHash(iterator->first)) != my_server) leaving.push_back(iterator);
+            for (auto iterator : leaving) RemoveEntry(shard, iterator);
+        }
+        std::unique_lock<std::shared_mutex> routing(routing_mutex);
+        moved_shards[shard] = handed ? SHARD_MOVED : SHARD_SERVING;
+        return true;
+    }, true);
+    handed_over.notify_all();
+    return handed;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::MigrateShards() {
+    bool result = true;
+    for (uint16_t shard = 0; shard < num_shards; ++shard) result = MigrateShard(shard) && result;
+    return result;
+}
+
+/**
+ * Take the keys of a shard that moved back from the servers of an aborted
+ * change. The shard serves them again once they are back; the keys a server
+ * that does not answer took are lost.
+ * @param shard, the shard that moved
+ * @param epoch, the number of the change
+ * @param servers, the servers involved in it
+ * @return false if a server did not hand its keys back.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::ReturnShard(uint16_t shard, uint64_t epoch, std::vector<uint16_t> &servers) {
+    typedef std::pair<std::vector<std::pair<KeyType, MappedType>>, std::vector<really_long>> ret_type;
+    std::vector<ret_type> returned;
+    bool asked = false, result = true;
+    WithSegment([&]() {
+        WriteLock lock(shard_mutexes[shard]);
+        /* the servers hand the keys over once; if the segment grows meanwhile they are stored again */
+        if (!asked) {
+            asked = true;
+            for (uint16_t server : servers) {
+                if (server == my_server) continue;
+                try {
+                    ret_type entries = RPC_CALL_WRAPPER("_MoveBack", server, ret_type, epoch, my_server, shard);
+                    returned.push_back(std::move(entries));
+                } catch (const std::exception &) {
+                    result = false;
+                }
+            }
+        }
+        for (auto &entries : returned) {
+            for (size_t i = 0; i < entries.first.size(); ++i)
+                InsertEntry(shard, entries.first[i].first, entries.first[i].second, expiry_time(entries.second[i]));
+        }
+        moved_shards[shard] = SHARD_SERVING;
+        return true;
+    }, true);
+    return result;
+}
+
+/**
+ * Hand the keys of a shard that server owns back to it, once a change was
+ * aborted, and forward what arrives for them from now on.
+ * @param epoch, the number of the change
+ * @param server, the server taking its keys back
+ * @param shard, the shard they are in
+ * @return the entries and the milliseconds each has left, 0 for never.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<std::vector<std::pair<KeyType, MappedType>>, std::vector<really_long>>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalMoveBack(uint64_t epoch, uint16_t server, uint16_t shard) {
+    typedef std::pair<std::vector<std::pair<KeyType, MappedType>>, std::vector<really_long>> ret_type;
+    {
+        std::shared_lock<std::shared_mutex> lock(routing_mutex);
+        if (!next_partitioner || epoch != next_epoch || shard >= num_shards) return ret_type();
+    }
+    ret_type returned;
+    WithSegment([&]() {
+        returned.first.clear();
+        returned.second.clear();
+        WriteLock lock(shard_mutexes[shard]);
+        std::vector<typename MyHashMap::iterator> leaving;
+        {
+            std::shared_lock<std::shared_mutex> routing(routing_mutex);
+            for (auto iterator = myHashMap[shard].begin(); iterator != myHashMap[shard].end(); ++iterator)
+                if (partitioner(keyHash(iterator->first)) == server) leaving.push_back(iterator);
+        }
+        for (auto iterator : leaving) {
+            if (is_expired(iterator->second.expires_at)) continue;
+            returned.first.push_back(std::pair<KeyType, MappedType>(iterator->first, iterator->second.value));
+            returned.second.push_back(time_left(iterator->second.expires_at));
+        }
+        for (auto iterator : leaving) RemoveEntry(shard, iterator);
+        std::unique_lock<std::shared_mutex> routing(routing_mutex);
+        returned_shards.emplace(shard, server);
+        return true;
+    }, true);
+    return returned;
+}
+
+/**
+ * Store entries moving in from another server, and erase the keys it sent
+ * before that were erased since.
+ * @param entries, the entries
+ * @param ttl_ms, milliseconds each entry has left, 0 for never
+ * @param erased, the erased keys
+ * @return bool, true once all are applied.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalMoveIn(std::vector<std::pair<KeyType, MappedType>> &entries,
+                                                                             std::vector<really_long> &ttl_ms,
+                                                                             std::vector<KeyType> &erased) {
+    return StoreEntries(0, entries, ttl_ms, erased);
+}
+
+/* Store entries and erase keys in the shards from first_shard on, either the data of this server or the copies. */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::StoreEntries(uint16_t first_shard,
+                                                                              std::vector<std::pair<KeyType, MappedType>> &entries,
+                                                                              std::vector<really_long> &ttl_ms,
+                                                                              std::vector<KeyType> &erased) {
+    return WithSegment([&]() {
+        auto shard_entries = GroupByShard(entries.size(), [&entries](size_t i) -> KeyType & { return entries[i].first; });
+        auto shard_erased = GroupByShard(erased.size(), [&erased](size_t i) -> KeyType & { return erased[i]; });
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            if (shard_entries[shard].empty() && shard_erased[shard].empty()) continue;
+            WriteLock lock(shard_mutexes[first_shard + shard]);
+            for (size_t i : shard_entries[shard])
+                InsertEntry(first_shard + shard, entries[i].first, entries[i].second, expiry_time(ttl_ms[i]));
+            for (size_t i : shard_erased[shard]) EraseEntry(first_shard + shard, erased[i]);
+        }
+        return true;
+    }, true);
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Replicate(const KeyType &key, const Entry *entry,
+                                                                          std::vector<std::future<bool>> &applied) {
+    if (!replicator) return;
+    Change change{key, entry ? MappedType(entry->value) : MappedType(), entry ? entry->expires_at : 0, entry == nullptr};
+    replicator->Push(partitioner.replicas(keyHash(key), replicator->Copies()), change, applied);
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::SendChanges(uint16_t server, std::vector<Change> &changes) {
+    std::vector<std::pair<KeyType, MappedType>> entries;
+    std::vector<really_long> ttl_ms;
+    std::vector<KeyType> erased;
+    for (auto &change : changes) {
+        if (change.erased) {
+            erased.push_back(change.key);
+        } else {
+            entries.emplace_back(change.key, change.value);
+            ttl_ms.push_back(time_left(change.expires_at));
+        }
+    }
+    bool stored = RPC_CALL_WRAPPER("_Apply", server, bool, entries, ttl_ms, erased);
+    return stored;
+}
+
+/**
+ * Apply changes a primary made to keys this server keeps copies of.
+ * @param entries, the stored entries
+ * @param ttl_ms, milliseconds each entry has left, 0 for never
+ * @param erased, the erased keys
+ * @return bool, true once all are applied.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalApply(std::vector<std::pair<KeyType, MappedType>> &entries,
+                                                                           std::vector<really_long> &ttl_ms,
+                                                                           std::vector<KeyType> &erased) {
+    return StoreEntries(num_shards, entries, ttl_ms, erased);
+}
+
+/**
+ * Get the copy of a key this server keeps as a backup.
+ * @param key, key to get
+ * @return return a pair of bool and Value, as returned by LocalGet.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, MappedType> unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetReplica(KeyType &key) {
+    typedef std::pair<bool, MappedType> ret_type;
+    return WithSegment([&]() {
+        uint16_t shard = num_shards + get_shard(key);
+        ReadLock lock(shard_mutexes[shard]);
+        typename MyHashMap::iterator iterator = FindLive(shard, key);
+        if (iterator == myHashMap[shard].end()) return ret_type(false, MappedType());
+        Touch(shard, iterator->second);
+        return ret_type(true, iterator->second.value);
+    });
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+std::pair<bool, MappedType> unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetReplica(KeyType &key, uint16_t server) {
+    if (is_local(server)) return LocalGetReplica(key);
+    typedef std::pair<bool, MappedType> ret_type;
+    return RPC_CALL_WRAPPER("_GetReplica", server, ret_type, key);
+}
+
+/**
+ * The steps of a change of the servers, run by the server joining or
+ * leaving on all servers involved. Prepare sets the servers keys move to,
+ * Migrate moves them in the background, Migrated tells how that goes and
+ * Commit switches to the new servers. Return cancels or waits out the move
+ * and takes the moved keys back; Abort then undoes Prepare.
+ * @param epoch, the number of the change, one more than the current one
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalPrepare(uint64_t epoch, std::vector<uint16_t> &servers) {
+    if (!dynamic || servers.empty()) return false;
+    std::unique_ptr<Partitioner> next(new Partitioner(servers));
+    {
+        std::unique_lock<std::shared_mutex> lock(routing_mutex);
+        if (epoch <= membership_epoch || next_partitioner || migration.valid()) return false;
+        next_partitioner = std::move(next);
+        next_members = servers;
+        next_epoch = epoch;
+        moved_shards.assign(num_shards, SHARD_SERVING);
+    }
+    /* a new epoch, so that keys moving in or back get no version a client cached from their former server */
+    uint64_t version = first_version();
+    WithSegment([&]() {
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            WriteLock lock(shard_mutexes[shard]);
+            shard_states[shard].writes = version;
+        }
+        return true;
+    }, true);
+    return true;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalMigrate(uint64_t epoch) {
+    std::unique_lock<std::shared_mutex> lock(routing_mutex);
+    if (!next_partitioner || epoch != next_epoch || migration.valid()) return false;
+    migration_cancelled = false;
+    migration = std::async(std::launch::async, &unordered_map::MigrateShards, this).share();
+    return true;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+uint8_t unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalMigrated(uint64_t epoch) {
+    std::shared_lock<std::shared_mutex> lock(routing_mutex);
+    if (!next_partitioner || epoch != next_epoch || !migration.valid()) return MIGRATION_FAILED;
+    if (migration.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return MIGRATING;
+    return migration.get() ? MIGRATED : MIGRATION_FAILED;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalCommit(uint64_t epoch) {
+    std::shared_future<bool> moved;
+    {
+        std::unique_lock<std::shared_mutex> lock(routing_mutex);
+        if (!next_partitioner || epoch != next_epoch || !migration.valid()) return false;
+        moved = migration;
+    }
+    /* Rebalance commits once every server migrated; keys that did not move stay here until Return */
+    if (!moved.get()) return false;
+    std::unique_lock<std::shared_mutex> lock(routing_mutex);
+    partitioner = std::move(*next_partitioner);
+    members = std::move(next_members);
+    membership_epoch = next_epoch;
+    next_partitioner.reset();
+    moved_shards.clear();
+    returned_shards.clear();
+    migration = std::shared_future<bool>();
+    return true;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalReturn(uint64_t epoch) {
+    std::vector<uint16_t> servers;
+    {
+        std::unique_lock<std::shared_mutex> lock(routing_mutex);
+        if (!next_partitioner || epoch != next_epoch) return false;
+        servers = members;
+        for (uint16_t server : next_members)
+            if (std::find(servers.begin(), servers.end(), server) == servers.end()) servers.push_back(server);
+        migration_cancelled = true;
+    }
+    if (migration.valid()) migration.wait();
+    bool result = true;
+    for (uint16_t shard = 0; shard < num_shards; ++shard)
+        if (moved_shards[shard] == SHARD_MOVED) result = ReturnShard(shard, epoch, servers) && result;
+    return result;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalAbort(uint64_t epoch) {
+    {
+        std::unique_lock<std::shared_mutex> lock(routing_mutex);
+        if (!next_partitioner || epoch != next_epoch) return false;
+        migration_cancelled = true;
+    }
+    if (migration.valid()) migration.wait();
+    /* a shard still forwarding would lose its keys; Return takes them back first */
+    if (std::find(moved_shards.begin(), moved_shards.end(), SHARD_MOVED) != moved_shards.end()) return false;
+    /* copies of keys that came in before the move stopped; their owners kept them */
+    WithSegment([&]() {
+        for (uint16_t shard = 0; shard < num_shards; ++shard) {
+            WriteLock lock(shard_mutexes[shard]);
+            std::shared_lock<std::shared_mutex> routing(routing_mutex);
+            std::vector<typename MyHashMap::iterator> stray;
+            for (auto iterator = myHashMap[shard].begin(); iterator != myHashMap[shard].end(); ++iterator)
+                if (partitioner(keyHash(iterator->first)) != my_server) stray.push_back(iterator);
+            for (auto iterator : stray) RemoveEntry(shard, iterator);
+        }
+        return true;
+    }, true);
+    std::unique_lock<std::shared_mutex> lock(routing_mutex);
+    next_partitioner.reset();
+    next_members.clear();
+    moved_shards.clear();
+    returned_shards.clear();
+    migration = std::shared_future<bool>();
+    return true;
+}
+
+/* Run a step of a change on server, directly if it is this one; false if it failed or did not answer. */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::MembershipStep(uint16_t server, bool (unordered_map::*local)(uint64_t),
+                                                                                const char *step, uint64_t epoch) {
+    if (server == my_server) return (this->*local)(epoch);
+    try {
+        bool done = RPC_CALL_WRAPPER(step, server, bool, epoch);
+        return done;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+/* The MigrationState of the move on server; a server that did not answer for REBALANCE_TIMEOUT_MS failed. */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+uint8_t unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::MigrationStep(uint16_t server, uint64_t epoch, really_long &silent_since) {
+    if (server == my_server) return LocalMigrated(epoch);
+    try {
+        uint8_t state = RPC_CALL_WRAPPER("_Migrated", server, uint8_t, epoch);
+        silent_since = 0;
+        return state;
+    } catch (const std::exception &) {
+        really_long now = now_ms();
+        if (silent_since == 0) silent_since = now;
+        return now - silent_since < HCL_CONF->REBALANCE_TIMEOUT_MS ? MIGRATING : MIGRATION_FAILED;
+    }
+}
+
+/**
+ * Change the servers of the container to servers, moving the keys that
+ * change owner. Every server involved keeps serving throughout. The change
+ * commits only once every server moved all of its keys; otherwise all of
+ * them take their keys back and keep the servers they had.
+ * @param servers, the new servers
+ * @return false if the change was aborted, or a server did not commit it.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Rebalance(std::vector<uint16_t> servers) {
+    std::vector<uint16_t> participants = Members();
+    for (uint16_t server : servers)
+        if (std::find(participants.begin(), participants.end(), server) == participants.end())
+            participants.push_back(server);
+    uint64_t epoch;
+    {
+        std::shared_lock<std::shared_mutex> lock(routing_mutex);
+        epoch = membership_epoch + 1;
+    }
+    std::vector<uint16_t> prepared;
+    for (uint16_t server : participants) {
+        bool ready = false;
+        if (server == my_server) {
+            ready = LocalPrepare(epoch, servers);
+        } else {
+            try {
+                ready = RPC_CALL_WRAPPER("_Prepare", server, bool, epoch, servers);
+            } catch (const std::exception &) {
+                ready = false;
+            }
+        }
+        if (!ready) {
+            for (uint16_t undo : prepared) MembershipStep(undo, &unordered_map::LocalAbort, "_Abort", epoch);
+            return false;
+        }
+        prepared.push_back(server);
+    }
+    bool migrated = true;
+    std::vector<uint16_t> pending;
+    for (uint16_t server : participants) {
+        if (!MembershipStep(server, &unordered_map::LocalMigrate, "_Migrate", epoch)) {
+            migrated = false;
+            break;
+        }
+        pending.push_back(server);
+    }
+    std::map<uint16_t, really_long> silent_since;
+    while (migrated && !pending.empty()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        for (auto server = pending.begin(); server != pending.end();) {
+            uint8_t state = MigrationStep(*server, epoch, silent_since[*server]);
+            if (state == MIGRATING) {
+                ++server;
+            } else if (state == MIGRATED) {
+                server = pending.erase(server);
+            } else {
+                migrated = false;
+                break;
+            }
+        }
+    }
+    if (!migrated) {
+        /* every server takes its keys back before any stops forwarding to the others */
+        for (uint16_t server : participants) MembershipStep(server, &unordered_map::LocalReturn, "_Return", epoch);
+        for (uint16_t server : participants) MembershipStep(server, &unordered_map::LocalAbort, "_Abort", epoch);
+        return false;
+    }
+    bool result = true;
+    for (uint16_t server : participants)
+        result = MembershipStep(server, &unordered_map::LocalCommit, "_Commit", epoch) && result;
+    return result;
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Join() {
+    if (!dynamic || !is_server) return false;
+    /* until now this server only knew the server list */
+    RefreshMembership(true);
+    std::vector<uint16_t> servers = Members();
+    if (std::find(servers.begin(), servers.end(), my_server) != servers.end()) return true;
+    servers.push_back(my_server);
+    return Rebalance(servers);
+}
+
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+bool unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::Leave() {
+    if (!dynamic || !is_server) return false;
+    std::vector<uint16_t> servers = Members();
+    auto self = std::find(servers.begin(), servers.end(), my_server);
+    if (self == servers.end()) return true;
+    servers.erase(self);
+    if (servers.empty()) return false;
+    return Rebalance(servers);
+}
+
+
+
+template<typename KeyType, typename MappedType, typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::open_shared_memory() {
     std::pair<MyHashMap *, boost::interprocess::managed_mapped_file::size_type> res;
     res = segment.find<MyHashMap>(name.c_str());
     myHashMap = res.first;
+    /* the server decides the number of shards */
+    num_shards = static_cast<uint16_t>(res.second / table_sets);
+    shard_mutexes = segment.find<Mutex>("shard_mtx").first;
+    shard_states = segment.find<ShardState>("shard_state").first;
+    usage = segment.find<ServerUsage>("server_usage").first;
 }
 
-template<typename KeyType, typename MappedType, typename Hash, typename Allocator ,typename SharedType>
-void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::bind_functions() {
-    switch (HCL_CONF->RPC_IMPLEMENTATION) {
-#ifdef HCL_ENABLE_RPCLIB
-        case RPCLIB: {
-            std::function<bool(KeyType &, MappedType &)> putFunc(
-                    std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalPut, this,
-                              std::placeholders::_1, std::placeholders::_2));
-            std::function<std::pair<bool, MappedType>(KeyType &)> getFunc(
-                    std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalGet, this,
-                              std::placeholders::_1));
-            std::function<std::pair<bool, MappedType>(KeyType &)> eraseFunc(
-                    std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalErase, this,
-                              std::placeholders::_1));
-            std::function<std::vector<std::pair<KeyType, MappedType>>(void)>
-                    getAllDataInServerFunc(std::bind(
-                    &unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::LocalGetAllDataInServer,
-                    this));
-            rpc->bind(func_prefix+"_Put", putFunc);
-            rpc->bind(func_prefix+"_Get", getFunc);
-            rpc->bind(func_prefix+"_Erase", eraseFunc);
-            rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-            break;
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::recover_shared_memory() {
+    open_shared_memory();
+    /* also after Restore: what this process counted refers to the segment it replaced */
+    size_occupied = 0;
+    std::fill(sweep_hands.begin(), sweep_hands.end(), 0);
+    /* segments written before the usage was kept have none */
+    usage = segment.find_or_construct<ServerUsage>("server_usage")();
+    usage->entries = 0;
+    usage->bytes = 0;
+    uint64_t version = first_version();
+    for (uint16_t shard = 0; shard < num_shards * table_sets; ++shard) {
+        new (&shard_mutexes[shard]) Mutex();
+        shard_states[shard].writes = version;
+        /* the bounds of this run apply from the next write on */
+        shard_states[shard].capacity_entries = HCL_CONF->CACHE_CAPACITY_ENTRIES;
+        shard_states[shard].capacity_bytes = HCL_CONF->CACHE_CAPACITY_BYTES;
+        shard_states[shard].policy = HCL_CONF->CACHE_EVICTION_POLICY;
+        /* counted again, they may be off by the write a crash interrupted */
+        shard_states[shard].entries = 0;
+        shard_states[shard].bytes = 0;
+        for (auto &entry : myHashMap[shard]) {
+            really_long size = CalculateSize<KeyType>().GetSize(entry.first) + CalculateSize<MappedType>().GetSize(entry.second.value);
+            shard_states[shard].entries++;
+            shard_states[shard].bytes += size;
+            size_occupied += size;
+            if (shard < num_shards) {
+                usage->entries++;
+                usage->bytes += size;
+            }
         }
-#endif
-#ifdef HCL_ENABLE_THALLIUM_TCP
-            case THALLIUM_TCP:
-#endif
-#ifdef HCL_ENABLE_THALLIUM_ROCE
-            case THALLIUM_ROCE:
-#endif
+    }
+}
+
+/**
+ * Register a callback on every rank and, on servers, bind the Put and Get
+ * variants running it.
+ * @param cb_name, name the callback is called with
+ * @param callback, function applied to the stored value
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::BindCallback(CharStruct cb_name,
+        std::function<Ret(MappedType &, CB_Args...)> callback) {
+    RegisterCallback(cb_name, callback);
+    if (!is_server) return;
+    std::function<std::pair<bool, Ret>(KeyType &, MappedType &, CB_Args...)> putFunc(
+        [this, cb_name](KeyType &key, MappedType &data, CB_Args... cb_args) {
+            return this->template LocalPutWithCallback<Ret, CB_Args...>(key, data, cb_name, std::forward<CB_Args>(cb_args)...);
+        });
+    std::function<std::pair<bool, Ret>(KeyType &, CB_Args...)> getFunc(
+        [this, cb_name](KeyType &key, CB_Args... cb_args) {
+            return this->template LocalGetWithCallback<Ret, CB_Args...>(key, cb_name, std::forward<CB_Args>(cb_args)...);
+        });
+    rpc->bind_function(func_prefix+"_PutWithCallback_"+cb_name, putFunc);
+    rpc->bind_function(func_prefix+"_GetWithCallback_"+cb_name, getFunc);
+}
+
+/**
+ * Put the data into the local unordered map and run a callback on the stored value.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalPutWithCallback(KeyType &key, MappedType &data,
+                                                                        CharStruct cb_name, CB_Args... cb_args) {
+    typedef std::pair<bool, Ret> ret_type;
+    uint16_t owner = my_server;
+    std::vector<std::future<bool>> applied;
+    ret_type result = WithSegment([&]() {
+        applied.clear();
+        auto &callback = GetCallback<std::function<Ret(MappedType &, CB_Args...)>>(cb_name);
+        uint16_t shard = get_shard(key);
+        WriteLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return ret_type(false, Ret());
+        auto iterator = InsertEntry(shard, key, data);
+        ret_type called(true, callback(iterator->second.value, std::forward<CB_Args>(cb_args)...));
+        Replicate(key, &iterator->second, applied);
+        return called;
+    }, true);
+    if (owner == my_server) {
+        result.first = wait_applied(applied) && result.first;
+        return result;
+    }
+    return RPC_CALL_WRAPPER_CB(func_prefix+"_PutWithCallback_"+cb_name, owner, ret_type, key, data);
+}
+
+/**
+ * Run a callback on a value of the local unordered map.
+ * @param key, key to get
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback. If bool is
+ * false the key was not found and the callback did not run.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::LocalGetWithCallback(KeyType &key, CharStruct cb_name,
+                                                                        CB_Args... cb_args) {
+    typedef std::pair<bool, Ret> ret_type;
+    uint16_t owner = my_server;
+    std::vector<std::future<bool>> applied;
+    ret_type result = WithSegment([&]() {
+        applied.clear();
+        auto &callback = GetCallback<std::function<Ret(MappedType &, CB_Args...)>>(cb_name);
+        uint16_t shard = get_shard(key);
+        WriteLock lock(shard_mutexes[shard]);
+        if ((owner = Redirect(shard, key, lock)) != my_server) return ret_type(false, Ret());
+        typename MyHashMap::iterator iterator = FindLive(shard, key);
+        if (iterator == myHashMap[shard].end()) return ret_type(false, Ret());
+        Touch(shard, iterator->second);
+        /* the callback may modify the value */
+        iterator->second.version = ++shard_states[shard].writes;
+        ret_type called(true, callback(iterator->second.value, std::forward<CB_Args>(cb_args)...));
+        Replicate(key, &iterator->second, applied);
+        return called;
+    }, true);
+    if (owner == my_server) {
+        wait_applied(applied);
+        return result;
+    }
+    return RPC_CALL_WRAPPER_CB(func_prefix+"_GetWithCallback_"+cb_name, owner, ret_type, key);
+}
+
+/**
+ * Put the data into the unordered map and run a callback on the server the key hashes to.
+ * @param key, the key for put
+ * @param data, the value for put
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::PutWithCallback(KeyType key, MappedType data,
+                                                                   CharStruct cb_name, CB_Args... cb_args) {
+    uint16_t key_int = route(keyHash(key));
+    if (is_local(key_int)) {
+        return LocalPutWithCallback<Ret, CB_Args...>(key, data, cb_name, std::forward<CB_Args>(cb_args)...);
+    } else {
+        ForgetLease(key);
+        typedef std::pair<bool, Ret> ret_type;
+        return RPC_CALL_WRAPPER_CB(func_prefix+"_PutWithCallback_"+cb_name, key_int, ret_type, key, data);
+    }
+}
+
+/**
+ * Run a callback on a value of the unordered map on the server the key hashes to.
+ * @param key, key to get
+ * @param cb_name, the callback to run
+ * @param cb_args, extra arguments of the callback
+ * @return return a pair of bool and the result of the callback. If bool is
+ * false the key was not found and the callback did not run.
+ */
+template<typename KeyType, typename MappedType,typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+template<typename Ret, typename... CB_Args>
+std::pair<bool, Ret>
+unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::GetWithCallback(KeyType &key, CharStruct cb_name,
+                                                                   CB_Args... cb_args) {
+    uint16_t key_int = route(keyHash(key));
+    if (is_local(key_int)) {
+        return LocalGetWithCallback<Ret, CB_Args...>(key, cb_name, std::forward<CB_Args>(cb_args)...);
+    } else {
+        ForgetLease(key);
+        typedef std::pair<bool, Ret> ret_type;
+        return RPC_CALL_WRAPPER_CB(func_prefix+"_GetWithCallback_"+cb_name, key_int, ret_type, key);
+    }
+}
+
+template<typename KeyType, typename MappedType, typename Hash, typename Allocator ,typename SharedType, typename Partitioner>
+void unordered_map<KeyType, MappedType, Hash, Allocator, SharedType, Partitioner>::bind_functions() {
+    rpc->bind_method(func_prefix+"_Put", this, &unordered_map::LocalPut);
+    rpc->bind_method(func_prefix+"_PutWithTTL", this, &unordered_map::LocalPutWithTTL);
+    rpc->bind_method(func_prefix+"_Get", this, &unordered_map::LocalGet);
+    rpc->bind_method(func_prefix+"_GetLeased", this, &unordered_map::LocalGetLeased);
+    rpc->bind_method(func_prefix+"_Erase", this, &unordered_map::LocalErase);
+    rpc->bind_method(func_prefix+"_GetAllData", this, &unordered_map::LocalGetAllDataInServer);
+    rpc->bind_method(func_prefix+"_PutBatch", this, &unordered_map::LocalPutBatch);
+    rpc->bind_method(func_prefix+"_GetBatch", this, &unordered_map::LocalGetBatch);
+    rpc->bind_method(func_prefix+"_EraseBatch", this, &unordered_map::LocalEraseBatch);
+    rpc->bind_method(func_prefix+"_Evictions", this, &unordered_map::LocalEvictions);
+    if (dynamic) {
+        rpc->bind_method(func_prefix+"_Membership", this, &unordered_map::LocalMembership);
+        rpc->bind_method(func_prefix+"_Prepare", this, &unordered_map::LocalPrepare);
+        rpc->bind_method(func_prefix+"_Migrate", this, &unordered_map::LocalMigrate);
+        rpc->bind_method(func_prefix+"_Migrated", this, &unordered_map::LocalMigrated);
+        rpc->bind_method(func_prefix+"_Commit", this, &unordered_map::LocalCommit);
+        rpc->bind_method(func_prefix+"_Return", this, &unordered_map::LocalReturn);
+        rpc->bind_method(func_prefix+"_Abort", this, &unordered_map::LocalAbort);
+        rpc->bind_method(func_prefix+"_MoveBack", this, &unordered_map::LocalMoveBack);
+        rpc->bind_method(func_prefix+"_MoveIn", this, &unordered_map::LocalMoveIn);
+    }
+    if (replicator) {
+        rpc->bind_method(func_prefix+"_Apply", this, &unordered_map::LocalApply);
+        rpc->bind_method(func_prefix+"_GetReplica", this, &unordered_map::LocalGetReplica);
+    }
+    bind_segment_functions();
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-            {
-
-     std::function<void(const tl::request &, KeyType &, MappedType &)> putFunc(
-            std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::ThalliumLocalPut, this,
-                      std::placeholders::_1, std::placeholders::_2,
-                      std::placeholders::_3));
-        // std::function<void(const tl::request &, tl::bulk &, KeyType &)> putFunc(
-        //     std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::ThalliumLocalPut, this,
-        //               std::placeholders::_1, std::placeholders::_2,
-        //               std::placeholders::_3));
-        std::function<void(const tl::request &, KeyType &)> getFunc(
-            std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::ThalliumLocalGet, this,
-                      std::placeholders::_1, std::placeholders::_2));
-        std::function<void(const tl::request &, KeyType &)> eraseFunc(
-            std::bind(&unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::ThalliumLocalErase, this,
-                      std::placeholders::_1, std::placeholders::_2));
-        std::function<void(const tl::request &)>
-                getAllDataInServerFunc(std::bind(
-                    &unordered_map<KeyType, MappedType, Hash, Allocator, SharedType>::ThalliumLocalGetAllDataInServer,
-                    this, std::placeholders::_1));
-
-        rpc->bind(func_prefix+"_Put", putFunc);
-        rpc->bind(func_prefix+"_Get", getFunc);
-        rpc->bind(func_prefix+"_Erase", eraseFunc);
-        rpc->bind(func_prefix+"_GetAllData", getAllDataInServerFunc);
-	break;
+    if constexpr (bulk_transferable && RPC::transport::implementation != RPCLIB) {
+        /* bulk handlers respond themselves since they need the request of the client */
+        std::function<void(const tl::request &, hcl::wire_t<KeyType> &, tl::bulk &)> putBulkFunc(
+            std::bind(&unordered_map::ThalliumLocalPutBulk, this,
+                      std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        std::function<void(const tl::request &, hcl::wire_t<KeyType> &, tl::bulk &)> getBulkFunc(
+            std::bind(&unordered_map::ThalliumLocalGetBulk, this,
+                      std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        rpc->bind(func_prefix+"_PutBulk", putBulkFunc);
+        rpc->bind(func_prefix+"_GetBulk", getBulkFunc);
     }
 #endif
-    }
 }
 
 #endif  // INCLUDE_HCL_UNORDERED_MAP_UNORDERED_MAP_CPP_
@@ -26,6 +26,18 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <type_traits>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
 
 #include <hcl/communication/rpc_lib.h>
 #include <hcl/communication/rpc_factory.h>
@@ -53,6 +65,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/interprocess/managed_mapped_file.hpp>
 #include <hcl/common/container.h>
+#include <hcl/common/lease_cache.h>
+#include <hcl/common/partitioner.h>
+#include <hcl/common/replicator.h>
 
 /** Namespaces Uses **/
 
@@ -64,76 +79,354 @@ namespace hcl {
  * achieve the data structure.
  *
  * @tparam MappedType, the value of the HashMap
+ * @tparam Partitioner, maps the hash of a key to its server (see partitioner.h)
  */
-template<typename KeyType, typename MappedType,typename Hash = std::hash<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t>
+template<typename KeyType, typename MappedType,typename Hash = std::hash<KeyType>, class Allocator=nullptr_t ,class SharedType=nullptr_t,
+         typename Partitioner = ring_partitioner>
 class unordered_map:public container {
+    static_assert(!Partitioner::ordered, "hcl::unordered_map requires a hash partitioner, range partitioning is for hcl::map");
   private:
+    /*
+     * A stored value. last_access orders entries for eviction: the shard tick
+     * of the last access with EVICT_LRU, the reference bit with EVICT_CLOCK.
+     * It is atomic since readers update it under a shared lock. expires_at is
+     * a time of container::now_ms, or 0. version identifies the value for the
+     * lease caches of clients, see LocalGetLeased.
+     */
+    struct Entry {
+        MappedType value;
+        std::atomic<uint64_t> last_access;
+        really_long expires_at;
+        uint64_t version;
+        template<typename Value>
+        Entry(Value &&value_, uint64_t last_access_, really_long expires_at_, uint64_t version_)
+                : value(std::forward<Value>(value_)), last_access(last_access_), expires_at(expires_at_),
+                  version(version_) {}
+        Entry(const Entry &other) : value(other.value), last_access(other.last_access.load(std::memory_order_relaxed)),
+                                    expires_at(other.expires_at), version(other.version) {}
+        Entry &operator=(const Entry &other) {
+            value = other.value;
+            last_access.store(other.last_access.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            expires_at = other.expires_at;
+            version = other.version;
+            return *this;
+        }
+    };
+    /*
+     * Bounds and eviction state of a shard, in the segment next to it so that
+     * same node clients evict consistently with the server. The bounds are
+     * those of the whole server, see ServerUsage. The counters change under
+     * the exclusive lock of the shard, except tick and evictions.
+     */
+    struct ShardState {
+        uint64_t capacity_entries;
+        really_long capacity_bytes;
+        EvictionPolicy policy;
+        uint64_t entries;
+        really_long bytes;
+        /* next bucket the eviction looks at */
+        size_t hand;
+        /* writes so far, the version of the last written value */
+        uint64_t writes;
+        std::atomic<uint64_t> tick;
+        std::atomic<uint64_t> evictions;
+        ShardState(uint64_t capacity_entries_, really_long capacity_bytes_, EvictionPolicy policy_, uint64_t writes_)
+                : capacity_entries(capacity_entries_), capacity_bytes(capacity_bytes_), policy(policy_),
+                  entries(0), bytes(0), hand(0), writes(writes_), tick(0), evictions(0) {}
+        bool bounded() const { return capacity_entries != 0 || capacity_bytes != 0; }
+    };
+    /* Entries and bytes of all shards of the server, without the copies, which the bounds apply to. */
+    struct ServerUsage {
+        std::atomic<uint64_t> entries;
+        std::atomic<really_long> bytes;
+        ServerUsage() : entries(0), bytes(0) {}
+    };
+    /* entries EVICT_LRU compares to pick the least recently used one */
+    static constexpr size_t lru_samples = 8;
     /** Class Typedefs for ease of use **/
-    typedef std::pair<const KeyType, MappedType> ValueType;
+    typedef std::pair<const KeyType, Entry> ValueType;
     typedef boost::interprocess::allocator<ValueType, boost::interprocess::managed_mapped_file::segment_manager> ShmemAllocator;
     typedef boost::interprocess::managed_mapped_file managed_segment;
-    typedef boost::unordered::unordered_map<KeyType, MappedType, Hash,
+    typedef boost::unordered::unordered_map<KeyType, Entry, Hash,
                                                                 std::equal_to<KeyType>,
                                                                 ShmemAllocator>
                                                                 MyHashMap;
     /** Class attributes**/
     Hash keyHash;
+    Partitioner partitioner;
+    /*
+     * The table is split in num_shards tables, each guarded by its own mutex,
+     * so that operations on keys of different shards run in parallel.
+     */
+    uint16_t num_shards;
     MyHashMap *myHashMap;
+    Mutex *shard_mutexes;
+    ShardState *shard_states;
+    ServerUsage *usage;
+    /* copied from HCL_CONF at construction to keep it off the Put/Get path */
+    size_t bulk_transfer_threshold;
+    /* next bucket of each shard SweepExpired looks at, on servers */
+    std::vector<size_t> sweep_hands;
+    /* values of remote Gets, with CLIENT_CACHE_LEASE_MS */
+    std::unique_ptr<LeaseCache<KeyType, MappedType, Hash>> lease_cache;
+    inline void ForgetLease(const KeyType &key) {
+        if (lease_cache) lease_cache->Forget(key);
+    }
+    std::pair<bool, MappedType> GetLeased(KeyType &key, uint16_t key_int);
+    /*
+     * Servers of the container, see Join. Without DYN_CONFIG they are the
+     * server list and never change. partitioner, members and the state of a
+     * move change under the exclusive routing_mutex. While keys move,
+     * next_partitioner tells where they go and moved_shards which shards of
+     * this server already handed theirs over (a ShardMove). A shard marks
+     * itself handing over together with its last changes under its exclusive
+     * lock and sends them after releasing it; operations on the leaving keys
+     * wait on handed_over meanwhile, so none is forwarded before the changes
+     * arrived, while the keys that stay are served. When a change is aborted, the servers
+     * take the moved keys back, and returned_shards tells which shards of
+     * which servers took theirs from this one.
+     */
+    bool dynamic;
+    std::shared_mutex routing_mutex;
+    std::vector<uint16_t> members;
+    uint64_t membership_epoch;
+    std::unique_ptr<Partitioner> next_partitioner;
+    std::vector<uint16_t> next_members;
+    uint64_t next_epoch;
+    std::vector<uint8_t> moved_shards;
+    std::condition_variable_any handed_over;
+    std::set<std::pair<uint16_t, uint16_t>> returned_shards;
+    std::shared_future<bool> migration;
+    std::atomic<bool> migration_cancelled;
+    /* The server owning a key, as this process knows it. */
+    inline uint16_t route(size_t key_hash) {
+        if (!dynamic) return partitioner(key_hash);
+        std::shared_lock<std::shared_mutex> lock(routing_mutex);
+        return partitioner(key_hash);
+    }
+    /* The servers of count keys, routed together, and a bound of the indices of the servers. */
+    template<typename GetKey>
+    std::vector<uint16_t> RouteAll(size_t count, GetKey get_key, size_t &server_slots);
+    /* Run call with the server of a key; once more if that server failed and the servers changed. */
+    template<typename Call>
+    auto Routed(size_t key_hash, Call &&call) -> decltype(call(uint16_t()));
+    /* The server an operation arriving here belongs to, my_server unless its key moved; lock, the shard lock, is held. */
+    template<typename Lock>
+    uint16_t Redirect(uint16_t shard, const KeyType &key, Lock &lock);
+    bool AdoptMembership(std::pair<uint64_t, std::vector<uint16_t>> &membership, bool force);
+    /* Ask the servers which of them serve the container; true if that changed here. */
+    bool RefreshMembership(bool force = false);
+    /* entries moving to one server, and keys sent to it before that were erased since */
+    struct Outgoing {
+        std::vector<std::pair<KeyType, MappedType>> entries;
+        std::vector<really_long> ttl_ms;
+        std::vector<KeyType> erased;
+    };
+    bool SendEntries(std::map<uint16_t, Outgoing> &outgoing);
+    bool MigrateShard(uint16_t shard);
+    bool MigrateShards();
+    bool ReturnShard(uint16_t shard, uint64_t epoch, std::vector<uint16_t> &servers);
+    uint8_t MigrationStep(uint16_t server, uint64_t epoch, really_long &silent_since);
+    bool MembershipStep(uint16_t server, bool (unordered_map::*local)(uint64_t), const char *step, uint64_t epoch);
+    bool Rebalance(std::vector<uint16_t> servers);
+    bool StoreEntries(uint16_t first_shard, std::vector<std::pair<KeyType, MappedType>> &entries,
+                      std::vector<really_long> &ttl_ms, std::vector<KeyType> &erased);
+    /*
+     * With a replication factor above 1, the servers following the primary of
+     * a key on the ring keep copies of it in the shards num_shards.. of their
+     * segment, which holds table_sets times num_shards shards. The primary
+     * queues every change of its keys, evictions and expirations included,
+     * for them, so the copies never evict on their own. Only servers queue
+     * changes, so clients on their node use RPC.
+     */
+    struct Change {
+        KeyType key;
+        MappedType value;
+        really_long expires_at;
+        bool erased;
+    };
+    uint16_t table_sets;
+    std::unique_ptr<Replicator<Change>> replicator;
+    /* Queue the entry of key, or its erase if entry is null, for the backups; the shard lock is held. */
+    void Replicate(const KeyType &key, const Entry *entry, std::vector<std::future<bool>> &applied);
+    bool SendChanges(uint16_t server, std::vector<Change> &changes);
+    /* The server a Get of a key goes to; with a lease cache the primary, which the versions come from. */
+    inline uint16_t ReadServer(size_t key_hash, uint16_t primary) {
+        if (!replicator || lease_cache) return primary;
+        return replicator->Reader(partitioner.replicas(key_hash, replicator->Copies()));
+    }
+    std::pair<bool, MappedType> GetReplica(KeyType &key, uint16_t server);
+    /* Shards use what the partitioner left of the hash, so that the keys of one server spread over all of them. */
+    inline uint16_t get_shard(const KeyType &key) {
+        return static_cast<uint16_t>(partitioner.local_hash(keyHash(key)) % num_shards);
+    }
+    /* Indices 0..count-1 grouped by the shard of their key, so batches take each shard lock once. */
+    template<typename GetKey>
+    std::vector<std::vector<size_t>> GroupByShard(size_t count, GetKey get_key) {
+        std::vector<std::vector<size_t>> shard_indices(num_shards);
+        for (size_t i = 0; i < count; ++i) shard_indices[get_shard(get_key(i))].push_back(i);
+        return shard_indices;
+    }
+    /* Record an access of entry for eviction; a no-op for unbounded shards. */
+    inline void Touch(uint16_t shard, Entry &entry) {
+        ShardState &state = shard_states[shard];
+        if (!state.bounded()) return;
+        if (state.policy == EVICT_LRU)
+            entry.last_access.store(state.tick.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else if (entry.last_access.load(std::memory_order_relaxed) == 0)
+            entry.last_access.store(1, std::memory_order_relaxed);
+    }
+    /* Find key in a shard, as end() once it expired. */
+    inline typename MyHashMap::iterator FindLive(uint16_t shard, const KeyType &key) {
+        auto iterator = myHashMap[shard].find(key);
+        if (iterator != myHashMap[shard].end() && is_expired(iterator->second.expires_at))
+            return myHashMap[shard].end();
+        return iterator;
+    }
+    typename MyHashMap::iterator InsertEntry(uint16_t shard, KeyType &key, MappedType &data,
+                                             really_long expires_at = 0);
+    bool EraseEntry(uint16_t shard, const KeyType &key);
+    void RemoveEntry(uint16_t shard, typename MyHashMap::iterator iterator);
+    void Evict(uint16_t shard, const KeyType &keep);
+    bool EvictOne(uint16_t shard, const KeyType &keep);
+    void SweepExpired();
   public:
-    really_long size_occupied;
+    std::atomic<really_long> size_occupied;
     ~unordered_map();
 
-    explicit unordered_map(CharStruct name_ = std::string("TEST_UNORDERED_MAP"), uint16_t port=HCL_CONF->RPC_PORT);
-    MyHashMap* data(){
-        if(server_on_node || is_server) return myHashMap;
-        else nullptr;
+    explicit unordered_map(CharStruct name_ = std::string("TEST_UNORDERED_MAP"), uint16_t port=HCL_CONF->RPC_PORT,
+                           ReplicationOptions replication = ReplicationOptions());
+    /* The table of one of the shards() shards, whose entries hold the value in Entry::value. */
+    MyHashMap* data(uint16_t shard){
+        if(server_on_node || is_server) return myHashMap + shard;
+        else return nullptr;
     }
+    uint16_t shards() const { return num_shards; }
 
     void construct_shared_memory() override{
-        /* Construct unordered_map in the shared memory space. */
-        myHashMap = segment.construct<MyHashMap>(name.c_str())(
+        /* Construct the shards of the unordered_map and their mutexes in the shared memory space. */
+        myHashMap = segment.construct<MyHashMap>(name.c_str())[num_shards * table_sets](
                 128, Hash(), std::equal_to<KeyType>(),
                 segment.get_allocator<ValueType>());
-
+        shard_mutexes = segment.construct<Mutex>("shard_mtx")[num_shards * table_sets]();
+        shard_states = segment.construct<ShardState>("shard_state")[num_shards * table_sets](
+                HCL_CONF->CACHE_CAPACITY_ENTRIES, HCL_CONF->CACHE_CAPACITY_BYTES,
+                HCL_CONF->CACHE_EVICTION_POLICY, first_version());
+        usage = segment.construct<ServerUsage>("server_usage")();
     }
 
     void open_shared_memory() override;
 
+    void recover_shared_memory() override;
+
     void bind_functions() override;
 
     bool LocalPut(KeyType &key, MappedType &data);
+    bool LocalPutWithTTL(KeyType &key, MappedType &data, really_long ttl_ms);
     std::pair<bool, MappedType> LocalGet(KeyType &key);
+    std::pair<uint64_t, MappedType> LocalGetLeased(KeyType &key, uint64_t known_version);
+    /**
+     * Run visitor(const MappedType &) on the value in the segment, under the
+     * read lock of its shard, instead of copying it out. The reference must
+     * not escape visitor, and visitor must not call into this container.
+     */
+    template<typename Visitor>
+    bool LocalGetView(KeyType &key, Visitor &&visitor);
     std::pair<bool, MappedType> LocalErase(KeyType &key);
     std::vector<std::pair<KeyType, MappedType>> LocalGetAllDataInServer();
+    bool LocalPutBatch(std::vector<std::pair<KeyType, MappedType>> &data);
+    std::vector<std::pair<bool, MappedType>> LocalGetBatch(std::vector<KeyType> &keys);
+    std::vector<std::pair<bool, MappedType>> LocalEraseBatch(std::vector<KeyType> &keys);
+    really_long LocalEvictions();
+    std::pair<uint64_t, std::vector<uint16_t>> LocalMembership();
+    bool LocalPrepare(uint64_t epoch, std::vector<uint16_t> &servers);
+    bool LocalMigrate(uint64_t epoch);
+    uint8_t LocalMigrated(uint64_t epoch);
+    bool LocalCommit(uint64_t epoch);
+    bool LocalReturn(uint64_t epoch);
+    bool LocalAbort(uint64_t epoch);
+    std::pair<std::vector<std::pair<KeyType, MappedType>>, std::vector<really_long>> LocalMoveBack(uint64_t epoch,
+                                                                                                  uint16_t server,
+                                                                                                  uint16_t shard);
+    bool LocalMoveIn(std::vector<std::pair<KeyType, MappedType>> &entries, std::vector<really_long> &ttl_ms,
+                     std::vector<KeyType> &erased);
+    bool LocalApply(std::vector<std::pair<KeyType, MappedType>> &entries, std::vector<really_long> &ttl_ms,
+                    std::vector<KeyType> &erased);
+    std::pair<bool, MappedType> LocalGetReplica(KeyType &key);
 
 #if defined(HCL_ENABLE_THALLIUM_TCP) || defined(HCL_ENABLE_THALLIUM_ROCE)
-    THALLIUM_DEFINE(LocalPut, (key,data) ,KeyType &key, MappedType &data)
-
-    // void ThalliumLocalPut(const tl::request &thallium_req, tl::bulk &bulk_handle, KeyType key) {
-    //     MappedType data = rpc->prep_rdma_server<MappedType>(thallium_req.get_endpoint(), bulk_handle);
-    //     thallium_req.respond(LocalPut(key, data));
-    // }
-
-    // void ThalliumLocalGet(const tl::request &thallium_req, KeyType key) {
-    //     auto retpair = LocalGet(key);
-    //     if (!retpair.first) {
-    //         printf("error\n");
-    //     }
-    //     MappedType data = retpair.second;
-    //     tl::bulk bulk_handle = rpc->prep_rdma_client<MappedType>(data);
-    //     thallium_req.respond(bulk_handle);
-    // }
-
-    THALLIUM_DEFINE(LocalGet, (key), KeyType &key)
-    THALLIUM_DEFINE(LocalErase, (key), KeyType &key)
-    THALLIUM_DEFINE1(LocalGetAllDataInServer)
+    /**
+     * Values of plain trivially copyable types are moved with Thallium bulk
+     * transfers instead of the argument serializer once they reach
+     * HCL_CONF->BULK_TRANSFER_THRESHOLD bytes.
+     */
+    static constexpr bool bulk_transferable =
+            std::is_trivially_copyable<MappedType>::value && std::is_same<Allocator, nullptr_t>::value;
+    bool use_bulk_transfer() const {
+        return bulk_transferable && RPC::transport::implementation != RPCLIB &&
+               sizeof(MappedType) >= bulk_transfer_threshold;
+    }
+    bool LocalPutBulk(const tl::request &thallium_req, KeyType &key, tl::bulk &bulk_handle);
+    bool LocalGetBulk(const tl::request &thallium_req, KeyType &key, tl::bulk &bulk_handle);
+    /* keys arrive the way RPC::call sends them, see wire.h */
+    void ThalliumLocalPutBulk(const tl::request &thallium_req, hcl::wire_t<KeyType> &key, tl::bulk &bulk_handle) {
+        thallium_req.respond(LocalPutBulk(thallium_req, hcl::from_wire(key), bulk_handle));
+    }
+    void ThalliumLocalGetBulk(const tl::request &thallium_req, hcl::wire_t<KeyType> &key, tl::bulk &bulk_handle) {
+        thallium_req.respond(LocalGetBulk(thallium_req, hcl::from_wire(key), bulk_handle));
+    }
+
 #endif
 
     bool Put(KeyType key, MappedType data);
+    /* The entry expires after ttl: Get and GetAllData no longer return it and the server reclaims it. */
+    bool Put(KeyType key, MappedType data, std::chrono::milliseconds ttl);
     std::pair<bool, MappedType> Get(KeyType &key);
+    /* LocalGetView on the node of the server, visitor on a copy of the value elsewhere. */
+    template<typename Visitor>
+    bool GetView(KeyType &key, Visitor &&visitor);
     std::pair<bool, MappedType> Erase(KeyType &key);
+    std::future<bool> AsyncPut(KeyType key, MappedType data);
+    std::future<std::pair<bool, MappedType>> AsyncGet(KeyType &key);
+    std::future<std::pair<bool, MappedType>> AsyncErase(KeyType &key);
+    bool PutBatch(std::vector<std::pair<KeyType, MappedType>> &data);
+    std::vector<std::pair<bool, MappedType>> GetBatch(std::vector<KeyType> &keys);
+    std::vector<std::pair<bool, MappedType>> EraseBatch(std::vector<KeyType> &keys);
     std::vector<std::pair<KeyType, MappedType>> GetAllData();
     std::vector<std::pair<KeyType, MappedType>> GetAllDataInServer();
+    /* entries evicted by the bounds of CACHE_CAPACITY_ENTRIES/BYTES on all servers */
+    really_long Evictions();
+    /* the servers of the container, as this process knows them */
+    std::vector<uint16_t> Members();
+
+    /**
+     * With DYN_CONFIG, add this server, which must be in the server list, to
+     * the servers of the container, or remove it. The keys changing owner
+     * stream to their new servers while all of them keep serving; a server
+     * receiving an operation on a key it handed over forwards it. A server
+     * that left keeps forwarding until it is destroyed, which should be once
+     * clients had MEMBERSHIP_REFRESH_MS to notice. One change at a time.
+     * @return false if the change could not be made or some entries could not be moved.
+     */
+    bool Join();
+    bool Leave();
+
+    /**
+     * Callbacks run on the server owning the key, on the stored value and
+     * under the exclusive lock of its shard, since they may modify it; only
+     * their result is sent back. The CB_Args of a call have to match the
+     * ones the callback was bound with.
+     */
+    template<typename Ret, typename... CB_Args>
+    void BindCallback(CharStruct cb_name, std::function<Ret(MappedType &, CB_Args...)> callback);
+    template<typename Ret, typename... CB_Args>
+    std::pair<bool, Ret> LocalPutWithCallback(KeyType &key, MappedType &data, CharStruct cb_name, CB_Args... cb_args);
+    template<typename Ret, typename... CB_Args>
+    std::pair<bool, Ret> LocalGetWithCallback(KeyType &key, CharStruct cb_name, CB_Args... cb_args);
+    template<typename Ret, typename... CB_Args>
+    std::pair<bool, Ret> PutWithCallback(KeyType key, MappedType data, CharStruct cb_name, CB_Args... cb_args);
+    template<typename Ret, typename... CB_Args>
+    std::pair<bool, Ret> GetWithCallback(KeyType &key, CharStruct cb_name, CB_Args... cb_args);
 };
 
 #include "unordered_map.cpp"
@@ -0,0 +1,220 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <functional>
+#include <utility>
+#include <mpi.h>
+#include <iostream>
+#include <signal.h>
+#include <execinfo.h>
+#include <chrono>
+#include <map>
+#include <algorithm>
+#include <hcl/common/data_structures.h>
+#include <hcl/flat_unordered_map/flat_unordered_map.h>
+#include "check.h"
+#include "keys.h"
+
+int main (int argc,char* argv[])
+{
+    int provided;
+    MPI_Init_thread(&argc,&argv, MPI_THREAD_MULTIPLE, &provided);
+    if (provided < MPI_THREAD_MULTIPLE) {
+        printf("Didn't receive appropriate MPI threading specification\n");
+        exit(EXIT_FAILURE);
+    }
+    int comm_size,my_rank;
+    MPI_Comm_size(MPI_COMM_WORLD,&comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD,&my_rank);
+    int ranks_per_server=comm_size,num_request=100;
+    long size_of_request=1000;
+    bool debug=false;
+    bool server_on_node=false;
+    if(argc > 1)    ranks_per_server = atoi(argv[1]);
+    if(argc > 2)    num_request = atoi(argv[2]);
+    if(argc > 3)    size_of_request = (long)atol(argv[3]);
+    if(argc > 4)    server_on_node = (bool)atoi(argv[4]);
+    if(argc > 5)    debug = (bool)atoi(argv[5]);
+
+    int len;
+    char processor_name[MPI_MAX_PROCESSOR_NAME];
+    MPI_Get_processor_name(processor_name, &len);
+    if (debug) {
+        printf("%s/%d: %d\n", processor_name, my_rank, getpid());
+    }
+
+    if(debug && my_rank==0){
+        printf("%d ready for attach\n", comm_size);
+        fflush(stdout);
+        getchar();
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    bool is_server=(my_rank+1) % ranks_per_server == 0;
+    int my_server=my_rank / ranks_per_server;
+    int num_servers=comm_size/ranks_per_server;
+    std::string proc_name = std::string(processor_name);
+    size_t size_of_elem = sizeof(int);
+
+    printf("rank %d, is_server %d, my_server %d, num_servers %d\n",my_rank,is_server,my_server,num_servers);
+
+    const int array_size=TEST_REQUEST_SIZE;
+
+    if (size_of_request != array_size) {
+        printf("Please set TEST_REQUEST_SIZE in include/hcl/common/constants.h instead. Testing with %d\n", array_size);
+    }
+
+    std::array<int,array_size> my_vals=std::array<int,array_size>();
+
+
+    HCL_CONF->IS_SERVER = is_server;
+    HCL_CONF->MY_SERVER = my_server;
+    HCL_CONF->NUM_SERVERS = num_servers;
+    HCL_CONF->SERVER_ON_NODE = server_on_node || is_server;
+    HCL_CONF->SERVER_LIST_PATH = "./server_list";
+
+    typedef hcl::flat_unordered_map<size_t,std::array<int,array_size>> flat_map;
+    /* a table of the default capacity, and one small enough to fill */
+    const size_t small_capacity = 64;
+    flat_map *map, *small_map;
+    if (is_server) {
+        map = new flat_map();
+        small_map = new flat_map("TEST_FLAT_SMALL_MAP", HCL_CONF->RPC_PORT, small_capacity);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!is_server) {
+        map = new flat_map();
+        small_map = new flat_map("TEST_FLAT_SMALL_MAP", HCL_CONF->RPC_PORT, small_capacity);
+    }
+
+    MPI_Comm client_comm;
+    bool is_client = true;
+    int client_comm_size = 1;
+    int client_rank = 0;
+    if(comm_size > 1){
+        MPI_Comm_split(MPI_COMM_WORLD, !is_server, my_rank, &client_comm);
+        MPI_Comm_size(client_comm, &client_comm_size);
+        MPI_Comm_rank(client_comm, &client_rank);
+        is_client = !is_server;
+    }else{
+        client_comm=MPI_COMM_WORLD;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (is_client) {
+        /* Get returns what Put stored, on this server and the others */
+        const size_t checked_keys = std::min<size_t>(num_request, map->Capacity() / (2 * client_comm_size));
+        auto check_key = [&](size_t i) { return (size_t)client_rank * checked_keys + i; };
+        std::array<int, array_size> val = my_vals;
+        for (size_t i = 0; i < checked_keys; i++) {
+            val[0] = (int)i;
+            CHECK(map->Put(check_key(i), val));
+        }
+        for (size_t i = 0; i < checked_keys; i++) {
+            size_t key = check_key(i);
+            auto result = map->Get(key);
+            CHECK(result.first && result.second[0] == (int)i);
+        }
+
+        /* an erased key is gone until it is put again */
+        for (size_t i = 0; i < checked_keys; i += 2) {
+            size_t key = check_key(i);
+            auto erased = map->Erase(key);
+            CHECK(erased.first && erased.second[0] == (int)i);
+            CHECK(!map->Get(key).first);
+            CHECK(!map->Erase(key).first);
+        }
+        for (size_t i = 1; i < checked_keys; i += 2) {
+            size_t key = check_key(i);
+            CHECK(map->Get(key).first);
+        }
+        for (size_t i = 0; i < checked_keys; i += 2) {
+            size_t key = check_key(i);
+            val[0] = (int)i + 1;
+            CHECK(map->Put(key, val));
+            auto result = map->Get(key);
+            CHECK(result.first && result.second[0] == (int)i + 1);
+        }
+
+        /*
+         * Put fails once the table of a server is full, the keys it holds stay
+         * writable and readable. Erasing all of them makes room for as many
+         * new keys, round after round.
+         */
+        if (client_rank == 0) {
+            size_t capacity = small_map->Capacity();
+            size_t next_key = 0;
+            for (int round = 0; round < 3; round++) {
+                std::vector<size_t> stored;
+                for (int server = 0; server < num_servers; server++) {
+                    size_t key = next_key;
+                    for (size_t i = 0; i <= capacity; i++) {
+                        key = key_on_server(server, num_servers, key + 1);
+                        val[0] = (int)key;
+                        if (i < capacity) {
+                            CHECK(small_map->Put(key, val));
+                            stored.push_back(key);
+                        } else {
+                            CHECK(!small_map->Put(key, val));
+                        }
+                    }
+                    next_key = std::max(next_key, key);
+                }
+                for (size_t key : stored) {
+                    val[0] = (int)key;
+                    CHECK(small_map->Put(key, val));
+                    auto result = small_map->Get(key);
+                    CHECK(result.first && result.second[0] == (int)key);
+                }
+                for (size_t key : stored) {
+                    auto erased = small_map->Erase(key);
+                    CHECK(erased.first && erased.second[0] == (int)key);
+                }
+                CHECK(small_map->GetAllData().empty());
+            }
+            printf("put, get, erase and full table: ok\n");
+        }
+        MPI_Barrier(client_comm);
+
+        Timer distinct_map_timer=Timer();
+        /*Local map test on distinct keys of the same server: no lock is shared between the ranks*/
+        size_t distinct_keys = std::min<size_t>(num_request, map->Capacity() / (2 * client_comm_size));
+        size_t key = (size_t)(client_rank + 1) << 36;
+        for(size_t i=0;i<distinct_keys;i++){
+            key = key_on_server(my_server, num_servers, key + 1);
+            distinct_map_timer.resumeTime();
+            map->Put(key,my_vals);
+            distinct_map_timer.pauseTime();
+        }
+        double distinct_map_throughput=distinct_keys/distinct_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        double distinct_put_tp_result;
+        if (client_comm_size > 1) {
+            MPI_Reduce(&distinct_map_throughput, &distinct_put_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
+        }
+        else {
+            distinct_put_tp_result = distinct_map_throughput;
+        }
+
+        if (my_rank==0) {
+            printf("local_map_throughput put (distinct keys, %d ranks, aggregate): %f\n", client_comm_size, distinct_put_tp_result);
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    delete(small_map);
+    delete(map);
+    MPI_Finalize();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,35 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HCL_TEST_KEYS_H
+#define HCL_TEST_KEYS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <hcl/common/partitioner.h>
+
+/*
+ * The first integer key from first on that a container of num_servers servers
+ * places on server, for the local and remote phases of the tests. The keys of
+ * the tests hash like their integer; num_servers is the same on every call.
+ */
+template<typename Partitioner = hcl::ring_partitioner>
+size_t key_on_server(uint16_t server, uint16_t num_servers, size_t first = 0) {
+    static Partitioner partitioner(num_servers);
+    std::hash<size_t> hash;
+    size_t key = first;
+    while (partitioner(hash(key)) != server) ++key;
+    return key;
+}
+
+#endif  // HCL_TEST_KEYS_H
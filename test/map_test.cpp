@@ -20,9 +20,12 @@
 #include <signal.h>
 #include <execinfo.h>
 #include <chrono>
+#include <thread>
 #include <map>
 #include <hcl/common/data_structures.h>
 #include <hcl/map/map.h>
+#include "check.h"
+#include "keys.h"
 
 struct KeyType{
     size_t a;
@@ -134,6 +137,10 @@ int main (int argc,char* argv[])
     HCL_CONF->SERVER_ON_NODE = server_on_node || is_server;
     HCL_CONF->SERVER_LIST_PATH = "./server_list";
 
+    /* keys the partitioner of the containers places on this server and on the next one */
+    size_t local_key = key_on_server(my_server, num_servers);
+    size_t remote_key = key_on_server((my_server + 1) % num_servers, num_servers);
+
     hcl::map<KeyType,std::array<int, array_size>> *map;
     if (is_server) {
         map = new hcl::map<KeyType,std::array<int,array_size>>();
@@ -162,7 +169,7 @@ int main (int argc,char* argv[])
         std::hash<KeyType> keyHash;
         /*Local std::map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_map_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -174,7 +181,7 @@ int main (int argc,char* argv[])
 
         Timer llocal_get_map_timer=Timer();
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_get_map_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -193,7 +200,7 @@ int main (int argc,char* argv[])
         Timer local_map_timer=Timer();
         /*Local map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_map_timer.resumeTime();
             map->Put(key,my_vals);
@@ -204,7 +211,7 @@ int main (int argc,char* argv[])
         Timer local_get_map_timer=Timer();
         /*Local map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_get_map_timer.resumeTime();
             auto result = map->Get(key);
@@ -237,7 +244,7 @@ int main (int argc,char* argv[])
         Timer remote_map_timer=Timer();
         /*Remote map test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_map_timer.resumeTime();
             map->Put(key
@@ -251,7 +258,7 @@ int main (int argc,char* argv[])
         Timer remote_get_map_timer=Timer();
         /*Remote map test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_get_map_timer.resumeTime();
             map->Get(key);
@@ -277,8 +284,162 @@ int main (int argc,char* argv[])
             printf("remote map throughput (put): %f\n",remote_put_tp_result);
             printf("remote map throughput (get): %f\n",remote_get_tp_result);
         }
+
+        MPI_Barrier(client_comm);
+
+        /*Remote batched map test: one RPC per server for the whole batch, of distinct keys spread over the servers*/
+        std::vector<std::pair<KeyType, std::array<int,array_size>>> batch;
+        std::vector<KeyType> batch_keys;
+        batch.reserve(num_request);
+        batch_keys.reserve(num_request);
+        std::array<int,array_size> batch_val = my_vals;
+        for(int i=0;i<num_request;i++){
+            size_t val = ((size_t)1 << 46) + (size_t)my_rank * num_request + i;
+            batch_val[0] = i;
+            batch.emplace_back(KeyType(val), batch_val);
+            batch_keys.push_back(KeyType(val));
+        }
+        Timer batch_map_timer=Timer();
+        batch_map_timer.resumeTime();
+        bool batch_put = map->PutBatch(batch);
+        batch_map_timer.pauseTime();
+        CHECK(batch_put);
+        double batch_map_throughput=num_request/batch_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        Timer batch_get_map_timer=Timer();
+        batch_get_map_timer.resumeTime();
+        auto batch_got = map->GetBatch(batch_keys);
+        batch_get_map_timer.pauseTime();
+        double batch_get_map_throughput=num_request/batch_get_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        /* the results come in the order of the keys */
+        CHECK(batch_got.size() == (size_t)num_request);
+        for (int i = 0; i < num_request; i++) CHECK(batch_got[i].first && batch_got[i].second[0] == i);
+        auto batch_erased = map->EraseBatch(batch_keys);
+        CHECK(batch_erased.size() == (size_t)num_request);
+        for (int i = 0; i < num_request; i++) CHECK(batch_erased[i].first && batch_erased[i].second[0] == i);
+        for (auto &result : map->GetBatch(batch_keys)) CHECK(!result.first);
+
+        double batch_put_tp_result, batch_get_tp_result;
+        if (client_comm_size > 1) {
+            MPI_Reduce(&batch_map_throughput, &batch_put_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
+            batch_put_tp_result /= client_comm_size;
+            MPI_Reduce(&batch_get_map_throughput, &batch_get_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
+            batch_get_tp_result /= client_comm_size;
+        }
+        else {
+            batch_put_tp_result = batch_map_throughput;
+            batch_get_tp_result = batch_get_map_throughput;
+        }
+
+        if(my_rank == 0) {
+            printf("remote map throughput (batch put): %f\n",batch_put_tp_result);
+            printf("remote map throughput (batch get): %f\n",batch_get_tp_result);
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /*Expiration test: keys put with a short time to live are gone from Get and GetAllData once it passed*/
+    if (!is_server) {
+        const int ttl_ms = 100;
+        auto ttl_key = [&](int i, bool expiring) {
+            return KeyType(((size_t)1 << 45) + ((size_t)expiring << 40) + (size_t)my_rank * num_request + i);
+        };
+        std::array<int, array_size> ttl_val = my_vals;
+        for (int i = 0; i < num_request; i++) {
+            KeyType expiring = ttl_key(i, true), kept = ttl_key(i, false);
+            ttl_val[0] = i;
+            CHECK(map->Put(expiring, ttl_val, std::chrono::milliseconds(ttl_ms)));
+            CHECK(map->Put(kept, ttl_val));
+        }
+        MPI_Barrier(client_comm);
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * ttl_ms));
+        for (int i = 0; i < num_request; i++) {
+            KeyType expired = ttl_key(i, true), kept = ttl_key(i, false);
+            CHECK(!map->Get(expired).first);
+            auto result = map->Get(kept);
+            CHECK(result.first && result.second[0] == i);
+        }
+        size_t kept = 0;
+        for (auto &entry : map->GetAllData()) {
+            CHECK(entry.first.a < ((size_t)1 << 45) + ((size_t)1 << 40));
+            if (entry.first.a >= ((size_t)1 << 45)) kept++;
+        }
+        CHECK(kept == (size_t)num_request * client_comm_size);
+        MPI_Barrier(client_comm);
+        if (my_rank == 0) printf("expiration: ok\n");
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /*Range partitioned map test: server i owns the keys [i*keys_per_range, (i+1)*keys_per_range)*/
+    typedef hcl::range_partitioner<KeyType> Ranges;
+    typedef hcl::map<KeyType, std::array<int, array_size>, std::less<KeyType>, nullptr_t, nullptr_t, Ranges> RangeMap;
+    const size_t keys_per_range = 1000;
+    std::vector<KeyType> split_points;
+    for (int i = 1; i < num_servers; ++i) split_points.push_back(KeyType(i * keys_per_range));
+    if (is_server && num_servers > 1) {
+        /* the servers refuse empty split points, and split points other than those of the first server */
+        bool refused = false;
+        try {
+            RangeMap empty_split("TEST_RANGE_MAP_EMPTY", HCL_CONF->RPC_PORT, std::vector<KeyType>());
+        } catch (const std::invalid_argument &) {
+            refused = true;
+        }
+        CHECK(refused);
+        std::vector<KeyType> other_points = split_points;
+        if (my_server != 0) other_points.back() = KeyType(other_points.back().a + 1);
+        refused = false;
+        RangeMap *other_split = nullptr;
+        try {
+            other_split = new RangeMap("TEST_RANGE_MAP_OTHER", HCL_CONF->RPC_PORT, other_points);
+        } catch (const std::runtime_error &) {
+            refused = true;
+        }
+        CHECK(refused == (my_server != 0));
+        /* the first server answers until all others checked */
+        MPI_Barrier(client_comm);
+        delete other_split;
+    }
+    RangeMap *range_map;
+    if (is_server) {
+        range_map = new RangeMap("TEST_RANGE_MAP", HCL_CONF->RPC_PORT, split_points);
+        /* A key of the first range stored on the other servers: a Contains asking them would return it. */
+        if (my_server != 0) {
+            KeyType stray = KeyType(keys_per_range / 2);
+            std::array<int, array_size> stray_val = std::array<int, array_size>();
+            stray_val[0] = -1;
+            range_map->LocalPut(stray, stray_val);
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!is_server) {
+        range_map = new RangeMap("TEST_RANGE_MAP");
+        int client_rank;
+        MPI_Comm_rank(client_comm, &client_rank);
+        for (size_t i = client_rank; i < num_servers * keys_per_range; i += client_comm_size) {
+            KeyType key = KeyType(i);
+            std::array<int, array_size> val = std::array<int, array_size>();
+            val[0] = i;
+            CHECK(range_map->Put(key, val));
+        }
+        MPI_Barrier(client_comm);
+        /* a narrow range in the first server, and one across the first split point */
+        std::vector<std::pair<size_t, size_t>> ranges = {{keys_per_range / 2 - 10, keys_per_range / 2 + 10}};
+        if (num_servers > 1) ranges.push_back({keys_per_range - 5, keys_per_range + 5});
+        for (auto &range : ranges) {
+            KeyType key_start = KeyType(range.first), key_end = KeyType(range.second);
+            auto result = range_map->Contains(key_start, key_end);
+            CHECK(result.size() == range.second - range.first + 1);
+            for (size_t i = 0; i < result.size(); ++i) {
+                CHECK(result[i].first.a == range.first + i);
+                CHECK(result[i].second[0] == (int)(range.first + i));
+            }
+        }
     }
     MPI_Barrier(MPI_COMM_WORLD);
+    delete(range_map);
     delete(map);
     MPI_Finalize();
     exit(EXIT_SUCCESS);
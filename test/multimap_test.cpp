@@ -23,6 +23,7 @@
 #include <map>
 #include <hcl/common/data_structures.h>
 #include <hcl/multimap/multimap.h>
+#include "keys.h"
 
 struct KeyType{
     size_t a;
@@ -134,6 +135,10 @@ int main (int argc,char* argv[])
     HCL_CONF->SERVER_ON_NODE = server_on_node || is_server;
     HCL_CONF->SERVER_LIST_PATH = "./server_list";
 
+    /* keys the partitioner of the containers places on this server and on the next one */
+    size_t local_key = key_on_server(my_server, num_servers);
+    size_t remote_key = key_on_server((my_server + 1) % num_servers, num_servers);
+
     hcl::multimap<KeyType,std::array<int, array_size>> *multimap;
     if (is_server) {
         multimap = new hcl::multimap<KeyType,std::array<int,array_size>>();
@@ -162,7 +167,7 @@ int main (int argc,char* argv[])
         std::hash<KeyType> keyHash;
         /*Local std::multimap test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_multimap_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -178,7 +183,7 @@ int main (int argc,char* argv[])
 
         Timer llocal_get_multimap_timer=Timer();
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_get_multimap_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -197,7 +202,7 @@ int main (int argc,char* argv[])
         Timer local_multimap_timer=Timer();
         /*Local multimap test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_multimap_timer.resumeTime();
             multimap->Put(key,my_vals);
@@ -208,7 +213,7 @@ int main (int argc,char* argv[])
         Timer local_get_multimap_timer=Timer();
         /*Local multimap test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_get_multimap_timer.resumeTime();
             auto result = multimap->Get(key);
@@ -241,7 +246,7 @@ int main (int argc,char* argv[])
         Timer remote_multimap_timer=Timer();
         /*Remote multimap test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_multimap_timer.resumeTime();
             multimap->Put(key
@@ -255,7 +260,7 @@ int main (int argc,char* argv[])
         Timer remote_get_multimap_timer=Timer();
         /*Remote multimap test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_get_multimap_timer.resumeTime();
             multimap->Get(key);
@@ -23,6 +23,7 @@
 #include <set>
 #include <hcl/common/data_structures.h>
 #include <hcl/set/set.h>
+#include "keys.h"
 
 struct KeyType{
     size_t a;
@@ -140,6 +141,10 @@ int main (int argc,char* argv[])
     HCL_CONF->SERVER_ON_NODE = server_on_node || is_server;
     HCL_CONF->SERVER_LIST_PATH = "./server_list";
 
+    /* keys the partitioner of the containers places on this server and on the next one */
+    size_t local_key = key_on_server(my_server, num_servers);
+    size_t remote_key = key_on_server((my_server + 1) % num_servers, num_servers);
+
     hcl::set<KeyType> *set;
     if (is_server) {
         set = new hcl::set<KeyType>();
@@ -168,7 +173,7 @@ int main (int argc,char* argv[])
         std::hash<KeyType> keyHash;
         /*Local std::set test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_set_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -180,7 +185,7 @@ int main (int argc,char* argv[])
 
         Timer llocal_get_set_timer=Timer();
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_get_set_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -200,7 +205,7 @@ int main (int argc,char* argv[])
         uint16_t my_server_key = my_server % num_servers;
         /*Local set test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_set_timer.resumeTime();
             set->Put(key);
@@ -211,7 +216,7 @@ int main (int argc,char* argv[])
         Timer local_get_set_timer=Timer();
         /*Local set test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -247,7 +252,7 @@ int main (int argc,char* argv[])
         /*Remote set test*/
         uint16_t my_server_remote_key = (my_server + 1) % num_servers;
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_set_timer.resumeTime();
             set->Put(key);
@@ -260,7 +265,7 @@ int main (int argc,char* argv[])
         Timer remote_get_set_timer=Timer();
         /*Remote set test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_get_set_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
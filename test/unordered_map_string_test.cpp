@@ -23,6 +23,7 @@
 #include <map>
 #include <hcl/common/data_structures.h>
 #include <hcl/unordered_map/unordered_map.h>
+#include "keys.h"
 
 struct KeyType{
     size_t a;
@@ -124,6 +125,10 @@ int main (int argc,char* argv[])
     HCL_CONF->SERVER_ON_NODE = server_on_node || is_server;
     HCL_CONF->SERVER_LIST_PATH = "./server_list";
 
+    /* keys the partitioner of the containers places on this server and on the next one */
+    size_t local_key = key_on_server(my_server, num_servers);
+    size_t remote_key = key_on_server((my_server + 1) % num_servers, num_servers);
+
     typedef boost::interprocess::allocator<char, boost::interprocess::managed_mapped_file::segment_manager> CharAllocator;
     typedef bip::basic_string<char, std::char_traits<char>, CharAllocator> MappedUnitString;
 
@@ -148,7 +153,7 @@ int main (int argc,char* argv[])
         std::hash<KeyType> keyHash;
         /*Local std::map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_map_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -160,7 +165,7 @@ int main (int argc,char* argv[])
 
         Timer llocal_get_map_timer=Timer();
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_get_map_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -179,7 +184,7 @@ int main (int argc,char* argv[])
         Timer local_map_timer=Timer();
         /*Local map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_map_timer.resumeTime();
             auto result = map->Put(key,my_vals);
@@ -191,7 +196,7 @@ int main (int argc,char* argv[])
         Timer local_get_map_timer=Timer();
         /*Local map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_get_map_timer.resumeTime();
             auto result = map->Get(key);
@@ -226,7 +231,7 @@ int main (int argc,char* argv[])
         Timer remote_map_timer=Timer();
         /*Remote map test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_map_timer.resumeTime();
             auto result = map->Put(key ,my_vals);
@@ -240,7 +245,7 @@ int main (int argc,char* argv[])
         Timer remote_get_map_timer=Timer();
         /*Remote map test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_get_map_timer.resumeTime();
             auto result = map->Get(key);
@@ -20,9 +20,14 @@
 #include <signal.h>
 #include <execinfo.h>
 #include <chrono>
+#include <thread>
 #include <map>
+#include <numeric>
+#include <algorithm>
 #include <hcl/common/data_structures.h>
 #include <hcl/unordered_map/unordered_map.h>
+#include "check.h"
+#include "keys.h"
 
 struct KeyType{
     size_t a;
@@ -81,11 +86,15 @@ int main (int argc,char* argv[])
     long size_of_request=1000;
     bool debug=false;
     bool server_on_node=false;
+    bool huge_pages=false;
+    bool numa_local=false;
     if(argc > 1)    ranks_per_server = atoi(argv[1]);
     if(argc > 2)    num_request = atoi(argv[2]);
     if(argc > 3)    size_of_request = (long)atol(argv[3]);
     if(argc > 4)    server_on_node = (bool)atoi(argv[4]);
     if(argc > 5)    debug = (bool)atoi(argv[5]);
+    if(argc > 6)    huge_pages = (bool)atoi(argv[6]);
+    if(argc > 7)    numa_local = (bool)atoi(argv[7]);
 
     int len;
     char processor_name[MPI_MAX_PROCESSOR_NAME];
@@ -123,6 +132,28 @@ int main (int argc,char* argv[])
     HCL_CONF->SERVER_ON_NODE = server_on_node || is_server;
     HCL_CONF->SERVER_LIST_PATH = "./server_list";
 
+    /* keys the partitioner of the containers places on this server and on the next one */
+    size_t local_key = key_on_server(my_server, num_servers);
+    size_t remote_key = key_on_server((my_server + 1) % num_servers, num_servers);
+    /* small integers, whose std::hash is the identity, spread over all servers of the ring */
+    std::vector<size_t> keys_of_server(num_servers);
+    hcl::ring_partitioner ring(num_servers);
+    for (size_t key = 0; key < HCL_CONF->RING_VIRTUAL_NODES; key++) keys_of_server[ring(std::hash<size_t>()(key))]++;
+    for (size_t keys : keys_of_server) CHECK(keys > 0);
+    HCL_CONF->MEMORY_HUGEPAGES = huge_pages;
+    HCL_CONF->MEMORY_NUMA_POLICY = numa_local ? NUMA_LOCAL : NUMA_DEFAULT;
+    /* servers forward operations on keys that moved to each other in the elastic phase */
+    HCL_CONF->RPC_THREADS = std::max<uint16_t>(HCL_CONF->RPC_THREADS, 2);
+    /* fit the distinct keys phase, in whole huge pages, so that the segment does not grow while it is measured */
+    const really_long huge_page = 2ULL * 1024 * 1024;
+    really_long distinct_bytes = 2ULL * ranks_per_server * num_request * sizeof(my_vals);
+    HCL_CONF->MEMORY_ALLOCATED = std::max(HCL_CONF->MEMORY_ALLOCATED,
+                                          (distinct_bytes + huge_page - 1) / huge_page * huge_page);
+    if (my_rank == 0) {
+        printf("segment %lu MB, huge pages %d, numa local %d\n",
+               (unsigned long)(HCL_CONF->MEMORY_ALLOCATED / 1024 / 1024), huge_pages, numa_local);
+    }
+
     hcl::unordered_map<KeyType,std::array<int, array_size>> *map;
     if (is_server) {
         map = new hcl::unordered_map<KeyType,std::array<int,array_size>>();
@@ -132,6 +163,85 @@ int main (int argc,char* argv[])
         map = new hcl::unordered_map<KeyType,std::array<int,array_size>>();
     }
 
+    /* a map whose clients cache remote Gets for a lease */
+    const int lease_ms = 50;
+    HCL_CONF->CLIENT_CACHE_LEASE_MS = lease_ms;
+    hcl::unordered_map<KeyType,std::array<int,array_size>> *lease_map;
+    if (is_server) {
+        lease_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_LEASE_MAP");
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!is_server) {
+        lease_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_LEASE_MAP");
+        lease_map->server_on_node = false;
+    }
+    HCL_CONF->CLIENT_CACHE_LEASE_MS = 0;
+
+    /*
+     * Maps keeping a copy of every key on the next server, see the
+     * replication phase: synchronous, asynchronous, and bounded.
+     */
+    typedef hcl::unordered_map<KeyType,std::array<int,array_size>> replicated_map;
+    replicated_map *sync_map = nullptr, *async_map = nullptr, *bounded_map = nullptr;
+    const uint64_t bounded_entries = 64;
+    auto open_replicated = [&](replicated_map *&replicated, const char *name, ReplicationMode mode) {
+        if (is_server) replicated = new replicated_map(name, HCL_CONF->RPC_PORT, hcl::ReplicationOptions(2, mode, READ_ANY));
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (!is_server) replicated = new replicated_map(name, HCL_CONF->RPC_PORT, hcl::ReplicationOptions(2, mode, READ_ANY));
+    };
+    if (num_servers > 1) {
+        open_replicated(sync_map, "TEST_SYNC_MAP", REPLICATE_SYNC);
+        open_replicated(async_map, "TEST_ASYNC_MAP", REPLICATE_ASYNC);
+        HCL_CONF->CACHE_CAPACITY_ENTRIES = bounded_entries;
+        open_replicated(bounded_map, "TEST_BOUNDED_REPLICATED_MAP", REPLICATE_SYNC);
+        HCL_CONF->CACHE_CAPACITY_ENTRIES = 0;
+    }
+
+    /* maps evicting past a bound of each server, see the eviction phase */
+    const uint64_t eviction_entries = 256;
+    hcl::unordered_map<KeyType,std::array<int,array_size>> *lru_map, *clock_map;
+    HCL_CONF->CACHE_CAPACITY_ENTRIES = eviction_entries;
+    for (EvictionPolicy policy : {EVICT_LRU, EVICT_CLOCK}) {
+        HCL_CONF->CACHE_EVICTION_POLICY = policy;
+        const char *name = policy == EVICT_LRU ? "TEST_LRU_MAP" : "TEST_CLOCK_MAP";
+        auto &evicting = policy == EVICT_LRU ? lru_map : clock_map;
+        if (is_server) {
+            evicting = new hcl::unordered_map<KeyType,std::array<int,array_size>>(name);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (!is_server) {
+            evicting = new hcl::unordered_map<KeyType,std::array<int,array_size>>(name);
+        }
+    }
+    HCL_CONF->CACHE_CAPACITY_ENTRIES = 0;
+    HCL_CONF->CACHE_EVICTION_POLICY = EVICT_LRU;
+
+    /* a map for the expiration phase, holding nothing else */
+    hcl::unordered_map<KeyType,std::array<int,array_size>> *ttl_map;
+    if (is_server) {
+        ttl_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_TTL_MAP");
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!is_server) {
+        ttl_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_TTL_MAP");
+    }
+
+    /* a map whose servers join and leave, see the elastic phase */
+    HCL_CONF->DYN_CONFIG = true;
+    hcl::unordered_map<KeyType,std::array<int,array_size>> *elastic_map;
+    if (is_server) {
+        elastic_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_ELASTIC_MAP");
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (!is_server) {
+        elastic_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_ELASTIC_MAP");
+    }
+    HCL_CONF->DYN_CONFIG = false;
+
+    /* every rank binds the callback; the server runs it and only sends the sum back */
+    map->BindCallback<long>("Sum", std::function<long(std::array<int, array_size> &)>(
+            [](std::array<int, array_size> &value) { return std::accumulate(value.begin(), value.end(), 0L); }));
+
     std::unordered_map<KeyType,std::array<int, array_size>> lmap=std::unordered_map<KeyType,std::array<int, array_size>>();
 
     MPI_Comm client_comm;
@@ -151,7 +261,7 @@ int main (int argc,char* argv[])
         std::hash<KeyType> keyHash;
         /*Local std::map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_map_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -163,7 +273,7 @@ int main (int argc,char* argv[])
 
         Timer llocal_get_map_timer=Timer();
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             llocal_get_map_timer.resumeTime();
             size_t key_hash = keyHash(KeyType(val))%num_servers;
             if (key_hash == my_server && is_server){}
@@ -182,7 +292,7 @@ int main (int argc,char* argv[])
         Timer local_map_timer=Timer();
         /*Local map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_map_timer.resumeTime();
             map->Put(key,my_vals);
@@ -193,7 +303,7 @@ int main (int argc,char* argv[])
         Timer local_get_map_timer=Timer();
         /*Local map test*/
         for(int i=0;i<num_request;i++){
-            size_t val=my_server;
+            size_t val=local_key;
             auto key=KeyType(val);
             local_get_map_timer.resumeTime();
             auto result = map->Get(key);
@@ -202,23 +312,68 @@ int main (int argc,char* argv[])
 
         double local_get_map_throughput=num_request/local_get_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
 
-        double local_put_tp_result, local_get_tp_result;
+        Timer local_view_map_timer=Timer();
+        /*Local map test reading the value in place*/
+        long view_checksum = 0;
+        for(int i=0;i<num_request;i++){
+            size_t val=local_key;
+            auto key=KeyType(val);
+            local_view_map_timer.resumeTime();
+            map->GetView(key, [&view_checksum](const std::array<int, array_size> &value) {
+                view_checksum += value[0];
+            });
+            local_view_map_timer.pauseTime();
+        }
+        double local_view_map_throughput=num_request/local_view_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        double local_put_tp_result, local_get_tp_result, local_view_tp_result;
         if (client_comm_size > 1) {
             MPI_Reduce(&local_map_throughput, &local_put_tp_result, 1,
                        MPI_DOUBLE, MPI_SUM, 0, client_comm);
             MPI_Reduce(&local_get_map_throughput, &local_get_tp_result, 1,
                        MPI_DOUBLE, MPI_SUM, 0, client_comm);
+            MPI_Reduce(&local_view_map_throughput, &local_view_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
             local_put_tp_result /= client_comm_size;
             local_get_tp_result /= client_comm_size;
+            local_view_tp_result /= client_comm_size;
         }
         else {
             local_put_tp_result = local_map_throughput;
             local_get_tp_result = local_get_map_throughput;
+            local_view_tp_result = local_view_map_throughput;
         }
 
         if (my_rank==0) {
             printf("local_map_throughput put: %f\n", local_put_tp_result);
             printf("local_map_throughput get: %f\n", local_get_tp_result);
+            printf("local_map_throughput get view: %f\n", local_view_tp_result);
+        }
+
+        MPI_Barrier(client_comm);
+        Timer distinct_map_timer=Timer();
+        /*Local map test on distinct keys of the same server: scales with the ranks as long as they hit different shards*/
+        size_t distinct_key = (size_t)my_rank << 36;
+        for(int i=0;i<num_request;i++){
+            distinct_key = key_on_server(my_server, num_servers, distinct_key + 1);
+            auto key=KeyType(distinct_key);
+            distinct_map_timer.resumeTime();
+            map->Put(key,my_vals);
+            distinct_map_timer.pauseTime();
+        }
+        double distinct_map_throughput=num_request/distinct_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        double distinct_put_tp_result;
+        if (client_comm_size > 1) {
+            MPI_Reduce(&distinct_map_throughput, &distinct_put_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
+        }
+        else {
+            distinct_put_tp_result = distinct_map_throughput;
+        }
+
+        if (my_rank==0) {
+            printf("local_map_throughput put (distinct keys, %d ranks, aggregate): %f\n", client_comm_size, distinct_put_tp_result);
         }
 
         MPI_Barrier(client_comm);
@@ -226,7 +381,7 @@ int main (int argc,char* argv[])
         Timer remote_map_timer=Timer();
         /*Remote map test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_map_timer.resumeTime();
             map->Put(key
@@ -240,7 +395,7 @@ int main (int argc,char* argv[])
         Timer remote_get_map_timer=Timer();
         /*Remote map test*/
         for(int i=0;i<num_request;i++){
-            size_t val = my_server+1;
+            size_t val = remote_key;
             auto key=KeyType(val);
             remote_get_map_timer.resumeTime();
             map->Get(key);
@@ -266,8 +421,388 @@ int main (int argc,char* argv[])
             printf("remote map throughput (put): %f\n",remote_put_tp_result);
             printf("remote map throughput (get): %f\n",remote_get_tp_result);
         }
+
+        MPI_Barrier(client_comm);
+
+        Timer async_map_timer=Timer();
+        /*Remote async map test: keep all requests in flight before waiting*/
+        std::vector<std::future<bool>> put_futures;
+        put_futures.reserve(num_request);
+        async_map_timer.resumeTime();
+        for(int i=0;i<num_request;i++){
+            size_t val = remote_key;
+            auto key=KeyType(val);
+            put_futures.push_back(map->AsyncPut(key,my_vals));
+        }
+        for(auto &future:put_futures) future.get();
+        async_map_timer.pauseTime();
+        double async_map_throughput=num_request/async_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        double async_put_tp_result;
+        if (client_comm_size > 1) {
+            MPI_Reduce(&async_map_throughput, &async_put_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
+            async_put_tp_result /= client_comm_size;
+        }
+        else {
+            async_put_tp_result = async_map_throughput;
+        }
+
+        if(my_rank == 0) {
+            printf("remote map throughput (async put): %f\n",async_put_tp_result);
+        }
+
+        MPI_Barrier(client_comm);
+
+        Timer callback_map_timer=Timer();
+        /*Remote callback map test: the value stays on the server*/
+        for(int i=0;i<num_request;i++){
+            size_t val = remote_key;
+            auto key=KeyType(val);
+            callback_map_timer.resumeTime();
+            map->GetWithCallback<long>(key, "Sum");
+            callback_map_timer.pauseTime();
+        }
+        double callback_map_throughput=num_request/callback_map_timer.getElapsedTime()*1000*size_of_elem*my_vals.size()/1024/1024;
+
+        double callback_get_tp_result;
+        if (client_comm_size > 1) {
+            MPI_Reduce(&callback_map_throughput, &callback_get_tp_result, 1,
+                       MPI_DOUBLE, MPI_SUM, 0, client_comm);
+            callback_get_tp_result /= client_comm_size;
+        }
+        else {
+            callback_get_tp_result = callback_map_throughput;
+        }
+
+        if(my_rank == 0) {
+            printf("remote map throughput (get with callback): %f\n",callback_get_tp_result);
+        }
+
+        MPI_Barrier(client_comm);
+        /*Snapshot and Restore: the first client of every server restores its segment to the snapshot*/
+        bool server_leader = my_rank % ranks_per_server == 0;
+        std::string snapshot = HCL_CONF->BACKED_FILE_DIR.string() + "/TEST_UNORDERED_MAP_snapshot_" + std::to_string(my_server);
+        auto restore_key = [&](int i) { return KeyType(((size_t)1 << 40) + (size_t)my_rank * num_request + i); };
+        std::array<int, array_size> restore_val = my_vals;
+        for(int i=0;i<num_request;i++){
+            auto key=restore_key(i);
+            restore_val[0] = i;
+            CHECK(map->Put(key, restore_val));
+        }
+        MPI_Barrier(client_comm);
+        if (server_leader) CHECK(map->Snapshot(snapshot) && map->WaitSnapshot());
+        MPI_Barrier(client_comm);
+        for(int i=0;i<num_request;i++){
+            auto key=restore_key(i);
+            restore_val[0] = -1;
+            if (i % 2 == 0) map->Put(key, restore_val);
+            else map->Erase(key);
+        }
+        MPI_Barrier(client_comm);
+        if (server_leader) CHECK(map->Restore(snapshot));
+        MPI_Barrier(client_comm);
+        for(int i=0;i<num_request;i++){
+            auto key=restore_key(i);
+            auto result = map->Get(key);
+            CHECK(result.first && result.second[0] == i);
+        }
+        MPI_Barrier(client_comm);
+        if (server_leader) std::remove(snapshot.c_str());
+        if (my_rank == 0) printf("snapshot and restore: ok\n");
+
+        MPI_Barrier(client_comm);
+        /*
+         * Lease cache: a Put of another rank shows once the lease of the
+         * cached value ends, also when a Restore rewound the server in between.
+         */
+        int client_rank;
+        MPI_Comm_rank(client_comm, &client_rank);
+        bool writer = client_rank == 0, reader = client_rank == client_comm_size - 1;
+        std::string lease_snapshot = HCL_CONF->BACKED_FILE_DIR.string() + "/TEST_LEASE_MAP_snapshot_" + std::to_string(my_server);
+        auto lease_key = KeyType(((size_t)1 << 41));
+        std::array<int, array_size> lease_val = my_vals;
+        auto lease_put = [&](int version) {
+            lease_val[0] = version;
+            if (writer) CHECK(lease_map->Put(lease_key, lease_val));
+            MPI_Barrier(client_comm);
+        };
+        lease_put(1);
+        if (server_leader) CHECK(lease_map->Snapshot(lease_snapshot) && lease_map->WaitSnapshot());
+        MPI_Barrier(client_comm);
+        lease_put(2);
+        if (reader) CHECK(lease_map->Get(lease_key).second[0] == 2);
+        MPI_Barrier(client_comm);
+        if (server_leader) CHECK(lease_map->Restore(lease_snapshot));
+        MPI_Barrier(client_comm);
+        /* the server wrote as many times as when the reader cached 2 */
+        lease_put(3);
+        if (reader) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2 * lease_ms));
+            auto result = lease_map->Get(lease_key);
+            CHECK(result.first && result.second[0] == 3);
+            /* unchanged: the server only renews the lease */
+            std::this_thread::sleep_for(std::chrono::milliseconds(2 * lease_ms));
+            CHECK(lease_map->Get(lease_key).second[0] == 3);
+        }
+        MPI_Barrier(client_comm);
+        if (server_leader) std::remove(lease_snapshot.c_str());
+        if (my_rank == 0) printf("lease cache invalidation: ok\n");
+
+        /*
+         * Replication: with READ_ANY every client reads the copies on its
+         * own server, so together they read both copies of every key. They
+         * hold a synchronous write once it returned, an asynchronous one
+         * soon after, and the same keys once a bounded map evicted.
+         */
+        if (num_servers > 1) {
+            auto replica_key = [&](int rank, int i) { return KeyType(((size_t)1 << 44) + (size_t)rank * num_request + i); };
+            /* checks every key of every client, until it holds or deadline passed */
+            auto all_keys = [&](std::function<bool(KeyType &, int)> holds, int deadline_ms) {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(deadline_ms);
+                for (int rank = 0; rank < comm_size; rank++) {
+                    if ((rank + 1) % ranks_per_server == 0) continue;
+                    for (int i = 0; i < num_request; i++) {
+                        auto key = replica_key(rank, i);
+                        while (!holds(key, i)) {
+                            CHECK(std::chrono::steady_clock::now() < deadline);
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                    }
+                }
+            };
+            std::array<int, array_size> replica_val = my_vals;
+            for (int i = 0; i < num_request; i++) {
+                auto key = replica_key(my_rank, i);
+                replica_val[0] = i;
+                CHECK(sync_map->Put(key, replica_val));
+                CHECK(async_map->Put(key, replica_val));
+            }
+            MPI_Barrier(client_comm);
+            all_keys([&](KeyType &key, int i) {
+                auto result = sync_map->Get(key);
+                CHECK(result.first && result.second[0] == i);
+                return true;
+            }, 0);
+            all_keys([&](KeyType &key, int i) {
+                auto result = async_map->Get(key);
+                return result.first && result.second[0] == i;
+            }, 10000);
+            MPI_Barrier(client_comm);
+            for (int i = 0; i < num_request; i++) {
+                auto key = replica_key(my_rank, i);
+                CHECK(sync_map->Erase(key).first);
+            }
+            MPI_Barrier(client_comm);
+            all_keys([&](KeyType &key, int) {
+                CHECK(!sync_map->Get(key).first);
+                return true;
+            }, 0);
+            for (int i = 0; i < num_request; i++) {
+                auto key = replica_key(my_rank, i);
+                replica_val[0] = i;
+                CHECK(bounded_map->Put(key, replica_val));
+            }
+            MPI_Barrier(client_comm);
+            /* how many clients found each key, all of them or none */
+            std::vector<int> found, found_by;
+            all_keys([&](KeyType &key, int) {
+                found.push_back(bounded_map->Get(key).first ? 1 : 0);
+                return true;
+            }, 0);
+            found_by.resize(found.size());
+            MPI_Allreduce(found.data(), found_by.data(), (int)found.size(), MPI_INT, MPI_SUM, client_comm);
+            for (int count : found_by) CHECK(count == 0 || count == client_comm_size);
+            CHECK(bounded_map->Evictions() > 0);
+            MPI_Barrier(client_comm);
+            if (my_rank == 0) printf("replication and replica reads: ok\n");
+        }
     }
     MPI_Barrier(MPI_COMM_WORLD);
+
+    /*
+     * Eviction: one client writes four times what the servers may keep,
+     * reading a hot key before every Put. Each server keeps its bound for all
+     * its shards together, evicts the rest and never the hot key.
+     */
+    if (is_client) {
+        int client_rank;
+        MPI_Comm_rank(client_comm, &client_rank);
+        if (client_rank == 0) {
+            auto eviction_key = [](size_t i) { return KeyType(((size_t)1 << 44) + i); };
+            size_t keys = 4 * eviction_entries * num_servers;
+            std::array<int, array_size> eviction_val = my_vals;
+            for (auto *evicting : {lru_map, clock_map}) {
+                KeyType hot = eviction_key(0);
+                eviction_val[0] = 0;
+                CHECK(evicting->Put(hot, eviction_val));
+                for (size_t i = 1; i < keys; i++) {
+                    CHECK(evicting->Get(hot).first);
+                    eviction_val[0] = (int)i;
+                    CHECK(evicting->Put(eviction_key(i), eviction_val));
+                }
+                CHECK(evicting->Get(hot).first);
+                size_t kept = evicting->GetAllData().size();
+                CHECK(kept <= eviction_entries * num_servers);
+                CHECK(kept + evicting->Evictions() == keys);
+            }
+            printf("lru and clock eviction: ok\n");
+        }
+        MPI_Barrier(client_comm);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /*
+     * Expiration: keys put with a short time to live are gone from Get and
+     * GetAllData once it passed, keys put without one stay.
+     */
+    if (is_client) {
+        const int ttl_ms = 100;
+        const int ttl_keys = std::min(num_request, 1000);
+        auto ttl_key = [&](int i, bool expiring) {
+            return KeyType(((size_t)expiring << 40) + (size_t)my_rank * ttl_keys + i);
+        };
+        std::array<int, array_size> ttl_val = my_vals;
+        for (int i = 0; i < ttl_keys; i++) {
+            ttl_val[0] = i;
+            CHECK(ttl_map->Put(ttl_key(i, true), ttl_val, std::chrono::milliseconds(ttl_ms)));
+            CHECK(ttl_map->Put(ttl_key(i, false), ttl_val));
+        }
+        MPI_Barrier(client_comm);
+        std::this_thread::sleep_for(std::chrono::milliseconds(3 * ttl_ms));
+        for (int i = 0; i < ttl_keys; i++) {
+            auto expired = ttl_key(i, true), kept = ttl_key(i, false);
+            CHECK(!ttl_map->Get(expired).first);
+            auto result = ttl_map->Get(kept);
+            CHECK(result.first && result.second[0] == i);
+        }
+        auto all_data = ttl_map->GetAllData();
+        CHECK(all_data.size() == (size_t)ttl_keys * client_comm_size);
+        for (auto &entry : all_data) CHECK(entry.first.a < ((size_t)1 << 40));
+        MPI_Barrier(client_comm);
+        if (my_rank == 0) printf("expiration: ok\n");
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /*
+     * Elastic servers: the last server leaves, then joins and leaves again
+     * while the clients keep writing; every key written stays readable.
+     */
+    if (num_servers > 1) {
+        bool mover = is_server && my_server == num_servers - 1;
+        auto elastic_key = [&](size_t i) { return KeyType(((size_t)1 << 42) + ((size_t)my_rank << 32) + i); };
+        std::array<int, array_size> elastic_val = my_vals;
+        size_t written = 0;
+        auto write = [&]() {
+            auto key = elastic_key(written);
+            elastic_val[0] = (int)written;
+            CHECK(elastic_map->Put(key, elastic_val));
+            ++written;
+        };
+        if (mover) CHECK(elastic_map->Leave());
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (is_client) {
+            for (int i = 0; i < num_request; i++) write();
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (mover) CHECK(elastic_map->Join() && elastic_map->Leave());
+        MPI_Request moved;
+        MPI_Ibarrier(MPI_COMM_WORLD, &moved);
+        if (is_client) {
+            int done = 0;
+            while (!done) {
+                write();
+                MPI_Test(&moved, &done, MPI_STATUS_IGNORE);
+            }
+            for (size_t i = 0; i < written; i++) {
+                auto key = elastic_key(i);
+                auto result = elastic_map->Get(key);
+                CHECK(result.first && result.second[0] == (int)i);
+            }
+        } else {
+            MPI_Wait(&moved, MPI_STATUS_IGNORE);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (my_rank == 0) printf("elastic servers under load: ok\n");
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    /*
+     * Crash recovery: the servers keep the segment of a persistent map, mark a
+     * write to it as interrupted and open it again, first refusing the file
+     * and then accepting it; every key written stays readable.
+     */
+    HCL_CONF->MEMORY_PERSISTENT = true;
+    std::string persistent_file = HCL_CONF->BACKED_FILE_DIR.string() + "/TEST_PERSISTENT_MAP_" + std::to_string(my_server);
+    auto persistent_key = [&](int i) { return KeyType(((size_t)1 << 43) + (size_t)my_rank * num_request + i); };
+    auto open_persistent = [&]() {
+        hcl::unordered_map<KeyType,std::array<int,array_size>> *persistent_map;
+        if (is_server) {
+            persistent_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_PERSISTENT_MAP");
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (!is_server) {
+            persistent_map = new hcl::unordered_map<KeyType,std::array<int,array_size>>("TEST_PERSISTENT_MAP");
+        }
+        return persistent_map;
+    };
+    auto close_persistent = [&](hcl::unordered_map<KeyType,std::array<int,array_size>> *persistent_map) {
+        /* the server flushes and unmaps the file once the clients on its node did */
+        if (!is_server) delete(persistent_map);
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (is_server) delete(persistent_map);
+        MPI_Barrier(MPI_COMM_WORLD);
+    };
+    /* from an earlier run */
+    if (is_server) std::remove(persistent_file.c_str());
+    auto persistent_map = open_persistent();
+    std::array<int, array_size> persistent_val = my_vals;
+    if (is_client) {
+        for(int i=0;i<num_request;i++){
+            auto key=persistent_key(i);
+            persistent_val[0] = i;
+            CHECK(persistent_map->Put(key, persistent_val));
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    close_persistent(persistent_map);
+    if (is_server) {
+        boost::interprocess::managed_mapped_file file(boost::interprocess::open_only, persistent_file.c_str());
+        file.find<hcl::PersistentHeader>("hcl_header").first->pending_writes.store(1);
+        file.flush();
+        bool refused = false;
+        try {
+            hcl::unordered_map<KeyType,std::array<int,array_size>> refusing("TEST_PERSISTENT_MAP");
+        } catch (const std::runtime_error &) {
+            refused = true;
+        }
+        CHECK(refused);
+    }
+    HCL_CONF->MEMORY_RECOVERY = RECOVER_ACCEPT;
+    persistent_map = open_persistent();
+    if (is_client) {
+        for(int i=0;i<num_request;i++){
+            auto key=persistent_key(i);
+            auto result = persistent_map->Get(key);
+            CHECK(result.first && result.second[0] == i);
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    close_persistent(persistent_map);
+    if (is_server) std::remove(persistent_file.c_str());
+    HCL_CONF->MEMORY_PERSISTENT = false;
+    HCL_CONF->MEMORY_RECOVERY = RECOVER_REFUSE;
+    if (my_rank == 0) printf("persistent segment recovery: ok\n");
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    delete(elastic_map);
+    delete(ttl_map);
+    delete(clock_map);
+    delete(lru_map);
+    delete(bounded_map);
+    delete(async_map);
+    delete(sync_map);
+    delete(lease_map);
     delete(map);
     MPI_Finalize();
     exit(EXIT_SUCCESS);